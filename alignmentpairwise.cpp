@@ -19,6 +19,7 @@
  ***************************************************************************/
 #include "alignmentpairwise.h"
 #include "phylosupertree.h"
+#include "model/modelgtr.h"
 
 AlignmentPairwise::AlignmentPairwise()
         : Alignment(), Optimization()
@@ -134,18 +135,24 @@ double AlignmentPairwise::computeFunction(double value) {
 		return lh;
 	}
     
-    double *trans_mat = new double[trans_size];
+    // matrices of all categories are computed in one call
+    double *trans_mat = new double[trans_size * ncat];
+    double *cat_time = new double[ncat];
+    for (cat = 0; cat < ncat; cat++)
+        cat_time[cat] = value * site_rate->getRate(cat);
 
     // categorized rates
     if (site_rate->getPtnCat(0) >= 0) {
+        tree->getModelFactory()->computeTransMatrixBatch(ncat, cat_time, trans_mat);
         for (cat = 0; cat < ncat; cat++) {
-            tree->getModelFactory()->computeTransMatrix(value*site_rate->getRate(cat), trans_mat);
             double *pair_pos = pair_freq + cat*trans_size;
+            double *trans_cat = trans_mat + cat*trans_size;
             for (i = 0; i < trans_size; i++) if (pair_pos[i] > Params::getInstance().min_branch_length) {
-                    if (trans_mat[i] <= 0) throw "Negative transition probability";
-                    lh -= pair_pos[i] * log(trans_mat[i]);
+                    if (trans_cat[i] <= 0) throw "Negative transition probability";
+                    lh -= pair_pos[i] * log(trans_cat[i]);
                 }
         }
+        delete [] cat_time;
         delete [] trans_mat;
         return lh;
     }
@@ -155,17 +162,19 @@ double AlignmentPairwise::computeFunction(double value) {
     if (tree->getModelFactory()->site_rate->getGammaShape() == 0.0)
         tree->getModelFactory()->computeTransMatrix(value, sum_trans_mat);
     else {
-        tree->getModelFactory()->computeTransMatrix(value * site_rate->getRate(0), sum_trans_mat);
+        tree->getModelFactory()->computeTransMatrixBatch(ncat, cat_time, trans_mat);
+        memcpy(sum_trans_mat, trans_mat, trans_size * sizeof(double));
         for (cat = 1; cat < ncat; cat++) {
-            tree->getModelFactory()->computeTransMatrix(value * site_rate->getRate(cat), trans_mat);
+            double *trans_cat = trans_mat + cat*trans_size;
             for (i = 0; i < trans_size; i++)
-                sum_trans_mat[i] += trans_mat[i];
+                sum_trans_mat[i] += trans_cat[i];
         }
     }
     for (i = 0; i < trans_size; i++) {
         lh -= pair_freq[i] * log(sum_trans_mat[i]);
     }
     delete [] sum_trans_mat;
+    delete [] cat_time;
     delete [] trans_mat;
     // negative log-likelihood (for minimization)
     return lh;
@@ -221,27 +230,39 @@ void AlignmentPairwise::computeFuncDerv(double value, double &df, double &ddf) {
         return;
     }
 
-    double *trans_mat = new double[trans_size];
-	double *trans_derv1 = new double[trans_size];
-	double *trans_derv2 = new double[trans_size];
+    // matrices and derivatives of all categories are computed in one call
+    double *trans_mat = new double[trans_size * ncat];
+	double *trans_derv1 = new double[trans_size * ncat];
+	double *trans_derv2 = new double[trans_size * ncat];
+    double *cat_rate = new double[ncat];
+    double *cat_time = new double[ncat];
 
     // categorized rates
     if (site_rate->getPtnCat(0) >= 0) {
         for (cat = 0; cat < ncat; cat++) {
-            double rate_val = site_rate->getRate(cat);
+            cat_rate[cat] = site_rate->getRate(cat);
+            cat_time[cat] = value * cat_rate[cat];
+        }
+        tree->getModelFactory()->computeTransDervBatch(ncat, cat_time, trans_mat, trans_derv1, trans_derv2);
+        for (cat = 0; cat < ncat; cat++) {
+            double rate_val = cat_rate[cat];
             double derv1 = 0.0, derv2 = 0.0;
-            tree->getModelFactory()->computeTransDerv(value*rate_val, trans_mat, trans_derv1, trans_derv2);
             double *pair_pos = pair_freq + cat*trans_size;
+            double *trans_cat = trans_mat + cat*trans_size;
+            double *derv1_cat = trans_derv1 + cat*trans_size;
+            double *derv2_cat = trans_derv2 + cat*trans_size;
             for (i = 0; i < trans_size; i++) if (pair_pos[i] > 0) {
-                    if (trans_mat[i] <= 0) throw "Negative transition probability";
-                    double d1 = trans_derv1[i] / trans_mat[i];
+                    if (trans_cat[i] <= 0) throw "Negative transition probability";
+                    double d1 = derv1_cat[i] / trans_cat[i];
                     derv1 += pair_pos[i] * d1;
-                    derv2 += pair_pos[i] * (trans_derv2[i]/trans_mat[i] - d1 * d1);
+                    derv2 += pair_pos[i] * (derv2_cat[i]/trans_cat[i] - d1 * d1);
 //                    lh -= pair_pos[i] * log(trans_mat[i]);
                 }
             df -= derv1 * rate_val;
             ddf -= derv2 * rate_val * rate_val;
         }
+        delete [] cat_time;
+        delete [] cat_rate;
         delete [] trans_derv2;
 		delete [] trans_derv1;
 		delete [] trans_mat;
@@ -258,16 +279,22 @@ void AlignmentPairwise::computeFuncDerv(double value, double &df, double &ddf) {
     memset(sum_derv2, 0, sizeof(double) * trans_size);
 
     for (cat = 0; cat < ncat; cat++) {
-        double rate_val = site_rate->getRate(cat);
+        cat_rate[cat] = site_rate->getRate(cat);
         if (tree->getModelFactory()->site_rate->getGammaShape() == 0.0)
-            rate_val = 1.0;
-
+            cat_rate[cat] = 1.0;
+        cat_time[cat] = value * cat_rate[cat];
+    }
+    tree->getModelFactory()->computeTransDervBatch(ncat, cat_time, trans_mat, trans_derv1, trans_derv2);
+    for (cat = 0; cat < ncat; cat++) {
+        double rate_val = cat_rate[cat];
         double rate_sqr = rate_val * rate_val;
-        tree->getModelFactory()->computeTransDerv(value * rate_val, trans_mat, trans_derv1, trans_derv2);
+        double *trans_cat = trans_mat + cat*trans_size;
+        double *derv1_cat = trans_derv1 + cat*trans_size;
+        double *derv2_cat = trans_derv2 + cat*trans_size;
         for (i = 0; i < trans_size; i++) {
-            sum_trans[i] += trans_mat[i];
-            sum_derv1[i] += trans_derv1[i] * rate_val;
-            sum_derv2[i] += trans_derv2[i] * rate_sqr;
+            sum_trans[i] += trans_cat[i];
+            sum_derv1[i] += derv1_cat[i] * rate_val;
+            sum_derv2[i] += derv2_cat[i] * rate_sqr;
         }
     }
     for (i = 0; i < trans_size; i++) 
@@ -280,6 +307,8 @@ void AlignmentPairwise::computeFuncDerv(double value, double &df, double &ddf) {
     delete [] sum_derv2;
 	delete [] sum_derv1;
 	delete [] sum_trans;
+    delete [] cat_time;
+    delete [] cat_rate;
 	delete [] trans_derv2;
 	delete [] trans_derv1;
 	delete [] trans_mat;
@@ -318,3 +347,235 @@ AlignmentPairwise::~AlignmentPairwise()
 }
 
 
+
+/****************************************************************************
+        AlignmentPairwiseBatch
+ ****************************************************************************/
+
+AlignmentPairwiseBatch::AlignmentPairwiseBatch(PhyloTree *atree) {
+    tree = atree;
+    model = dynamic_cast<ModelGTR*>(tree->getModel());
+    assert(model);
+    Alignment *aln = tree->aln;
+    num_states = aln->num_states;
+    nseq = aln->getNSeq();
+    nptn = aln->getNPattern();
+    seq_states = new char[(size_t)nseq * nptn];
+    ptn_freq = new int[nptn];
+    for (int ptn = 0; ptn < nptn; ptn++) {
+        Pattern &pat = aln->at(ptn);
+        ptn_freq[ptn] = pat.frequency;
+        for (int seq = 0; seq < nseq; seq++)
+            seq_states[(size_t)seq * nptn + ptn] = pat[seq];
+    }
+    RateHeterogeneity *site_rate = tree->getRate();
+    int ncat = site_rate->getNDiscreteRate();
+    cat_rates.resize(ncat, 1.0);
+    if (site_rate->getGammaShape() != 0.0)
+        for (int cat = 0; cat < ncat; cat++)
+            cat_rates[cat] = site_rate->getRate(cat);
+}
+
+AlignmentPairwiseBatch::~AlignmentPairwiseBatch() {
+    delete [] ptn_freq;
+    delete [] seq_states;
+}
+
+bool AlignmentPairwiseBatch::isSupported(PhyloTree *atree) {
+    if (atree->isSuperTree() || !atree->getModelFactory() || !atree->getRate() || !atree->optimize_by_newton)
+        return false;
+    RateHeterogeneity *site_rate = atree->getRate();
+    ModelSubst *model = atree->getModel();
+    if (site_rate->isSiteSpecificRate() || model->isSiteSpecificModel() || model->isMixture() || !model->isReversible())
+        return false;
+    // pattern-specific categories use a different likelihood in AlignmentPairwise
+    if (site_rate->getPtnCat(0) >= 0)
+        return false;
+    ModelGTR *gtr = dynamic_cast<ModelGTR*>(model);
+    return gtr && gtr->getEigenCoeff() && gtr->getEigenvalues();
+}
+
+void AlignmentPairwiseBatch::computeFuncDerv(int num_pairs, bool *active, double *value, int *entry_start,
+		int *entry_idx, double *entry_freq, double *df, double *ddf, double *exptime) {
+    int ncat = cat_rates.size();
+    double *eval = model->getEigenvalues();
+    double *eigen_coeff = model->getEigenCoeff();
+    double total_num_subst = model->total_num_subst;
+    double min_freq = Params::getInstance().min_branch_length;
+    int pair, cat, k;
+
+    for (pair = 0; pair < num_pairs; pair++) {
+        if (!active[pair]) continue;
+        // exp(lambda*t) for all categories, as in ModelGTR::computeTransDerv
+        for (cat = 0; cat < ncat; cat++) {
+            double evol_time = (value[pair] * cat_rates[cat]) / total_num_subst;
+            double *exp_cat = exptime + cat*num_states;
+            for (k = 0; k < num_states; k++)
+                exp_cat[k] = exp(evol_time * eval[k]);
+        }
+        double pair_df = 0.0, pair_ddf = 0.0;
+        for (int e = entry_start[pair]; e < entry_start[pair+1]; e++) {
+            double *coeff = eigen_coeff + entry_idx[e]*num_states;
+            double sum_trans = 0.0, sum_derv1 = 0.0, sum_derv2 = 0.0;
+            for (cat = 0; cat < ncat; cat++) {
+                double *exp_cat = exptime + cat*num_states;
+                double rate_val = cat_rates[cat];
+                double trans_val = 0.0, derv1 = 0.0, derv2 = 0.0;
+                for (k = 0; k < num_states; k++) {
+                    double trans = coeff[k] * exp_cat[k];
+                    double trans2 = trans * eval[k];
+                    trans_val += trans;
+                    derv1 += trans2;
+                    derv2 += trans2 * eval[k];
+                }
+                if (trans_val < 0.0)
+                    trans_val = 0.0;
+                sum_trans += trans_val;
+                sum_derv1 += derv1 * rate_val;
+                sum_derv2 += derv2 * (rate_val * rate_val);
+            }
+            if (entry_freq[e] > min_freq && sum_trans > 0) {
+                double d1 = sum_derv1 / sum_trans;
+                pair_df -= entry_freq[e] * d1;
+                pair_ddf -= entry_freq[e] * (sum_derv2/sum_trans - d1 * d1);
+            }
+        }
+        df[pair] = pair_df;
+        ddf[pair] = pair_ddf;
+    }
+}
+
+void AlignmentPairwiseBatch::optimizeDist(int num_pairs, int *seq1, int *seq2, double *dist, double *d2l) {
+    int size_sqr = num_states * num_states;
+    int pair, i;
+    if (num_pairs <= 0)
+        return;
+
+    // packed pair-state histograms: only non-zero entries
+    vector<int> entry_start(num_pairs+1, 0);
+    vector<int> entry_idx;
+    DoubleVector entry_freq;
+    vector<int> hist(size_sqr, 0);
+    entry_idx.reserve(num_pairs * min(size_sqr, nptn));
+    entry_freq.reserve(num_pairs * min(size_sqr, nptn));
+    for (pair = 0; pair < num_pairs; pair++) {
+        const char *states1 = seq_states + (size_t)seq1[pair] * nptn;
+        const char *states2 = seq_states + (size_t)seq2[pair] * nptn;
+        int total_pos = 0, diff_pos = 0;
+        for (int ptn = 0; ptn < nptn; ptn++) {
+            int state1 = states1[ptn];
+            int state2 = states2[ptn];
+            if (state1 >= num_states || state2 >= num_states) continue;
+            hist[state1*num_states + state2] += ptn_freq[ptn];
+            total_pos += ptn_freq[ptn];
+            if (state1 != state2)
+                diff_pos += ptn_freq[ptn];
+        }
+        for (i = 0; i < size_sqr; i++)
+            if (hist[i]) {
+                entry_idx.push_back(i);
+                entry_freq.push_back(hist[i]);
+                hist[i] = 0;
+            }
+        entry_start[pair+1] = entry_idx.size();
+        if (dist[pair] != 0.0)
+            continue;
+        // initial guess: JC distance as in Alignment::computeJCDist
+        if (!total_pos) {
+            if (verbose_mode >= VB_MED)
+                outWarning("No overlapping characters between " + tree->aln->getSeqName(seq1[pair]) + " and " + tree->aln->getSeqName(seq2[pair]));
+            dist[pair] = MAX_GENETIC_DIST;
+            continue;
+        }
+        double z = (double)num_states / (num_states-1);
+        double x = 1.0 - (z * ((double)diff_pos) / total_pos);
+        dist[pair] = (x <= 0) ? MAX_GENETIC_DIST : -log(x) / z;
+    }
+
+    if (entry_idx.empty()) {
+        // no overlapping characters at all; keep valid storage for computeFuncDerv
+        entry_idx.push_back(0);
+        entry_freq.push_back(0.0);
+    }
+
+    // Newton-Raphson in lock-step over all pairs, following Optimization::minimizeNewton
+    double x1 = Params::getInstance().min_branch_length, x2 = MAX_GENETIC_DIST;
+    double xacc = Params::getInstance().min_branch_length;
+    int maxNRStep = 100;
+    DoubleVector rts(num_pairs), rts_old(num_pairs), xl(num_pairs), xh(num_pairs), dx(num_pairs), dxold(num_pairs);
+    DoubleVector f(num_pairs), df(num_pairs);
+    DoubleVector exptime(cat_rates.size() * num_states);
+    vector<int> step(num_pairs, 0);
+    bool *active = new bool[num_pairs];
+    int num_active = num_pairs;
+
+    for (pair = 0; pair < num_pairs; pair++) {
+        rts[pair] = dist[pair];
+        if (rts[pair] < x1) rts[pair] = x1;
+        if (rts[pair] > x2) rts[pair] = x2;
+        active[pair] = true;
+    }
+
+    while (num_active > 0) {
+        computeFuncDerv(num_pairs, active, &rts[0], &entry_start[0], &entry_idx[0], &entry_freq[0],
+            &f[0], &df[0], &exptime[0]);
+        for (pair = 0; pair < num_pairs; pair++) {
+            if (!active[pair]) continue;
+            if (!isfinite(f[pair]) || !isfinite(df[pair]))
+                nrerror("Wrong computeFuncDerv");
+            bool done = false;
+            if (step[pair] == 0) {
+                d2l[pair] = df[pair];
+                if (df[pair] >= 0.0 && fabs(f[pair]) < xacc) {
+                    done = true;
+                } else {
+                    if (f[pair] < 0.0) {
+                        xl[pair] = rts[pair];
+                        xh[pair] = x2;
+                    } else {
+                        xh[pair] = rts[pair];
+                        xl[pair] = x1;
+                    }
+                    dx[pair] = dxold[pair] = fabs(xh[pair]-xl[pair]);
+                }
+            } else {
+                if (df[pair] > 0.0 && fabs(f[pair]) < xacc) {
+                    d2l[pair] = df[pair];
+                    done = true;
+                } else if (f[pair] < 0.0)
+                    xl[pair] = rts[pair];
+                else
+                    xh[pair] = rts[pair];
+            }
+            if (!done) {
+                step[pair]++;
+                rts_old[pair] = rts[pair];
+                if (df[pair] <= 0.0 ||
+                    ((rts[pair]-xh[pair])*df[pair]-f[pair])*((rts[pair]-xl[pair])*df[pair]-f[pair]) >= 0.0) {
+                    dxold[pair] = dx[pair];
+                    dx[pair] = 0.5*(xh[pair]-xl[pair]);
+                    rts[pair] = xl[pair]+dx[pair];
+                    d2l[pair] = df[pair];
+                    if (xl[pair] == rts[pair]) done = true;
+                } else {
+                    dxold[pair] = dx[pair];
+                    dx[pair] = f[pair]/df[pair];
+                    double temp = rts[pair];
+                    rts[pair] -= dx[pair];
+                    d2l[pair] = df[pair];
+                    if (temp == rts[pair]) done = true;
+                }
+                if (!done && (fabs(dx[pair]) < xacc || step[pair] == maxNRStep)) {
+                    rts[pair] = rts_old[pair];
+                    done = true;
+                }
+            }
+            if (done) {
+                dist[pair] = rts[pair];
+                active[pair] = false;
+                num_active--;
+            }
+        }
+    }
+    delete [] active;
+}
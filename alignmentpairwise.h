@@ -97,4 +97,72 @@ public:
 	int seq_id1, seq_id2;
 };
 
+class ModelGTR;
+
+/**
+	Batched ML distance computation for many sequence pairs at once.
+	Sequences are stored sequence-major so that pair-state histograms of a block of
+	pairs are built from rows that stay in cache. Only non-zero histogram entries are
+	kept, and their transition probabilities are computed from the eigen coefficients
+	of the model, without building full transition matrices. Newton-Raphson
+	(same steps as Optimization::minimizeNewton) runs in lock-step over all pairs of
+	a tile. Results are identical to AlignmentPairwise::optimizeDist().
+*/
+class AlignmentPairwiseBatch
+{
+public:
+	/**
+		@param atree tree with alignment, model and site rates
+	*/
+	AlignmentPairwiseBatch(PhyloTree *atree);
+
+	/**
+		@param atree a phylogenetic tree
+		@return TRUE if the model and rate heterogeneity of atree are supported
+	*/
+	static bool isSupported(PhyloTree *atree);
+
+	/**
+		compute ML distances for a tile of sequence pairs, thread-safe
+		@param num_pairs number of pairs
+		@param seq1 first sequence IDs
+		@param seq2 second sequence IDs
+		@param dist (IN) initial distances, 0.0 to start from the JC distance; (OUT) ML distances
+		@param d2l (OUT) second derivative of the likelihood at the ML distances
+	*/
+	void optimizeDist(int num_pairs, int *seq1, int *seq2, double *dist, double *d2l);
+
+	~AlignmentPairwiseBatch();
+
+	/** number of sequences per block when tiling pairs */
+	static const int BLOCK_SIZE = 16;
+
+protected:
+
+	/**
+		compute first and second derivatives of the negative log-likelihood for active pairs
+	*/
+	void computeFuncDerv(int num_pairs, bool *active, double *value, int *entry_start,
+		int *entry_idx, double *entry_freq, double *df, double *ddf, double *exptime);
+
+	PhyloTree *tree;
+
+	ModelGTR *model;
+
+	int num_states;
+
+	int nseq;
+
+	int nptn;
+
+	/** nseq*nptn states, sequence-major */
+	char *seq_states;
+
+	/** pattern frequencies */
+	int *ptn_freq;
+
+	/** rate of each category as used by AlignmentPairwise::computeFuncDerv */
+	DoubleVector cat_rates;
+};
+
 #endif
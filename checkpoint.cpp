@@ -9,6 +9,8 @@
 #include "tools.h"
 #include "timeutil.h"
 #include "gzstream.h"
+#include "mpihelper.h"
+#include <string.h>
 
 
 Checkpoint::Checkpoint() {
@@ -16,21 +18,34 @@ Checkpoint::Checkpoint() {
     prev_dump_time = 0;
     dump_interval = 30; // dumping at most once per 30 seconds
     struct_name = "";
+    binary_dump = false;
+    compact_bytes = journal_bytes = 0;
+    need_compact = true;
+    write_failed = false;
+#ifdef _USE_PTHREADS
+    writer_running = false;
+#endif
 }
 
 
 Checkpoint::~Checkpoint() {
+    waitDump();
 }
 
 
 const char* CKP_HEADER = "--- # IQ-TREE Checkpoint";
 
+/** magic bytes at the start of a binary checkpoint file */
+const char CKP_BINARY_HEADER[] = "IQCKPB01";
+const size_t CKP_BINARY_HEADER_LEN = 8;
+
 void Checkpoint::setFileName(string filename) {
 	this->filename = filename;
 }
 void Checkpoint::load() {
 	assert(filename != "");
     if (!fileExists(filename)) return;
+    if (loadBinary()) return;
     try {
         igzstream in;
         // set the failbit and badbit
@@ -93,17 +108,187 @@ void Checkpoint::load() {
     }
 }
 
+static bool readBinaryString(FILE *in, string &str) {
+    uint32_t len;
+    if (fread(&len, sizeof(len), 1, in) != 1)
+        return false;
+    str.resize(len);
+    return len == 0 || fread(&str[0], 1, len, in) == len;
+}
+
+static void writeBinaryString(FILE *out, const string &str) {
+    uint32_t len = str.length();
+    fwrite(&len, sizeof(len), 1, out);
+    if (len)
+        fwrite(str.data(), 1, len, out);
+}
+
+/*
+ * binary format: CKP_BINARY_HEADER, then records of
+ * 'P' <uint32 key length> <key> <uint32 value length> <value> to put a key, or
+ * 'E' <uint32 key length> <key> to erase a key
+ */
+bool Checkpoint::loadBinary() {
+    FILE *in = fopen(filename.c_str(), "rb");
+    if (!in)
+        outError(ERR_READ_INPUT, filename);
+    char header[CKP_BINARY_HEADER_LEN];
+    if (fread(header, 1, CKP_BINARY_HEADER_LEN, in) != CKP_BINARY_HEADER_LEN ||
+        memcmp(header, CKP_BINARY_HEADER, CKP_BINARY_HEADER_LEN) != 0) {
+        fclose(in);
+        return false;
+    }
+    string key, value;
+    int op;
+    // replay the journal, a truncated last record (interrupted dump) is ignored
+    while ((op = fgetc(in)) != EOF) {
+        if (!readBinaryString(in, key))
+            break;
+        if (op == 'P') {
+            if (!readBinaryString(in, value))
+                break;
+            (*this)[key] = value;
+        } else if (op == 'E') {
+            erase(key);
+        } else {
+            fclose(in);
+            outError("Invalid checkpoint file " + filename);
+        }
+    }
+    fclose(in);
+    return true;
+}
+
+void Checkpoint::writeBinary() {
+    FILE *out;
+    uint64_t bytes = 0;
+    if (need_compact) {
+        // write a full snapshot and atomically replace the old file
+        string tmp_file = filename + ".tmp";
+        out = fopen(tmp_file.c_str(), "wb");
+        if (!out) {
+            write_failed = true;
+            return;
+        }
+        fwrite(CKP_BINARY_HEADER, 1, CKP_BINARY_HEADER_LEN, out);
+        bytes = CKP_BINARY_HEADER_LEN;
+        for (iterator it = dumped.begin(); it != dumped.end(); it++) {
+            fputc('P', out);
+            writeBinaryString(out, it->first);
+            writeBinaryString(out, it->second);
+            bytes += 9 + it->first.length() + it->second.length();
+        }
+        if (fclose(out) != 0) {
+            write_failed = true;
+            return;
+        }
+#if defined WIN32 || defined _WIN32 || defined __WIN32__
+        // rename does not overwrite on Windows
+        remove(filename.c_str());
+#endif
+        if (rename(tmp_file.c_str(), filename.c_str()) != 0) {
+            write_failed = true;
+            return;
+        }
+        compact_bytes = bytes;
+        journal_bytes = 0;
+        need_compact = false;
+    } else {
+        out = fopen(filename.c_str(), "ab");
+        if (!out) {
+            write_failed = true;
+            return;
+        }
+        for (vector<pair<string, string*> >::iterator it = journal.begin(); it != journal.end(); it++) {
+            fputc(it->second ? 'P' : 'E', out);
+            writeBinaryString(out, it->first);
+            bytes += 5 + it->first.length();
+            if (it->second) {
+                writeBinaryString(out, *it->second);
+                bytes += 4 + it->second->length();
+            }
+        }
+        if (fclose(out) != 0) {
+            write_failed = true;
+            return;
+        }
+        journal_bytes += bytes;
+    }
+    journal.clear();
+}
+
+void *Checkpoint::writeBinaryThread(void *ckp) {
+    ((Checkpoint*)ckp)->writeBinary();
+    return NULL;
+}
+
 void Checkpoint::setDumpInterval(double interval) {
     dump_interval = interval;
 }
 
+void Checkpoint::setBinaryDump(bool binary) {
+    waitDump();
+    binary_dump = binary;
+    need_compact = true;
+}
+
+void Checkpoint::waitDump() {
+#ifdef _USE_PTHREADS
+    if (writer_running) {
+        pthread_join(writer_thread, NULL);
+        writer_running = false;
+    }
+#endif
+    if (write_failed) {
+        write_failed = false;
+        outError(ERR_WRITE_OUTPUT, filename);
+    }
+}
 
 void Checkpoint::dump(bool force) {
 	assert(filename != "");
+	// in the distributed tree search only the master process owns the checkpoint
+	if (!MPIHelper::getInstance().isMaster())
+		return;
     if (!force && getRealTime() < prev_dump_time + dump_interval) {
         return;
     }
     prev_dump_time = getRealTime();
+    if (binary_dump) {
+        // previous dump must be finished before touching dumped and journal
+        waitDump();
+        // collect keys changed since the last dump
+        iterator it = begin(), dit = dumped.begin();
+        while (it != end() || dit != dumped.end()) {
+            if (dit == dumped.end() || (it != end() && it->first < dit->first)) {
+                dit = dumped.insert(dit, *it);
+                journal.push_back(make_pair(it->first, &dit->second));
+                it++; dit++;
+            } else if (it == end() || dit->first < it->first) {
+                journal.push_back(make_pair(dit->first, (string*)NULL));
+                dumped.erase(dit++);
+            } else {
+                if (it->second != dit->second) {
+                    dit->second = it->second;
+                    journal.push_back(make_pair(it->first, &dit->second));
+                }
+                it++; dit++;
+            }
+        }
+        if (journal_bytes > compact_bytes)
+            need_compact = true;
+        if (journal.empty() && !need_compact)
+            return;
+#ifdef _USE_PTHREADS
+        if (!force && pthread_create(&writer_thread, NULL, writeBinaryThread, this) == 0) {
+            writer_running = true;
+            return;
+        }
+#endif
+        writeBinary();
+        waitDump();
+        return;
+    }
     try {
         ogzstream out;
         out.exceptions(ios::failbit | ios::badbit);
@@ -9,12 +9,20 @@
 #define CHECKPOINT_H_
 
 #include <stdio.h>
+#include <stdint.h>
 #include <map>
 #include <string>
 #include <sstream>
 #include <cassert>
 #include <vector>
 #include <typeinfo>
+#ifdef _USE_PTHREADS
+#if defined (_MSC_VER)
+#include "pthread.h"
+#else
+#include <pthread.h>
+#endif
+#endif
 
 using namespace std;
 
@@ -81,6 +89,19 @@ public:
     */
     void setDumpInterval(double interval);
 
+    /**
+        switch to binary, incremental checkpoint file: only changed keys are appended
+        to a journal by a background thread, the file is compacted once the journal
+        grows larger than the last full snapshot
+        @param binary TRUE for binary format, FALSE for text format
+    */
+    void setBinaryDump(bool binary);
+
+    /**
+        wait until the background writer has finished the last dump
+    */
+    void waitDump();
+
 	/**
 	 * @return true if checkpoint contains the key
 	 * @param key key to search for
@@ -324,7 +345,41 @@ protected:
     
     /** dumping time interval */
     double dump_interval;
-    
+
+    /** TRUE to dump in binary, incremental format */
+    bool binary_dump;
+
+    /** checkpoint content as currently in the binary file (or being written to it) */
+    map<string, string> dumped;
+
+    /** changed (key,value) pairs to append to the journal by the writer, erased keys have a NULL value */
+    vector<pair<string, string*> > journal;
+
+    /** size of the last compacted snapshot and of the journal appended to it (bytes) */
+    uint64_t compact_bytes, journal_bytes;
+
+    /** TRUE if the next binary dump must write a full snapshot */
+    bool need_compact;
+
+    /** TRUE if the last background write failed */
+    bool write_failed;
+
+#ifdef _USE_PTHREADS
+    /** background writer thread */
+    pthread_t writer_thread;
+
+    /** TRUE if writer_thread has to be joined */
+    bool writer_running;
+#endif
+
+    /** load binary checkpoint file, @return FALSE if the file is not in binary format */
+    bool loadBinary();
+
+    /** write the pending binary dump (full snapshot or journal), called by the writer thread */
+    void writeBinary();
+
+    static void *writeBinaryThread(void *ckp);
+
 private:
 
     /** name of the current nested key */
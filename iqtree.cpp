@@ -27,6 +27,7 @@
 #include <numeric>
 #include "pll/pllInternal.h"
 #include "pllnni.h"
+#include "mpihelper.h"
 #include "vectorclass/vectorclass.h"
 #include "vectorclass/vectormath_common.h"
 
@@ -46,6 +47,10 @@ void IQTree::init() {
     k_delete = k_delete_min = k_delete_max = k_delete_stay = 0;
     dist_matrix = NULL;
     var_matrix = NULL;
+    boot_ptn_lh = NULL;
+    boot_ptn_lh_orig = NULL;
+    boot_rell = NULL;
+    nni_workers_lh_bytes = 0;
     nni_count_est = 0.0;
     nni_delta_est = 0;
 //    curScore = 0.0; // Current score of the tree
@@ -372,6 +377,13 @@ IQTree::~IQTree() {
     	aligned_free(boot_samples[0]); // free memory
         boot_samples.clear();
     }
+    if (boot_rell)
+        aligned_free(boot_rell);
+    if (boot_ptn_lh_orig)
+        aligned_free(boot_ptn_lh_orig);
+    if (boot_ptn_lh)
+        aligned_free(boot_ptn_lh);
+    deleteNNIWorkers();
 }
 
 extern const char *aa_model_names_rax[];
@@ -586,7 +598,8 @@ void IQTree::createInitTrees(int nParTrees) {
     int numDupPars = 0;
 #ifdef _OPENMP
     StrVector pars_trees;
-    if (params->start_tree == STT_PARSIMONY && nParTrees >= 1) {
+    // with -parspar every tree is built in turn by all threads instead
+    if (params->start_tree == STT_PARSIMONY && nParTrees >= 1 && !params->pars_parallel) {
         pars_trees.resize(nParTrees);
         #pragma omp parallel
         {
@@ -623,11 +636,14 @@ void IQTree::createInitTrees(int nParTrees) {
         } else if (params->start_tree == STT_PARSIMONY) {
             /********* Create parsimony tree using IQ-TREE *********/
 #ifdef _OPENMP
-            curParsTree = pars_trees[treeNr-1];
-#else
-            computeParsimonyTree(NULL, aln);
-            curParsTree = getTreeString();
+            if (!pars_trees.empty()) {
+                curParsTree = pars_trees[treeNr-1];
+            } else
 #endif
+            {
+                computeParsimonyTree(NULL, aln);
+                curParsTree = getTreeString();
+            }
         } else {
             assert(0);
         }
@@ -1877,10 +1893,41 @@ double IQTree::doTreeSearch() {
 
 	double cur_correlation = 0.0;
 
+	bool distributed = false;
+	if (MPIHelper::getInstance().getNumProcesses() > 1) {
+		distributed = canDistributeSearch();
+		if (distributed)
+			cout << "Distributed search with " << MPIHelper::getInstance().getNumProcesses()
+				<< " processes, exchanging candidate trees every " << params->mpi_sync_iterations << " iterations" << endl;
+		else
+			outWarning("Distributed search not supported with the chosen options, processes search independently");
+	}
+
+	bool use_walkers = false;
+	if (params->num_search_walkers > 1 && distributed) {
+		outWarning("Search walkers (-walkers) not used in the distributed search");
+	} else if (params->num_search_walkers > 1) {
+		use_walkers = canUseSearchWalkers();
+		if (use_walkers)
+			doWalkerSearch(cur_correlation);
+		else
+			outWarning("Search walkers (-walkers) not supported with the chosen options, running serial search");
+	}
+
 	/*====================================================
 	 * MAIN LOOP OF THE IQ-TREE ALGORITHM
 	 *====================================================*/
-    while(!stop_rule.meetStopCondition(stop_rule.getCurIt(), cur_correlation)) {
+    int sync_iterations = 0;
+    while(!use_walkers) {
+    	if (distributed) {
+    		if (sync_iterations % params->mpi_sync_iterations == 0) {
+    			if (syncCandidateTrees(sync_iterations, cur_correlation))
+    				break;
+    			sync_iterations = 0;
+    		}
+    	} else if (stop_rule.meetStopCondition(stop_rule.getCurIt(), cur_correlation))
+    		break;
+    	sync_iterations++;
         stop_rule.setCurIt(stop_rule.getCurIt() + 1);
         searchinfo.curIter = stop_rule.getCurIt();
         // estimate logl_cutoff for bootstrap
@@ -2080,6 +2127,10 @@ double IQTree::doTreeSearch() {
 
     readTreeString(candidateTrees.getTopTrees()[0]);
 
+    if (verbose_mode >= VB_MED)
+        cout << "NNI evaluation: " << num_nni_evaluations << " branches evaluated, "
+             << nni_heap_allocs << " heap allocations during evaluation" << endl;
+
     if (testNNI)
         outNNI.close();
     if (params->write_intermediate_trees)
@@ -2097,6 +2148,202 @@ double IQTree::doTreeSearch() {
     return candidateTrees.getBestScore();
 }
 
+bool IQTree::canDistributeSearch() {
+	// must give the same answer on all processes, hence only depends on params
+	return params->snni && !params->pll && params->gbo_replicates == 0 &&
+			params->iqp_assess_quartet != IQP_BOOTSTRAP;
+}
+
+bool IQTree::syncCandidateTrees(int num_iterations, double cur_correlation) {
+	MPIHelper &mpi = MPIHelper::getInstance();
+	int i;
+	if (mpi.isMaster())
+		stop_rule.setCurIt(stop_rule.getCurIt() + (mpi.getNumProcesses() - 1) * num_iterations);
+
+	int num_trees = min(params->popSize, (int)candidateTrees.size());
+	StrVector trees = candidateTrees.getTopTrees(num_trees);
+	DoubleVector scores = candidateTrees.getBestScores(num_trees);
+	mpi.allGatherTrees(trees, scores);
+
+	// scores of other processes are computed under their own model parameters, so a new tree is
+	// re-scored under the local model before it enters the candidate set. The sender's score screens
+	// the trees: only those reaching the local top set are re-scored, at most popSize per synchronization
+	double min_score = -DBL_MAX;
+	if (candidateTrees.size() >= params->popSize)
+		min_score = candidateTrees.getBestScores(params->popSize).back();
+	vector<pair<double, int> > order;
+	for (i = 0; i < trees.size(); i++)
+		if (scores[i] > min_score && !candidateTrees.treeExist(trees[i]))
+			order.push_back(make_pair(-scores[i], i));
+	sort(order.begin(), order.end());
+	if (order.size() > (size_t)params->popSize)
+		order.resize(params->popSize);
+	for (int j = 0; j < order.size(); j++) {
+		i = order[j].second;
+		if (candidateTrees.treeExist(trees[i]))
+			continue;
+		readTreeString(trees[i]);
+		computeLogL();
+		curScore = optimizeAllBranches(1);
+		string tree = getTreeString();
+		if (curScore > candidateTrees.getBestScore() + params->modeps) {
+			tree = optimizeModelParameters();
+			getModelFactory()->saveCheckpoint();
+			stop_rule.addImprovedIteration(stop_rule.getCurIt());
+			cout << "BETTER TREE RECEIVED at iteration " << stop_rule.getCurIt() << ": " << curScore << endl;
+			printResultTree();
+		}
+		candidateTrees.update(tree, curScore);
+	}
+
+	// the master decides for all processes
+	IntVector state(2);
+	if (mpi.isMaster()) {
+		state[0] = stop_rule.meetStopCondition(stop_rule.getCurIt(), cur_correlation);
+		state[1] = stop_rule.getCurIt();
+	}
+	mpi.broadcastInts(state);
+	stop_rule.setCurIt(state[1]);
+	return state[0];
+}
+
+bool IQTree::canUseSearchWalkers() {
+	// walkers only run the randomized NNI perturbation and the IQ-TREE NNI search,
+	// options that record every evaluated tree or NNI stay with the serial search
+	return params->snni && !params->iqp && !params->pll && !isSuperTree() &&
+			params->gbo_replicates == 0 && iqp_assess_quartet != IQP_BOOTSTRAP &&
+			!params->fix_stable_splits && !params->reduction && !params->count_trees &&
+			!params->write_intermediate_trees && !params->print_tree_lh &&
+			!params->print_site_posterior && !estimate_nni_cutoff && !testNNI;
+}
+
+void IQTree::doWalkerSearch(double cur_correlation) {
+	int num_walkers = params->num_search_walkers;
+	int w;
+	cout << "Running " << num_walkers << " search walkers per round" << endl;
+
+	vector<IQTree*> walkers(num_walkers);
+	for (w = 0; w < num_walkers; w++) {
+		walkers[w] = new IQTree(aln);
+		walkers[w]->attachSearchWalker(this);
+	}
+	StrVector perturb_trees(num_walkers), imd_trees(num_walkers);
+	DoubleVector perturb_scores(num_walkers), imd_scores(num_walkers);
+	IntVector iterations(num_walkers), nni_counts(num_walkers), nni_steps(num_walkers);
+
+    while (!stop_rule.meetStopCondition(stop_rule.getCurIt(), cur_correlation)) {
+    	/*----------------------------------------
+    	 * Perturb the trees of all walkers, serially to draw random numbers in a fixed order
+    	 *---------------------------------------*/
+    	int num_active = 0;
+    	while (num_active < num_walkers && !stop_rule.meetStopCondition(stop_rule.getCurIt(), cur_correlation)) {
+            stop_rule.setCurIt(stop_rule.getCurIt() + 1);
+            iterations[num_active] = stop_rule.getCurIt();
+        	int numStableBranches = aln->getNSeq() - 3 - candidateTrees.getStableSplits().size();
+            int numNNI = floor(searchinfo.curPerStrength * numStableBranches);
+            readTreeString(candidateTrees.getRandCandTree());
+            doRandomNNIs(numNNI);
+            perturb_trees[num_active] = getTreeString();
+            num_active++;
+    	}
+
+    	/*----------------------------------------
+    	 * Optimize the perturbed trees with NNI concurrently
+    	 *---------------------------------------*/
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(params->num_threads)
+#endif
+    	for (w = 0; w < num_active; w++) {
+    		IQTree *walker = walkers[w];
+    		walker->searchinfo.curIter = iterations[w];
+    		walker->readTreeString(perturb_trees[w]);
+    		walker->initializeAllPartialLh();
+    		walker->computeLogL();
+    		perturb_scores[w] = walker->curScore;
+    		imd_trees[w] = walker->doNNISearch(nni_counts[w], nni_steps[w]);
+    		imd_scores[w] = walker->curScore;
+    	}
+
+    	/*----------------------------------------
+    	 * Merge the local optima into the candidate set in walker order
+    	 *---------------------------------------*/
+    	for (w = 0; w < num_active; w++) {
+    		int cur_it = iterations[w];
+    		string imd_tree = imd_trees[w];
+    		curScore = imd_scores[w];
+    		num_nni_evaluations += walkers[w]->num_nni_evaluations;
+    		nni_heap_allocs += walkers[w]->nni_heap_allocs;
+    		walkers[w]->num_nni_evaluations = walkers[w]->nni_heap_allocs = 0;
+
+            cout.setf(ios::fixed, ios::floatfield);
+            if (cur_it % 10 == 0 || verbose_mode >= VB_MED) {
+    			cout << "Iteration " << cur_it << " / LogL: ";
+    			if (verbose_mode >= VB_MED)
+    				cout << perturb_scores[w] << " -> ";
+    			cout << curScore;
+    			if (verbose_mode >= VB_MED)
+    				cout << " / (NNIs, Steps): (" << nni_counts[w] << "," << nni_steps[w] << ")";
+    			cout << " / Time: " << convert_time(getRealTime() - params->start_real_time);
+    			if (cur_it > 10)
+    				cout << " (" << convert_time(stop_rule.getRemainingTime(cur_it, cur_correlation)) << " left)";
+    			cout << endl;
+            }
+
+            if (curScore > candidateTrees.getBestScore() + params->modeps) {
+            	// re-estimate the model on the new best tree; walkers pick the new
+            	// parameters up in the next round
+            	readTreeString(imd_tree);
+            	initializeAllPartialLh();
+            	imd_tree = optimizeModelParameters();
+            	getModelFactory()->saveCheckpoint();
+                if (!candidateTrees.treeExist(imd_tree)) {
+                    stop_rule.addImprovedIteration(cur_it);
+                    cout << "BETTER TREE FOUND at iteration " << cur_it << ": " << curScore << endl;
+                } else {
+                    cout << "UPDATE BEST LOG-LIKELIHOOD: " << curScore << endl;
+                }
+                printResultTree();
+            }
+
+        	candidateTrees.update(imd_tree, curScore);
+        	if (verbose_mode >= VB_MED)
+            	printBestScores(params->popSize);
+    	}
+
+        saveCheckpoint();
+        checkpoint->dump();
+    }
+
+	for (w = num_walkers - 1; w >= 0; w--) {
+		walkers[w]->detachSearchWalker();
+		delete walkers[w];
+	}
+}
+
+void IQTree::attachSearchWalker(IQTree *master) {
+	aln = master->aln;
+	params = master->params;
+	model = master->model;
+	site_rate = master->site_rate;
+	model_factory = master->model_factory;
+	optimize_by_newton = master->optimize_by_newton;
+	partial_lh_float = master->partial_lh_float;
+	force_double_lh = master->force_double_lh;
+	rooted = master->rooted;
+	setLikelihoodKernel(master->sse);
+	searchinfo = master->searchinfo;
+	nni_cutoff = master->nni_cutoff;
+	nni_sort = master->nni_sort;
+	fastNNI = master->fastNNI;
+}
+
+void IQTree::detachSearchWalker() {
+	aln = NULL;
+	model = NULL;
+	site_rate = NULL;
+	model_factory = NULL;
+}
+
 /****************************************************************************
  Fast Nearest Neighbor Interchange by maximum likelihood
  ****************************************************************************/
@@ -2560,6 +2807,12 @@ void IQTree::evalNNIs(PhyloNode *node, PhyloNode *dad) {
 }
 
 void IQTree::evalNNIs(NodeVector& nodes1, NodeVector& nodes2) {
+	if (params->nni_parallel && params->num_threads > 1 && nodes1.size() > 1 && !isSuperTree() &&
+		(sse == LK_EIGEN || sse == LK_EIGEN_SSE) && !params->lh_mem_limit && params->lh_mem_save != LM_PER_NODE &&
+		save_all_trees != 2 && !params->upper_bound_NNI) {
+		evalNNIsParallel(nodes1, nodes2);
+		return;
+	}
 	if (!nodes1.empty()) {
 		assert(!nodes2.empty());
 		assert(nodes1.size() == nodes2.size());
@@ -2577,6 +2830,93 @@ void IQTree::evalNNIs(NodeVector& nodes1, NodeVector& nodes2) {
     }
 }
 
+void IQTree::evalNNIsParallel(NodeVector &nodes1, NodeVector &nodes2) {
+	assert(nodes1.size() == nodes2.size());
+	int num_threads = params->num_threads;
+	size_t num_branches = nodes1.size();
+	size_t i;
+
+	// workers read the partial likelihoods around their branches concurrently,
+	// so all of them must be available before the parallel region
+	computeTipPartialLikelihood();
+	computeAllPartialLh();
+
+	if (nni_workers_lh_bytes != getPartialLhBytes())
+		deleteNNIWorkers();
+	while (nni_workers.size() < num_threads)
+		nni_workers.push_back(new PhyloTree);
+	for (i = 0; i < nni_workers.size(); i++)
+		nni_workers[i]->attachNNIWorker(this);
+	nni_workers_lh_bytes = getPartialLhBytes();
+
+	// an NNI on (node1,node2) temporarily rewires node1, node2 and their neighbors:
+	// greedily assign each branch to the first round where none of these nodes is taken
+	vector<IntVector> rounds;
+	IntVector pending(num_branches);
+	for (i = 0; i < num_branches; i++)
+		pending[i] = i;
+	while (!pending.empty()) {
+		vector<bool> taken(nodeNum, false);
+		IntVector round, postponed;
+		for (IntVector::iterator it = pending.begin(); it != pending.end(); it++) {
+			Node *node1 = nodes1[*it], *node2 = nodes2[*it];
+			assert(isInnerBranch(node1, node2));
+			bool free_branch = !taken[node1->id] && !taken[node2->id];
+			FOR_NEIGHBOR_DECLARE(node1, node2, nit)
+				free_branch &= !taken[(*nit)->node->id];
+			FOR_NEIGHBOR(node2, node1, nit)
+				free_branch &= !taken[(*nit)->node->id];
+			if (!free_branch) {
+				postponed.push_back(*it);
+				continue;
+			}
+			taken[node1->id] = taken[node2->id] = true;
+			FOR_NEIGHBOR(node1, node2, nit)
+				taken[(*nit)->node->id] = true;
+			FOR_NEIGHBOR(node2, node1, nit)
+				taken[(*nit)->node->id] = true;
+			round.push_back(*it);
+		}
+		rounds.push_back(round);
+		pending = postponed;
+	}
+
+	vector<NNIMove> moves(num_branches);
+	for (vector<IntVector>::iterator rit = rounds.begin(); rit != rounds.end(); rit++) {
+		int round_size = rit->size();
+		int j;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+#endif
+		for (j = 0; j < round_size; j++) {
+			int thread_id = 0;
+#ifdef _OPENMP
+			thread_id = omp_get_thread_num();
+#endif
+			int branch = (*rit)[j];
+			moves[branch] = nni_workers[thread_id]->getBestNNIForBran((PhyloNode*)nodes1[branch], (PhyloNode*)nodes2[branch], NULL);
+		}
+	}
+
+	for (i = 0; i < num_branches; i++)
+		if (moves[i].newloglh > curScore + params->loglh_epsilon)
+			addPositiveNNIMove(moves[i]);
+	for (i = 0; i < nni_workers.size(); i++) {
+		num_nni_evaluations += nni_workers[i]->num_nni_evaluations;
+		nni_heap_allocs += nni_workers[i]->nni_heap_allocs;
+		nni_workers[i]->num_nni_evaluations = nni_workers[i]->nni_heap_allocs = 0;
+	}
+}
+
+void IQTree::deleteNNIWorkers() {
+	for (vector<PhyloTree*>::reverse_iterator it = nni_workers.rbegin(); it != nni_workers.rend(); it++) {
+		(*it)->detachNNIWorker();
+		delete (*it);
+	}
+	nni_workers.clear();
+	nni_workers_lh_bytes = 0;
+}
+
 /**
  *  Currently not used, commented out to simplify the interface of getBestNNIForBran
 void IQTree::evalNNIsSort(bool approx_nni) {
@@ -2687,16 +3027,24 @@ void IQTree::saveCurrentTree(double cur_logl) {
 
 #ifdef BOOT_VAL_FLOAT
     int maxnptn = get_safe_upper_limit_float(nptn);
-    BootValType *pattern_lh = aligned_alloc<BootValType>(maxnptn);
-    memset(pattern_lh, 0, maxnptn*sizeof(BootValType));
-    double *pattern_lh_orig = aligned_alloc<double>(nptn);
+#else
+    int maxnptn = get_safe_upper_limit(nptn);
+#endif
+    // buffers are allocated once, padding behind nptn stays zero
+    if (!boot_ptn_lh) {
+        boot_ptn_lh = aligned_alloc<BootValType>(maxnptn);
+        memset(boot_ptn_lh, 0, maxnptn*sizeof(BootValType));
+#ifdef BOOT_VAL_FLOAT
+        boot_ptn_lh_orig = aligned_alloc<double>(nptn);
+#endif
+    }
+    BootValType *pattern_lh = boot_ptn_lh;
+#ifdef BOOT_VAL_FLOAT
+    double *pattern_lh_orig = boot_ptn_lh_orig;
     computePatternLikelihood(pattern_lh_orig, &cur_logl);
     for (int i = 0; i < nptn; i++)
     	pattern_lh[i] = (float)pattern_lh_orig[i];
 #else
-    int maxnptn = get_safe_upper_limit(nptn);
-    BootValType *pattern_lh = aligned_alloc<BootValType>(maxnptn);
-    memset(pattern_lh, 0, maxnptn*sizeof(BootValType));
     computePatternLikelihood(pattern_lh, &cur_logl);
 #endif
 
@@ -2720,20 +3068,16 @@ void IQTree::saveCurrentTree(double cur_logl) {
         }
         double rand_double = random_double();
 
+        // RELL scores of all bootstrap samples as one matrix-vector product
+        if (!boot_rell)
+            boot_rell = aligned_alloc<BootValType>(nsamples);
+        (this->*dotProductMulti)(pattern_lh, boot_samples[0], maxnptn, nsamples, nptn, boot_rell);
+
         #ifdef _OPENMP
         #pragma omp parallel for
         #endif
         for (int sample = 0; sample < nsamples; sample++) {
-            double rell = 0.0;
-
-            {
-            	// SSE optimized version of the above loop
-				BootValType *boot_sample = boot_samples[sample];
-
-				BootValType res = (this->*dotProduct)(pattern_lh, boot_sample, nptn);
-
-				rell = res;
-            }
+            double rell = boot_rell[sample];
 
             bool better = rell > boot_logl[sample] + params->ufboot_epsilon;
             if (!better && rell > boot_logl[sample] - params->ufboot_epsilon) {
@@ -2772,30 +3116,17 @@ void IQTree::saveCurrentTree(double cur_logl) {
         out_sitelh << endl;
     }
 
-    if (!boot_samples.empty()) {
-#ifdef BOOT_VAL_FLOAT
-    	aligned_free(pattern_lh_orig);
-#endif
-    	aligned_free(pattern_lh);
-    } else {
-#ifdef BOOT_VAL_FLOAT
-    	aligned_free(pattern_lh);
-#endif
-    }
-
 }
 
 void IQTree::saveNNITrees(PhyloNode *node, PhyloNode *dad) {
     if (!node) {
         node = (PhyloNode*) root;
+        if (nni_ptn_lh.size() != 2*aln->getNPattern())
+            nni_ptn_lh.resize(2*aln->getNPattern());
     }
     if (dad && !node->isLeaf() && !dad->isLeaf()) {
-        double *pat_lh1 = new double[aln->getNPattern()];
-        double *pat_lh2 = new double[aln->getNPattern()];
         double lh1, lh2;
-        computeNNIPatternLh(curScore, lh1, pat_lh1, lh2, pat_lh2, node, dad);
-        delete[] pat_lh2;
-        delete[] pat_lh1;
+        computeNNIPatternLh(curScore, lh1, &nni_ptn_lh[0], lh2, &nni_ptn_lh[aln->getNPattern()], node, dad);
     }
     FOR_NEIGHBOR_IT(node, dad, it)saveNNITrees((PhyloNode*) (*it)->node, node);
 }
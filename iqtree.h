@@ -277,6 +277,48 @@ public:
      */
     double doTreeSearch();
 
+    /**
+     * @return TRUE if the processes of an MPI run can exchange candidate trees during the search
+     */
+    bool canDistributeSearch();
+
+    /**
+     * distributed search: exchange the best candidate trees of all processes, collective call.
+     * The master counts the iterations of all processes for its stop rule and decides for all
+     * processes whether to stop.
+     * @param num_iterations number of iterations done by each process since the last exchange
+     * @param cur_correlation bootstrap correlation passed to stop_rule
+     * @return TRUE if the search should stop
+     */
+    bool syncCandidateTrees(int num_iterations, double cur_correlation);
+
+    /**
+     * @return TRUE if the stochastic search can run params->num_search_walkers walkers per round
+     */
+    bool canUseSearchWalkers();
+
+    /**
+     * main loop of the stochastic search with independent walkers (-walkers): in each round
+     * the perturbed trees of all walkers are drawn serially from the candidate set, the walkers
+     * optimize them by NNI concurrently and their local optima are merged into the candidate
+     * set in walker order, each counting as one iteration of stop_rule
+     * @param cur_correlation bootstrap correlation passed to stop_rule
+     */
+    void doWalkerSearch(double cur_correlation);
+
+    /**
+     * share alignment, model and rate heterogeneity of master with this tree, which then
+     * runs its own NNI search on its own tree and partial likelihoods
+     * @param master tree doing the search
+     */
+    void attachSearchWalker(IQTree *master);
+
+    /**
+     * release the data shared with master by attachSearchWalker, so that deleting
+     * this tree does not free them
+     */
+    void detachSearchWalker();
+
     /**
      *  Wrapper function that uses either PLL or IQ-TREE to optimize the branch length
      *  @param maxTraversal
@@ -345,6 +387,20 @@ public:
      */
     void evalNNIs(NodeVector &nodes1, NodeVector &nodes2);
 
+    /**
+     * @brief Evaluate NNIs on the branches defined by \a nodes1 and \a nodes2 concurrently.
+     * Branches are grouped into rounds in which no two branches share a node of their
+     * NNI neighborhood; branches of one round are evaluated in parallel on nni_workers.
+     * Positive NNIs are added to plusNNIs in the order of \a nodes1, as in evalNNIs().
+     *
+     * @param[in] nodes1 contains one ends of the branches for NNI evaluation
+     * @param[in] nodes2 contains the other ends of the branches for NNI evaluation
+     */
+    void evalNNIsParallel(NodeVector &nodes1, NodeVector &nodes2);
+
+    /** delete the worker trees used by evalNNIsParallel */
+    void deleteNNIWorkers();
+
     /**
             search all positive NNI move on the current tree and save them
             on the possilbleNNIMoves list
@@ -666,9 +722,20 @@ public:
     /** log-likelihood threshold (l_min) */
     double logl_cutoff;
 
-    /** vector of bootstrap alignments generated */
+    /** vector of bootstrap alignments generated, rows of one contiguous matrix */
     vector<BootValType* > boot_samples;
 
+    /** pattern likelihoods and RELL scores of the current tree, kept across saveCurrentTree calls */
+    BootValType *boot_ptn_lh;
+    double *boot_ptn_lh_orig;
+    BootValType *boot_rell;
+
+    /** worker views of this tree for concurrent NNI evaluation (-nnipar), one per thread */
+    vector<PhyloTree*> nni_workers;
+
+    /** partial likelihood vector size the worker buffers were allocated for */
+    size_t nni_workers_lh_bytes;
+
     /** newick string of corresponding bootstrap trees */
     StrVector boot_trees;
 
@@ -739,6 +806,9 @@ protected:
 
     void saveNNITrees(PhyloNode *node = NULL, PhyloNode *dad = NULL);
 
+    /** pattern likelihoods of the two NNIs in saveNNITrees, reused across branches */
+    DoubleVector nni_ptn_lh;
+
     int duplication_counter;
 
     /**
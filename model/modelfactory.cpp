@@ -83,6 +83,7 @@ ModelFactory::ModelFactory() : CheckpointFactory() {
 	is_storing = false;
 	joint_optimize = false;
 	fused_mix_rate = false;
+	fai = false;
 	unobserved_ptns = "";
 }
 
@@ -102,6 +103,7 @@ ModelFactory::ModelFactory(Params &params, PhyloTree *tree, ModelsBlock *models_
 	is_storing = false;
 	joint_optimize = params.optimize_model_rate_joint;
 	fused_mix_rate = false;
+	fai = params.fai;
 
 	string model_str = params.model_name;
 	string rate_str;
@@ -706,7 +708,7 @@ double ModelFactory::initGTRGammaIParameters(RateHeterogeneity *rate, ModelSubst
 
 double ModelFactory::optimizeParametersOnly(double gradient_epsilon) {
     double logl;
-    if (Params::getInstance().fai && site_rate != NULL && model != NULL) {
+    if (fai && site_rate != NULL && model != NULL) {
         cout << "Optimize substitutional and site rates with restart ..." << endl;
         PhyloTree* tree = site_rate->phylo_tree;
         double initAlpha = 0.1;
@@ -991,8 +993,8 @@ double ModelFactory::optimizeParameters(bool fixed_len, bool write_info,
 		*/
         double new_lh;
 
-        if (Params::getInstance().fai && i > 2) {
-            Params::getInstance().fai = false;
+        if (fai && i > 2) {
+            fai = false;
         }
 
                 // changed to opimise edge length first, and then Q,W,R inside the loop by Thomas on Sept 11, 15
@@ -1075,16 +1077,21 @@ bool ModelFactory::isUnstableParameters() {
 void ModelFactory::startStoringTransMatrix() {
 	if (!store_trans_matrix) return;
 	is_storing = true;
+	if (!trans_cache.isInitialized())
+		trans_cache.init(model->num_states * model->num_states,
+			(size_t)Params::getInstance().trans_matrix_cache_size * 1048576);
 }
 
 void ModelFactory::stopStoringTransMatrix() {
 	if (!store_trans_matrix) return;
 	is_storing = false;
-	if (!empty()) {
-		for (iterator it = begin(); it != end(); it++)
-			delete it->second;
-		clear();
-	}
+	if (trans_cache.isInitialized())
+		trans_cache.clear();
+}
+
+void ModelFactory::reportTransMatrixCache(ostream &out) {
+	if (!store_trans_matrix) return;
+	trans_cache.report(out);
 }
 
 
@@ -1097,24 +1104,25 @@ double ModelFactory::computeTrans(double time, int state1, int state2, double &d
 }
 
 void ModelFactory::computeTransMatrix(double time, double *trans_matrix) {
-	if (!store_trans_matrix || !is_storing || model->isSiteSpecificModel()) {
+	if (!store_trans_matrix || !is_storing || model->isSiteSpecificModel() || model->isMixture()) {
 		model->computeTransMatrix(time, trans_matrix);
 		return;
 	}
-	int mat_size = model->num_states * model->num_states;
-	iterator ass_it = find(round(time * 1e6));
-	if (ass_it == end()) {
-		// allocate memory for 3 matricies
-		double *trans_entry = new double[mat_size * 3];
-		trans_entry[mat_size] = trans_entry[mat_size+1] = 0.0;
-		model->computeTransMatrix(time, trans_entry);
-		ass_it = insert(value_type(round(time * 1e6), trans_entry)).first;
-	} else {
-		//if (verbose_mode >= VB_MAX) 
-			//cout << "ModelFactory bingo" << endl;
-	} 
-	
-	memcpy(trans_matrix, ass_it->second, mat_size * sizeof(double));
+	if (trans_cache.find(time, trans_matrix))
+		return;
+	model->computeTransMatrix(time, trans_matrix);
+	trans_cache.insert(time, trans_matrix);
+}
+
+void ModelFactory::computeTransMatrixBatch(int num, double *times, double *trans_matrices) {
+	if (!store_trans_matrix || !is_storing || model->isSiteSpecificModel() || model->isMixture()) {
+		model->computeTransMatrixBatch(num, times, trans_matrices);
+		return;
+	}
+	// stored matrices are looked up one by one
+	int mat_size = model->getTransMatrixSize();
+	for (int t = 0; t < num; t++)
+		computeTransMatrix(times[t], trans_matrices + t*mat_size);
 }
 
 void ModelFactory::computeTransMatrixFreq(double time, double *state_freq, double *trans_matrix) {
@@ -1133,25 +1141,25 @@ void ModelFactory::computeTransMatrixFreq(double time, double *state_freq, doubl
 
 void ModelFactory::computeTransDerv(double time, double *trans_matrix, 
 	double *trans_derv1, double *trans_derv2) {
-	if (!store_trans_matrix || !is_storing || model->isSiteSpecificModel()) {
+	if (!store_trans_matrix || !is_storing || model->isSiteSpecificModel() || model->isMixture()) {
 		model->computeTransDerv(time, trans_matrix, trans_derv1, trans_derv2);
 		return;
 	}
-	int mat_size = model->num_states * model->num_states;
-	iterator ass_it = find(round(time * 1e6));
-	if (ass_it == end()) {
-		// allocate memory for 3 matricies
-		double *trans_entry = new double[mat_size * 3];
-		trans_entry[mat_size] = trans_entry[mat_size+1] = 0.0;
-		model->computeTransDerv(time, trans_entry, trans_entry+mat_size, trans_entry+(mat_size*2));
-		ass_it = insert(value_type(round(time * 1e6), trans_entry)).first;
-	} else if (ass_it->second[mat_size] == 0.0 && ass_it->second[mat_size+1] == 0.0) {
-		double *trans_entry = ass_it->second;
-		model->computeTransDerv(time, trans_entry, trans_entry+mat_size, trans_entry+(mat_size*2));
+	if (trans_cache.find(time, trans_matrix, trans_derv1, trans_derv2))
+		return;
+	model->computeTransDerv(time, trans_matrix, trans_derv1, trans_derv2);
+	trans_cache.insert(time, trans_matrix, trans_derv1, trans_derv2);
+}
+
+void ModelFactory::computeTransDervBatch(int num, double *times, double *trans_matrices,
+	double *trans_derv1, double *trans_derv2) {
+	if (!store_trans_matrix || !is_storing || model->isSiteSpecificModel() || model->isMixture()) {
+		model->computeTransDervBatch(num, times, trans_matrices, trans_derv1, trans_derv2);
+		return;
 	}
-	memcpy(trans_matrix, ass_it->second, mat_size * sizeof(double));
-	memcpy(trans_derv1, ass_it->second + mat_size, mat_size * sizeof(double));
-	memcpy(trans_derv2, ass_it->second + (mat_size*2), mat_size * sizeof(double));
+	int mat_size = model->getTransMatrixSize();
+	for (int t = 0; t < num; t++)
+		computeTransDerv(times[t], trans_matrices + t*mat_size, trans_derv1 + t*mat_size, trans_derv2 + t*mat_size);
 }
 
 void ModelFactory::computeTransDervFreq(double time, double rate_val, double *state_freq, double *trans_matrix, 
@@ -1178,9 +1186,6 @@ void ModelFactory::computeTransDervFreq(double time, double rate_val, double *st
 
 ModelFactory::~ModelFactory()
 {
-	for (iterator it = begin(); it != end(); it++)
-		delete it->second;
-	clear();
 }
 
 /************* FOLLOWING SERVE FOR JOINT OPTIMIZATION OF MODEL AND RATE PARAMETERS *******/
@@ -25,6 +25,7 @@
 #include "rateheterogeneity.h"
 #include "modelsblock.h"
 #include "checkpoint.h"
+#include "transmatrixcache.h"
 
 
 ModelsBlock *readModelsDefinition(Params &params);
@@ -32,11 +33,11 @@ ModelsBlock *readModelsDefinition(Params &params);
 /**
 Store the transition matrix corresponding to evolutionary time so that one must not compute again. 
 For efficiency purpose esp. for protein (20x20) or codon (61x61).
-The values of the map contain 3 matricies consecutively: transition matrix, 1st, and 2nd derivative
+The matrices are kept in a bounded TransMatrixCache that can be used by several threads.
 
 	@author BUI Quang Minh <minh.bui@univie.ac.at>
 */
-class ModelFactory : public unordered_map<int, double*>, public Optimization, public CheckpointFactory
+class ModelFactory : public Optimization, public CheckpointFactory
 {
 public:
 
@@ -99,6 +100,12 @@ public:
 	*/
 	void stopStoringTransMatrix();
 
+	/**
+		print hit/miss statistics of the transition matrix cache
+		@param out output stream
+	*/
+	void reportTransMatrixCache(ostream &out);
+
 	/**
 		Wrapper for computing the transition probability matrix from the model. It use ModelFactory
 		that stores matrix computed before for effiency purpose.
@@ -108,6 +115,15 @@ public:
 	*/
 	void computeTransMatrix(double time, double *trans_matrix);
 
+	/**
+		Wrapper for computing the transition probability matrices for several times at once,
+		e.g. one branch length multiplied by the rates of all categories.
+		@param num number of times
+		@param times the times
+		@param trans_matrices (OUT) num transition matrices, each of size model->getTransMatrixSize()
+	*/
+	void computeTransMatrixBatch(int num, double *times, double *trans_matrices);
+
 	/**
 	 * wrapper for computing transition matrix times state frequency vector
 	 * @param time time between two events
@@ -147,6 +163,18 @@ public:
 	void computeTransDerv(double time, double *trans_matrix, 
 		double *trans_derv1, double *trans_derv2);
 
+	/**
+		Wrapper for computing the transition probability matrices and the derivative 1 and 2
+		for several times at once.
+		@param num number of times
+		@param times the times
+		@param trans_matrices (OUT) num transition matrices, each of size model->getTransMatrixSize()
+		@param trans_derv1 (OUT) num 1st derivative matrices
+		@param trans_derv2 (OUT) num 2nd derivative matrices
+	*/
+	void computeTransDervBatch(int num, double *times, double *trans_matrices,
+		double *trans_derv1, double *trans_derv2);
+
 	void computeTransDervFreq(double time, double rate_val, double *state_freq, double *trans_matrix, 
 		double *trans_derv1, double *trans_derv2);
 
@@ -195,6 +223,13 @@ public:
 	/* TRUE if a fused mixture and rate model, e.g. LG4M and LG4X */
 	bool fused_mix_rate;
 
+	/**
+		TRUE to optimize rates with restarts from several initial alpha values (Params::fai),
+		only done in the first round of optimizeParameters(). Kept here and not in the global
+		Params as several models may be optimized concurrently
+	*/
+	bool fai;
+
 	/**
 		TRUE to store transition matrix into this hash table for computation efficiency
 	*/
@@ -205,6 +240,11 @@ public:
 	*/
 	bool is_storing;
 
+	/**
+		cache of transition matrices, used if store_trans_matrix is TRUE
+	*/
+	TransMatrixCache trans_cache;
+
 	/**
 	 * encoded constant sites that are unobservable and added in the alignment
 	 * this involves likelihood function for ascertainment bias correction for morphological or SNP data (Lewis 2001)
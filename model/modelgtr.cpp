@@ -18,6 +18,8 @@
  *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
  ***************************************************************************/
 #include "modelgtr.h"
+#include "vectorclass/vectorclass.h"
+#include "vectorclass/vectormath_exp.h"
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
@@ -258,6 +260,70 @@ void ModelGTR::computeTransMatrix(double time, double *trans_matrix) {
 	delete [] exptime;
 }
 
+/**
+	exp(eigenvalues[i] * times[t] / total_num_subst) for all times and eigenvalues,
+	two values per vectorclass exp() call
+	@param exptime (OUT) num * num_states values, one row per time
+*/
+static void computeExpTimeBatch(int num, double *times, double total_num_subst,
+	double *eigenvalues, int num_states, double *exptime)
+{
+	int size = num * num_states;
+	int t, i;
+	for (t = 0; t < num; t++) {
+		double evol_time = times[t] / total_num_subst;
+		for (i = 0; i < num_states; i++)
+			exptime[t*num_states+i] = evol_time * eigenvalues[i];
+	}
+	for (i = 0; i+1 < size; i += 2)
+		exp(Vec2d().load(exptime+i)).store(exptime+i);
+	if (i < size)
+		exptime[i] = exp(exptime[i]);
+}
+
+void ModelGTR::computeTransMatrixBatch(int num, double *times, double *trans_matrices) {
+	int nstates_sqr = num_states * num_states;
+	double *exptime = new double[num * num_states];
+	int t, i, j, k;
+
+	computeExpTimeBatch(num, times, total_num_subst, eigenvalues, num_states, exptime);
+
+	// off-diagonal entries, the coefficients of one entry stay in cache for all times
+	for (i = 0; i < num_states; i++) {
+		for (j = i+1; j < num_states; j++) {
+			double *coeff_entry = eigen_coeff + ((i*num_states+j)*num_states);
+			double freq_ratio = state_freq[i]/state_freq[j];
+			for (t = 0; t < num; t++) {
+				double *exptime_t = exptime + t*num_states;
+				Vec2d trans_vec = 0.0;
+				for (k = 0; k+1 < num_states; k += 2)
+					trans_vec += Vec2d().load(coeff_entry+k) * Vec2d().load(exptime_t+k);
+				double trans = horizontal_add(trans_vec);
+				if (k < num_states)
+					trans += coeff_entry[k] * exptime_t[k];
+				if (trans < 0.0)
+					trans = 0.0;
+				trans_matrices[t*nstates_sqr + i*num_states+j] = trans;
+				trans_matrices[t*nstates_sqr + j*num_states+i] = freq_ratio * trans;
+			}
+		}
+	}
+
+	// diagonal entries
+	for (t = 0; t < num; t++) {
+		double *trans_matrix = trans_matrices + t*nstates_sqr;
+		for (i = 0; i < num_states; i++) {
+			double *trans_row = trans_matrix + i*num_states;
+			trans_row[i] = 0.0;
+			double sum = 0.0;
+			for (j = 0; j < num_states; j++)
+				sum += trans_row[j];
+			trans_row[i] = 1.0 - sum;
+		}
+	}
+	delete [] exptime;
+}
+
 void ModelGTR::computeTransMatrixFreq(double time, double* trans_matrix)
 {
 	computeTransMatrix(time, trans_matrix);
@@ -337,6 +403,48 @@ void ModelGTR::computeTransDerv(double time, double *trans_matrix,
 	delete [] exptime;
 }
 
+void ModelGTR::computeTransDervBatch(int num, double *times, double *trans_matrices,
+	double *trans_derv1, double *trans_derv2)
+{
+	int nstates_sqr = num_states * num_states;
+	double *exptime = new double[num * num_states];
+	int t, k;
+
+	computeExpTimeBatch(num, times, total_num_subst, eigenvalues, num_states, exptime);
+
+	for (int offset = 0; offset < nstates_sqr; offset++) {
+		double *coeff_entry = eigen_coeff + offset*num_states;
+		for (t = 0; t < num; t++) {
+			double *exptime_t = exptime + t*num_states;
+			Vec2d trans_vec = 0.0, derv1_vec = 0.0, derv2_vec = 0.0;
+			for (k = 0; k+1 < num_states; k += 2) {
+				Vec2d eval = Vec2d().load(eigenvalues+k);
+				Vec2d trans = Vec2d().load(coeff_entry+k) * Vec2d().load(exptime_t+k);
+				Vec2d trans2 = trans * eval;
+				trans_vec += trans;
+				derv1_vec += trans2;
+				derv2_vec += trans2 * eval;
+			}
+			double trans_entry = horizontal_add(trans_vec);
+			double derv1_entry = horizontal_add(derv1_vec);
+			double derv2_entry = horizontal_add(derv2_vec);
+			if (k < num_states) {
+				double trans = coeff_entry[k] * exptime_t[k];
+				double trans2 = trans * eigenvalues[k];
+				trans_entry += trans;
+				derv1_entry += trans2;
+				derv2_entry += trans2 * eigenvalues[k];
+			}
+			if (trans_entry < 0.0)
+				trans_entry = 0.0;
+			trans_matrices[t*nstates_sqr+offset] = trans_entry;
+			trans_derv1[t*nstates_sqr+offset] = derv1_entry;
+			trans_derv2[t*nstates_sqr+offset] = derv2_entry;
+		}
+	}
+	delete [] exptime;
+}
+
 void ModelGTR::computeTransDervFreq(double time, double rate_val, double* trans_matrix, double* trans_derv1, double* trans_derv2)
 {
 	int nstates = num_states;
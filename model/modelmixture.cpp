@@ -1423,9 +1423,12 @@ double ModelMixture::optimizeWithEM(double gradient_epsilon) {
     double *new_prop = aligned_alloc<double>(nmix);
     PhyloTree *tree = new PhyloTree;
     
-    // attach memory to save space
-    tree->central_partial_lh = phylo_tree->central_partial_lh;
-    tree->central_scale_num = phylo_tree->central_scale_num;
+    // attach memory to save space, unless it is laid out as memory-capped pool (-mem) for the mixture
+    bool attach_lh = !phylo_tree->params->lh_mem_limit;
+    if (attach_lh) {
+        tree->central_partial_lh = phylo_tree->central_partial_lh;
+        tree->central_scale_num = phylo_tree->central_scale_num;
+    }
     tree->central_partial_pars = phylo_tree->central_partial_pars;
     
     tree->copyPhyloTree(phylo_tree);
@@ -1521,8 +1524,10 @@ double ModelMixture::optimizeWithEM(double gradient_epsilon) {
     }
     
     // deattach memory
-    tree->central_partial_lh = NULL;
-    tree->central_scale_num = NULL;
+    if (attach_lh) {
+        tree->central_partial_lh = NULL;
+        tree->central_scale_num = NULL;
+    }
     tree->central_partial_pars = NULL;
     
     delete tree;
@@ -65,6 +65,13 @@ public:
 	*/
 	virtual void computeTransMatrix(double time, double *trans_matrix);
 
+	/**
+		compute the transition probability matrices for several times, one time after another
+	*/
+	virtual void computeTransMatrixBatch(int num, double *times, double *trans_matrices) {
+		ModelSubst::computeTransMatrixBatch(num, times, trans_matrices);
+	}
+
 	/**
 		compute the transition probability between two states
 		@param time time between two events
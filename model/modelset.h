@@ -51,6 +51,13 @@ public:
 	*/
 	virtual void computeTransMatrix(double time, double *trans_matrix);
 
+	/**
+		compute the transition probability matrices for several times, one time after another
+	*/
+	virtual void computeTransMatrixBatch(int num, double *times, double *trans_matrices) {
+		ModelSubst::computeTransMatrixBatch(num, times, trans_matrices);
+	}
+
 	
 	/**
 	 * wrapper for computing transition matrix times state frequency vector
@@ -72,6 +79,14 @@ public:
 	virtual void computeTransDerv(double time, double *trans_matrix, 
 		double *trans_derv1, double *trans_derv2);
 
+	/**
+		compute the transition probability matrices and derivatives for several times, one time after another
+	*/
+	virtual void computeTransDervBatch(int num, double *times, double *trans_matrices,
+		double *trans_derv1, double *trans_derv2) {
+		ModelSubst::computeTransDervBatch(num, times, trans_matrices, trans_derv1, trans_derv2);
+	}
+
 	/**
 		compute the transition probability matrix.and the derivative 1 and 2 times state frequency vector
 		@param time time between two events
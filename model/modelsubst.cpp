@@ -68,6 +68,12 @@ void ModelSubst::computeTransMatrix(double time, double *trans_matrix) {
 			trans_matrix[i] = non_diagonal;
 }
 
+void ModelSubst::computeTransMatrixBatch(int num, double *times, double *trans_matrices) {
+	int mat_size = getTransMatrixSize();
+	for (int t = 0; t < num; t++)
+		computeTransMatrix(times[t], trans_matrices + t*mat_size);
+}
+
 void ModelSubst::computeTransMatrixFreq(double time, double* trans_matrix)
 {
 	computeTransMatrix(time, trans_matrix);
@@ -184,6 +190,14 @@ void ModelSubst::computeTransDerv(double time, double *trans_matrix,
 
 }
 
+void ModelSubst::computeTransDervBatch(int num, double *times, double *trans_matrices,
+		double *trans_derv1, double *trans_derv2)
+{
+	int mat_size = getTransMatrixSize();
+	for (int t = 0; t < num; t++)
+		computeTransDerv(times[t], trans_matrices + t*mat_size, trans_derv1 + t*mat_size, trans_derv2 + t*mat_size);
+}
+
 void ModelSubst::computeTransDervFreq(double time, double rate_val, double* trans_matrix, double* trans_derv1, double* trans_derv2)
 {
 	int nstates = num_states;
@@ -97,6 +97,15 @@ public:
 	*/
 	virtual void computeTransMatrix(double time, double *trans_matrix);
 
+	/**
+		compute the transition probability matrices for several times at once, e.g. one branch
+		length multiplied by the rates of all categories. The default calls computeTransMatrix.
+		@param num number of times
+		@param times the times
+		@param trans_matrices (OUT) num transition matrices, each of size getTransMatrixSize()
+	*/
+	virtual void computeTransMatrixBatch(int num, double *times, double *trans_matrices);
+
 	/**
 	 * wrapper for computing transition matrix times state frequency vector
 	 * @param time time between two events
@@ -209,6 +218,18 @@ public:
 	virtual void computeTransDerv(double time, double *trans_matrix, 
 		double *trans_derv1, double *trans_derv2);
 
+	/**
+		compute the transition probability matrices and the derivative 1 and 2 for several times at once.
+		The default calls computeTransDerv.
+		@param num number of times
+		@param times the times
+		@param trans_matrices (OUT) num transition matrices, each of size getTransMatrixSize()
+		@param trans_derv1 (OUT) num 1st derivative matrices
+		@param trans_derv2 (OUT) num 2nd derivative matrices
+	*/
+	virtual void computeTransDervBatch(int num, double *times, double *trans_matrices,
+		double *trans_derv1, double *trans_derv2);
+
 	/**
 		compute the transition probability matrix.and the derivative 1 and 2 times state frequency vector
 		@param time time between two events
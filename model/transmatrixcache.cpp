@@ -0,0 +1,154 @@
+/*
+ * transmatrixcache.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "transmatrixcache.h"
+
+TransMatrixCache::TransMatrixCache() {
+	num_hits = num_misses = num_evictions = 0;
+	num_sets = 0;
+	mat_size = 0;
+	entries = NULL;
+	entry_data = NULL;
+	clock = 0;
+#ifdef _OPENMP
+	omp_init_lock(&write_lock);
+#endif
+}
+
+TransMatrixCache::~TransMatrixCache() {
+	if (entry_data)
+		delete [] entry_data;
+	if (entries)
+		delete [] entries;
+#ifdef _OPENMP
+	omp_destroy_lock(&write_lock);
+#endif
+}
+
+void TransMatrixCache::init(int mat_size, size_t max_mem) {
+	assert(!entries);
+	this->mat_size = mat_size;
+	size_t max_entries = max_mem / (3 * mat_size * sizeof(double));
+	// number of sets is a power of two
+	num_sets = 1;
+	while ((size_t)num_sets * 2 * WAYS <= max_entries)
+		num_sets *= 2;
+	int num_entries = num_sets * WAYS;
+	entries = new Entry[num_entries];
+	entry_data = new double[(size_t)num_entries * 3 * mat_size];
+	clear();
+}
+
+void TransMatrixCache::clear() {
+	for (int i = 0; i < num_sets * WAYS; i++) {
+		entries[i].key = -1;
+		entries[i].has_derv = false;
+		entries[i].version = 0;
+		entries[i].last_use = 0;
+	}
+	clock = 0;
+}
+
+int TransMatrixCache::getSet(int64_t key) {
+	uint64_t h = (uint64_t)key * 0x9E3779B97F4A7C15ULL;
+	return (int)(h >> 40) & (num_sets - 1);
+}
+
+bool TransMatrixCache::find(double time, double *trans_matrix, double *trans_derv1, double *trans_derv2) {
+	int64_t key = (int64_t)round(time * 1e6);
+	bool need_derv = (trans_derv1 != NULL);
+	int first = getSet(key) * WAYS;
+	for (int i = first; i < first + WAYS; i++) {
+		Entry &entry = entries[i];
+		unsigned int version = entry.version;
+#ifdef _OPENMP
+		#pragma omp flush
+#endif
+		if ((version & 1) || entry.key != key || (need_derv && !entry.has_derv))
+			continue;
+		double *data = entry_data + (size_t)i * 3 * mat_size;
+		memcpy(trans_matrix, data, mat_size * sizeof(double));
+		if (need_derv) {
+			memcpy(trans_derv1, data + mat_size, mat_size * sizeof(double));
+			memcpy(trans_derv2, data + 2 * mat_size, mat_size * sizeof(double));
+		}
+#ifdef _OPENMP
+		#pragma omp flush
+#endif
+		if (entry.version != version)
+			break; // overwritten while copying
+		entry.last_use = clock;
+#ifdef _OPENMP
+		#pragma omp atomic
+#endif
+		num_hits++;
+		return true;
+	}
+#ifdef _OPENMP
+	#pragma omp atomic
+#endif
+	num_misses++;
+	return false;
+}
+
+void TransMatrixCache::insert(double time, double *trans_matrix, double *trans_derv1, double *trans_derv2) {
+	int64_t key = (int64_t)round(time * 1e6);
+	int first = getSet(key) * WAYS;
+#ifdef _OPENMP
+	omp_set_lock(&write_lock);
+#endif
+	// same key (e.g. to add derivatives), otherwise an empty or the least recently used entry
+	int victim = -1;
+	for (int i = first; i < first + WAYS; i++)
+		if (entries[i].key == key) {
+			victim = i;
+			break;
+		}
+	if (victim < 0)
+		for (int i = first; i < first + WAYS; i++)
+			if (entries[i].key < 0) {
+				victim = i;
+				break;
+			}
+	if (victim < 0) {
+		victim = first;
+		for (int i = first + 1; i < first + WAYS; i++)
+			if (entries[i].last_use < entries[victim].last_use)
+				victim = i;
+		num_evictions++;
+	}
+	Entry &entry = entries[victim];
+	if (!(entry.key == key && entry.has_derv && trans_derv1 == NULL)) {
+		entry.version++;
+#ifdef _OPENMP
+		#pragma omp flush
+#endif
+		entry.key = key;
+		entry.has_derv = (trans_derv1 != NULL);
+		double *data = entry_data + (size_t)victim * 3 * mat_size;
+		memcpy(data, trans_matrix, mat_size * sizeof(double));
+		if (trans_derv1) {
+			memcpy(data + mat_size, trans_derv1, mat_size * sizeof(double));
+			memcpy(data + 2 * mat_size, trans_derv2, mat_size * sizeof(double));
+		}
+#ifdef _OPENMP
+		#pragma omp flush
+#endif
+		entry.version++;
+	}
+	entry.last_use = ++clock;
+#ifdef _OPENMP
+	omp_unset_lock(&write_lock);
+#endif
+}
+
+void TransMatrixCache::report(ostream &out) {
+	size_t total = num_hits + num_misses;
+	out << "Transition matrix cache: " << num_hits << " hits, " << num_misses << " misses";
+	if (total > 0)
+		out << " (" << (100.0 * num_hits) / total << "% hit rate)";
+	out << ", " << num_evictions << " evictions, " << num_sets * WAYS << " entries" << endl;
+}
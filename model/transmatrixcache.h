@@ -0,0 +1,129 @@
+/*
+ * transmatrixcache.h
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef TRANSMATRIXCACHE_H_
+#define TRANSMATRIXCACHE_H_
+
+#include <stdint.h>
+#include "tools.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ * Bounded cache of transition probability matrices, keyed by evolutionary time
+ * rounded to 1e-6. The time already includes the rate of the category, so that
+ * matrices of different rate categories are distinct entries. Each entry holds the
+ * transition matrix and optionally its 1st and 2nd derivatives.
+ *
+ * The cache is set-associative: a key maps to a set of WAYS entries and the least
+ * recently used entry of the set is evicted when the set is full. Lookups are
+ * lock-free: every entry carries a version number that is odd while the entry is
+ * being written, a reader that sees the version change while copying the matrix
+ * counts the lookup as a miss. Insertions are serialized by a lock.
+ */
+class TransMatrixCache {
+public:
+
+	/** number of entries per set */
+	static const int WAYS = 4;
+
+	TransMatrixCache();
+
+	~TransMatrixCache();
+
+	/**
+	 * allocate the cache
+	 * @param mat_size number of elements of one matrix
+	 * @param max_mem maximal memory in bytes used for the matrices
+	 */
+	void init(int mat_size, size_t max_mem);
+
+	/**
+	 * @return TRUE if init() was called
+	 */
+	bool isInitialized() { return entry_data != NULL; }
+
+	/**
+	 * look up the matrices of a time and copy them out
+	 * @param time evolutionary time
+	 * @param trans_matrix (OUT) transition matrix
+	 * @param trans_derv1 (OUT) 1st derivative, NULL if not needed
+	 * @param trans_derv2 (OUT) 2nd derivative, NULL if not needed
+	 * @return TRUE if found, FALSE otherwise
+	 */
+	bool find(double time, double *trans_matrix, double *trans_derv1 = NULL, double *trans_derv2 = NULL);
+
+	/**
+	 * insert the matrices of a time, replacing the least recently used entry of its set
+	 * @param time evolutionary time
+	 * @param trans_matrix transition matrix
+	 * @param trans_derv1 1st derivative, NULL if not available
+	 * @param trans_derv2 2nd derivative, NULL if not available
+	 */
+	void insert(double time, double *trans_matrix, double *trans_derv1 = NULL, double *trans_derv2 = NULL);
+
+	/**
+	 * remove all entries, e.g. when model parameters change. Must not be called concurrently
+	 * with find() or insert()
+	 */
+	void clear();
+
+	/**
+	 * print hit/miss statistics
+	 * @param out output stream
+	 */
+	void report(ostream &out);
+
+	/** number of successful lookups */
+	size_t num_hits;
+
+	/** number of failed lookups */
+	size_t num_misses;
+
+	/** number of entries replaced by another time */
+	size_t num_evictions;
+
+protected:
+
+	/** state of an entry */
+	struct Entry {
+		/** rounded time, -1 for an empty entry */
+		volatile int64_t key;
+		/** TRUE if derivatives are stored */
+		volatile bool has_derv;
+		/** odd while the entry is written */
+		volatile unsigned int version;
+		/** time of last use for LRU eviction */
+		volatile unsigned int last_use;
+	};
+
+	/** compute the set of a key */
+	int getSet(int64_t key);
+
+	/** number of sets */
+	int num_sets;
+
+	/** number of elements of one matrix */
+	int mat_size;
+
+	/** num_sets*WAYS entries */
+	Entry *entries;
+
+	/** 3*mat_size doubles per entry */
+	double *entry_data;
+
+	/** clock for LRU eviction, advanced at every insertion */
+	volatile unsigned int clock;
+
+#ifdef _OPENMP
+	/** lock for insertions */
+	omp_lock_t write_lock;
+#endif
+};
+
+#endif /* TRANSMATRIXCACHE_H_ */
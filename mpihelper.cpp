@@ -0,0 +1,124 @@
+/*
+ * mpihelper.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "mpihelper.h"
+#include <string.h>
+
+#ifdef _IQTREE_MPI
+// only the C interface is used
+#define OMPI_SKIP_MPICXX
+#define MPICH_SKIP_MPICXX
+#include <mpi.h>
+#endif
+
+MPIHelper::MPIHelper() {
+	process_id = PROC_MASTER;
+	num_processes = 1;
+}
+
+MPIHelper &MPIHelper::getInstance() {
+	static MPIHelper instance;
+	return instance;
+}
+
+void MPIHelper::init(int *argc, char ***argv) {
+#ifdef _IQTREE_MPI
+	MPI_Init(argc, argv);
+	MPI_Comm_rank(MPI_COMM_WORLD, &process_id);
+	MPI_Comm_size(MPI_COMM_WORLD, &num_processes);
+#endif
+}
+
+void MPIHelper::finalize() {
+#ifdef _IQTREE_MPI
+	MPI_Finalize();
+#endif
+}
+
+void MPIHelper::allGatherTrees(StrVector &trees, DoubleVector &scores) {
+	assert(trees.size() == scores.size());
+#ifdef _IQTREE_MPI
+	if (num_processes == 1)
+		return;
+	// one line "score tree" per tree
+	stringstream ss;
+	ss.precision(17);
+	for (int i = 0; i < trees.size(); i++)
+		ss << scores[i] << " " << trees[i] << endl;
+	string buf = ss.str();
+
+	int length = buf.length();
+	IntVector lengths(num_processes), displs(num_processes);
+	MPI_Allgather(&length, 1, MPI_INT, &lengths[0], 1, MPI_INT, MPI_COMM_WORLD);
+	int total = 0;
+	for (int proc = 0; proc < num_processes; proc++) {
+		displs[proc] = total;
+		total += lengths[proc];
+	}
+	vector<char> all_buf(total + 1);
+	MPI_Allgatherv((void*)buf.c_str(), length, MPI_CHAR, &all_buf[0], &lengths[0], &displs[0], MPI_CHAR, MPI_COMM_WORLD);
+
+	trees.clear();
+	scores.clear();
+	stringstream in(string(all_buf.begin(), all_buf.begin() + total));
+	double score;
+	string tree;
+	while (in >> score) {
+		in.get();
+		getline(in, tree);
+		scores.push_back(score);
+		trees.push_back(tree);
+	}
+#endif
+}
+
+void MPIHelper::broadcastInts(IntVector &values) {
+#ifdef _IQTREE_MPI
+	if (num_processes == 1 || values.empty())
+		return;
+	MPI_Bcast(&values[0], values.size(), MPI_INT, PROC_MASTER, MPI_COMM_WORLD);
+#endif
+}
+
+void MPIHelper::broadcastCheckpoint(Checkpoint *checkpoint) {
+#ifdef _IQTREE_MPI
+	if (num_processes == 1)
+		return;
+	// key and value are prefixed with their lengths, values may contain any character
+	string buf;
+	if (isMaster()) {
+		stringstream ss;
+		for (Checkpoint::iterator it = checkpoint->begin(); it != checkpoint->end(); it++)
+			ss << it->first.length() << " " << it->first << it->second.length() << " " << it->second;
+		buf = ss.str();
+	}
+	int length = buf.length();
+	MPI_Bcast(&length, 1, MPI_INT, PROC_MASTER, MPI_COMM_WORLD);
+	if (length == 0)
+		return;
+	vector<char> all_buf(length);
+	if (isMaster())
+		memcpy(&all_buf[0], buf.c_str(), length);
+	MPI_Bcast(&all_buf[0], length, MPI_CHAR, PROC_MASTER, MPI_COMM_WORLD);
+	if (isMaster())
+		return;
+
+	checkpoint->clear();
+	int pos = 0;
+	while (pos < length) {
+		string item[2];
+		for (int i = 0; i < 2; i++) {
+			int len = 0;
+			while (all_buf[pos] != ' ')
+				len = len * 10 + (all_buf[pos++] - '0');
+			pos++;
+			item[i].assign(&all_buf[pos], len);
+			pos += len;
+		}
+		(*checkpoint)[item[0]] = item[1];
+	}
+#endif
+}
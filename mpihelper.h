@@ -0,0 +1,76 @@
+/*
+ * mpihelper.h
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef MPIHELPER_H_
+#define MPIHELPER_H_
+
+#include "tools.h"
+#include "checkpoint.h"
+
+/** ID of the process that owns output files and checkpointing, the others write to <prefix>.rank<ID>.* */
+#define PROC_MASTER 0
+
+/**
+ * Process information and message passing for the distributed tree search.
+ * Compiled with MPI if _IQTREE_MPI is defined (cmake -DIQTREE_FLAGS=mpi), otherwise
+ * there is only the master process and all communication functions are no-ops.
+ */
+class MPIHelper {
+public:
+
+	/** @return the single instance */
+	static MPIHelper &getInstance();
+
+	/**
+	 * initialize MPI, must be called before parsing the command line
+	 * @param argc pointer to number of arguments of main()
+	 * @param argv pointer to arguments of main()
+	 */
+	void init(int *argc, char ***argv);
+
+	/** finalize MPI at the normal end of the program */
+	void finalize();
+
+	/** @return ID of this process, from 0 to getNumProcesses()-1 */
+	int getProcessID() { return process_id; }
+
+	/** @return number of processes */
+	int getNumProcesses() { return num_processes; }
+
+	/** @return TRUE if this is the master process */
+	bool isMaster() { return process_id == PROC_MASTER; }
+
+	/**
+	 * gather trees and their scores from all processes, collective call
+	 * @param trees (IN) trees of this process, (OUT) trees of all processes in order of process ID
+	 * @param scores (IN/OUT) scores of trees
+	 */
+	void allGatherTrees(StrVector &trees, DoubleVector &scores);
+
+	/**
+	 * broadcast integers from the master to all processes, collective call
+	 * @param values (IN) on master, (OUT) on the other processes
+	 */
+	void broadcastInts(IntVector &values);
+
+	/**
+	 * broadcast the checkpoint loaded by the master, so that all processes resume from it, collective call
+	 * @param checkpoint (IN) on master, (OUT) on the other processes
+	 */
+	void broadcastCheckpoint(Checkpoint *checkpoint);
+
+private:
+
+	MPIHelper();
+
+	/** ID of this process */
+	int process_id;
+
+	/** number of processes */
+	int num_processes;
+};
+
+#endif /* MPIHELPER_H_ */
@@ -502,15 +502,17 @@ void MTree::readTree(const char *infile, bool &is_rooted) {
 
 void MTree::readTree(istream &in, bool &is_rooted)
 {
-    in_line = 1;
-    in_column = 1;
+    NewickReader reader(in, false);
+    readTree(reader, is_rooted);
+}
+
+void MTree::readTree(NewickReader &in, bool &is_rooted)
+{
     try {
         char ch;
-        ch = readNextChar(in);
-        if (ch != '(') {
-        	cout << in.rdbuf() << endl;
+        ch = in.readNextChar();
+        if (ch != '(')
             throw "Tree file does not start with an opening-bracket '('";
-        }
 
         leafNum = 0;
 
@@ -541,14 +543,14 @@ void MTree::readTree(istream &in, bool &is_rooted)
     } catch (bad_alloc) {
         outError(ERR_NO_MEMORY);
     } catch (const char *str) {
-        outError(str, reportInputInfo());
+        outError(str, in.reportInputInfo());
     } catch (string str) {
-        outError(str.c_str(), reportInputInfo());
+        outError(str.c_str(), in.reportInputInfo());
     } catch (ios::failure) {
-        outError(ERR_READ_INPUT, reportInputInfo());
+        outError(ERR_READ_INPUT, in.reportInputInfo());
     } catch (...) {
         // anything else
-        outError(ERR_READ_ANY, reportInputInfo());
+        outError(ERR_READ_ANY, in.reportInputInfo());
     }
 
     nodeNum = leafNum;
@@ -583,12 +585,11 @@ void MTree::initializeTree(Node *node, Node* dad)
 }
 
 
-void MTree::parseFile(istream &infile, char &ch, Node* &root, double &branch_len)
+void MTree::parseFile(NewickReader &in, char &ch, Node* &root, double &branch_len)
 {
     Node *node;
-    int maxlen = 1000;
+    size_t maxlen = 1000;
     string seqname;
-    int seqlen;
     double brlen;
     branch_len = -1.0;
 
@@ -596,21 +597,21 @@ void MTree::parseFile(istream &infile, char &ch, Node* &root, double &branch_len
 
     if (ch == '(') {
         // internal node
-        ch = readNextChar(infile);
-        while (ch != ')' && !infile.eof())
+        ch = in.readNextChar();
+        while (ch != ')' && !in.eof())
         {
             node = NULL;
-            parseFile(infile, ch, node, brlen);
+            parseFile(in, ch, node, brlen);
             //if (brlen == -1.0)
             //throw "Found branch with no length.";
             //if (brlen < 0.0)
             //throw ERR_NEG_BRANCH;
             root->addNeighbor(node, brlen);
             node->addNeighbor(root, brlen);
-            if (infile.eof())
+            if (in.eof())
                 throw "Expecting ')', but end of file instead";
             if (ch == ',')
-                ch = readNextChar(infile);
+                ch = in.readNextChar();
             else if (ch != ')') {
                 string err = "Expecting ')', but found '";
                 err += ch;
@@ -618,39 +619,35 @@ void MTree::parseFile(istream &infile, char &ch, Node* &root, double &branch_len
                 throw err;
             }
         }
-        if (!infile.eof()) ch = readNextChar(infile);
+        if (!in.eof()) ch = in.readNextChar();
     }
     // now read the node name
-    seqlen = 0;
     char end_ch = 0;
     if (ch == '\'' || ch == '"') end_ch = ch;
-    seqname = "";
 
-    while (!infile.eof() && seqlen < maxlen)
-    {
-        if (end_ch == 0) {
-            if (is_newick_token(ch) || controlchar(ch)) break;
+    if (in.eof()) {
+        // nothing left
+    } else if (end_ch == 0) {
+        // unquoted name is cut out of the input buffer as a whole
+        if (!is_newick_token(ch) && !controlchar(ch)) {
+            seqname = ch;
+            in.readToken(seqname, ch);
         }
-        seqname += ch;
-        seqlen++;
-//        seqname[seqlen++] = ch;
-        ch = infile.get();
-        in_column++;
-        if (end_ch != 0 && ch == end_ch) {
+    } else {
+        seqname = ch;
+        do {
+            in.get(ch);
+            if (in.eof()) break;
             seqname += ch;
-            seqlen++;
-//            seqname[seqlen++] = ch;
-            break;
-        }
+        } while (ch != end_ch && seqname.length() < maxlen);
     }
-    if ((controlchar(ch) || ch == '[' || ch == end_ch) && !infile.eof())
-        ch = readNextChar(infile, ch);
-    if (seqlen == maxlen)
+    if ((controlchar(ch) || ch == '[' || ch == end_ch) && !in.eof())
+        ch = in.readNextChar(ch);
+    if (seqname.length() >= maxlen)
         throw "Too long name ( > 1000)";
-//    seqname[seqlen] = 0;
-    if (seqlen == 0 && root->isLeaf())
+    if (seqname.empty() && root->isLeaf())
         throw "A taxon has no name.";
-    if (seqlen > 0)
+    if (!seqname.empty())
         root->name.append(seqname);
     if (root->isLeaf()) {
         // is a leaf, assign its ID
@@ -660,26 +657,20 @@ void MTree::parseFile(istream &infile, char &ch, Node* &root, double &branch_len
         leafNum++;
     }
 
-    if (ch == ';' || infile.eof())
+    if (ch == ';' || in.eof())
         return;
     if (ch == ':')
     {
-        ch = readNextChar(infile);
-        seqlen = 0;
+        ch = in.readNextChar();
         seqname = "";
-        while (!is_newick_token(ch) && !controlchar(ch) && !infile.eof() && seqlen < maxlen)
-        {
-//            seqname[seqlen] = ch;
-            seqname += ch;
-            seqlen++;
-            ch = infile.get();
-            in_column++;
+        if (!is_newick_token(ch) && !controlchar(ch) && !in.eof()) {
+            seqname = ch;
+            in.readToken(seqname, ch);
         }
-        if ((controlchar(ch) || ch == '[') && !infile.eof())
-            ch = readNextChar(infile, ch);
-        if (seqlen == maxlen || infile.eof())
+        if ((controlchar(ch) || ch == '[') && !in.eof())
+            ch = in.readNextChar(ch);
+        if (seqname.length() >= maxlen || in.eof())
             throw "branch length format error.";
-//        seqname[seqlen] = 0;
         branch_len = convert_double(seqname.c_str());
     }
 }
@@ -1241,61 +1232,6 @@ int MTree::freeNode(Node *node, Node *dad)
     return num_nodes;
 }
 
-char MTree::readNextChar(istream &in, char current_ch) {
-    char ch;
-    if (current_ch == '[')
-        ch = current_ch;
-    else {
-        in.get(ch);
-        in_column++;
-        if (ch == 10) {
-            in_line++;
-            in_column = 1;
-        }
-    }
-    while (controlchar(ch) && !in.eof()) {
-        in.get(ch);
-        in_column++;
-        if (ch == 10) {
-            in_line++;
-            in_column = 1;
-        }
-    }
-    // ignore comment
-    while (ch=='[' && !in.eof()) {
-        while (ch!=']' && !in.eof()) {
-            in.get(ch);
-            in_column++;
-            if (ch == 10) {
-                in_line++;
-                in_column = 1;
-            }
-        }
-        if (ch != ']') throw "Comments not ended with ]";
-        in_column++;
-        in.get(ch);
-        if (ch == 10) {
-            in_line++;
-            in_column = 1;
-        }
-        while (controlchar(ch) && !in.eof()) {
-            in_column++;
-            in.get(ch);
-            if (ch == 10) {
-                in_line++;
-                in_column = 1;
-            }
-        }
-    }
-    return ch;
-}
-
-string MTree::reportInputInfo() {
-    string str = " (line ";
-    str += convertIntToString(in_line) + " column " + convertIntToString(in_column-1) + ")";
-    return str;
-}
-
 
 typedef map<int, Neighbor*> IntNeighborMap;
 
@@ -27,6 +27,7 @@
 #include <sstream>
 #include "hashsplitset.h"
 #include "splitset.h"
+#include "newickreader.h"
 
 const char ROOT_NAME[] = "_root";
 
@@ -253,15 +254,22 @@ public:
      */
     virtual void readTree(istream &in, bool &is_rooted);
 
+    /**
+            read the tree from a NEWICK reader, used to read many trees of a file in one pass
+            @param in the reader, positioned before the tree
+            @param is_rooted (IN/OUT) true if tree is rooted
+     */
+    void readTree(NewickReader &in, bool &is_rooted);
+
     /**
             parse the tree from the input file in newick format
-            @param infile the input file
+            @param in the reader of the input file
             @param ch (IN/OUT) current char
             @param root (IN/OUT) the root of the (sub)tree
             @param branch_len (OUT) branch length associated to the current root
 		
      */
-    void parseFile(istream &infile, char &ch, Node* &root, double &branch_len);
+    void parseFile(NewickReader &in, char &ch, Node* &root, double &branch_len);
 
 
     /**
@@ -677,16 +685,6 @@ public:
 
 protected:
 
-    /**
-            line number of the input file, used to output errors in input file
-     */
-    int in_line;
-    /**
-            column number of the input file, used to output errors in input file
-     */
-    int in_column;
-
-
     /**
      * special character for drawing tree figure
      * 0: vertical line
@@ -705,16 +703,6 @@ protected:
      */
     void checkValidTree(bool& stop, Node *node = NULL, Node *dad = NULL);
 
-    /**
-            read the next character from a NEWICK file. Ignore comments [...]
-            @param in input stream
-            @param current_ch current character in the stream
-            @return next character read from input stream
-     */
-    char readNextChar(istream &in, char current_ch = 0);
-
-    string reportInputInfo();
-
     /**
      * Convert node IDs of a pair of nodes to a string in form "id1-id2"
      * where id1 is smaller than id2. This is done to create a key for the map data structure
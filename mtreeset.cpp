@@ -20,6 +20,9 @@
 #include "mtreeset.h"
 #include "alignment.h"
 #include "gzstream.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 MTreeSet::MTreeSet()
 {
@@ -156,10 +159,11 @@ void MTreeSet::init(vector<string> &trees, vector<string> &taxonNames, bool &is_
 }
 
 void MTreeSet::readTrees(const char *infile, bool &is_rooted, int burnin, int max_count,
-	IntVector *weights, bool compressed) 
+	IntVector *weights, bool compressed, MTreeVisitor *visitor) 
 {
 	cout << "Reading tree(s) file " << infile << " ..." << endl;
-	int count, omitted;
+	int count, omitted, loaded = 0;
+	bool loaded_rooted = false;
 /*	IntVector ok_trees;
 	if (trees_id) {
 		int max_id = *max_element(trees_id->begin(), trees_id->end());
@@ -174,50 +178,45 @@ void MTreeSet::readTrees(const char *infile, bool &is_rooted, int burnin, int ma
 		in->exceptions(ios::failbit | ios::badbit);
 		
 		if (compressed) ((igzstream*)in)->open(infile); else ((ifstream*)in)->open(infile);
+		// the whole file is parsed from large chunks, end of file is checked by the reader
+		in->exceptions(ios::badbit);
+		NewickReader reader(*in);
 		if (burnin > 0) {
 			int cnt = 0;
-			while (cnt < burnin && !in->eof()) {
-				char ch;
-				(*in) >> ch;
-				if (ch == ';') cnt++;
-			}
+			while (cnt < burnin && reader.skipTree())
+				cnt++;
 			cout << cnt << " beginning tree(s) discarded" << endl;
-			if (in->eof())
+			if (reader.skipSpaces())
 				throw "Burnin value is too large.";
 		}
-		for (count = 1, omitted = 0; !in->eof() && count <= max_count; count++) {
+		for (count = 1, omitted = 0; !reader.skipSpaces() && count <= max_count; count++) {
 			if (!weights || weights->at(count-1)) {
 				//cout << "Reading tree " << count << " ..." << endl;
 				MTree *tree = newTree();
 				bool myrooted = is_rooted;
 				//tree->userFile = (char*) infile;
-				tree->readTree(*in, myrooted);
-				push_back(tree);
+				tree->readTree(reader, myrooted);
 				if (weights) 
 					tree_weights.push_back(weights->at(count-1)); 
 				else tree_weights.push_back(1);
+				loaded++;
+				loaded_rooted = tree->rooted;
+				if (visitor) {
+					// only one tree is in memory at a time
+					visitor->visitTree(tree, tree_weights.size()-1, tree_weights.back());
+					delete tree;
+				} else
+					push_back(tree);
 				//cout << "Tree contains " << tree->leafNum - tree->rooted << 
 				//" taxa and " << tree->nodeNum-1-tree->rooted << " branches" << endl;
 			} else {
 				// omit the tree
 				//push_back(NULL);
-				//in->exceptions(ios::badbit);
-				while (!in->eof()) {
-					char ch;
-					if (!((*in) >> ch)) break;
-					if (ch == ';') break;
-				}
+				reader.skipTree();
 				omitted++;
 			} 
-			char ch;
-			in->exceptions(ios::goodbit);
-			(*in) >> ch;
-			if (in->eof()) break;
-			in->unget();
-			in->exceptions(ios::failbit | ios::badbit);
-
 		}
-		cout << size() << ((front()->rooted) ? " rooted" : " un-rooted") << " tree(s) loaded" << endl;
+		cout << loaded << (loaded_rooted ? " rooted" : " un-rooted") << " tree(s) loaded" << endl;
 		if (omitted) cout << omitted << " tree(s) omitted" << endl;
 		//in->exceptions(ios::failbit | ios::badbit);
 		if (compressed) ((igzstream*)in)->close(); else ((ifstream*)in)->close();
@@ -317,9 +316,13 @@ void MTreeSet::convertSplits(SplitGraph &sg, double split_threshold, int weighti
 	}*/
 	//SplitGraph temp;
 	convertSplits(sg, hash_ss, weighting_type, weight_threshold);
+	filterSplits(sg, hash_ss, split_threshold);
+}
+
+void MTreeSet::filterSplits(SplitGraph &sg, SplitIntMap &hash_ss, double split_threshold) {
 	int nsplits = sg.getNSplits();
 
-	double threshold = split_threshold * size();
+	double threshold = split_threshold * tree_weights.size();
 //	cout << "threshold = " << threshold << endl;
 	int count=0;
 	for (SplitGraph::iterator it = sg.begin(); it != sg.end(); ) {
@@ -387,7 +390,19 @@ void MTreeSet::convertSplits(vector<string> &taxname, SplitGraph &sg, SplitIntMa
 
 		cout << "Converting collection of tree(s) into split system..." << endl;
 	}
-	SplitGraph::iterator itg;
+	initSplits(taxname, sg, sort_taxa);
+
+	int tree_id = 0;
+//	cout << "Number of trees: " << size() << endl;
+//	cout << "Number of weight: " << tree_weights.size() << endl;
+	for (iterator it = begin(); it != end(); it++, tree_id++) {
+		if (tree_weights[tree_id] == 0) continue;
+		addSplits(*it, tree_id, tree_weights[tree_id], taxname, sg, hash_ss, weighting_type, tag_str, sort_taxa);
+	}
+	summarizeSplits(sg, hash_ss, weighting_type, weight_threshold);
+}
+
+void MTreeSet::initSplits(vector<string> &taxname, SplitGraph &sg, bool sort_taxa) {
 	vector<string>::iterator its;
 /*
 	for (its = taxname.begin(); its != taxname.end(); its++)
@@ -404,67 +419,144 @@ void MTreeSet::convertSplits(vector<string> &taxname, SplitGraph &sg, SplitIntMa
 		front()->convertSplits(taxname, sg);
 		return;
 	}*/
+}
 
-
+void MTreeSet::addSplits(MTree *tree, int tree_id, int weight, vector<string> &taxname, SplitGraph &sg,
+	SplitIntMap &hash_ss, int weighting_type, char *tag_str, bool sort_taxa)
+{
+	SplitGraph::iterator itg;
 	SplitGraph *isg;
-	int tree_id = 0;
-//	cout << "Number of trees: " << size() << endl;
-//	cout << "Number of weight: " << tree_weights.size() << endl;
-	for (iterator it = begin(); it != end(); it++, tree_id++) {
-		if (tree_weights[tree_id] == 0) continue;
-		MTree *tree = *it;
 
-		if (tree->leafNum != taxname.size())
-			outError("Tree has different number of taxa!");
-		if (sort_taxa) {
-			NodeVector taxa;
-			tree->getTaxa(taxa);
-			sort(taxa.begin(), taxa.end(), nodenamecmp);
-			int i = 0;
-			for (NodeVector::iterator it2 = taxa.begin(); it2 != taxa.end(); it2++) {
-				if ((*it2)->name != taxname[i]) {
-					cout << "Name 1: " <<  (*it2)->name << endl;
-					cout << "Name 2: " <<  taxname[i] << endl;
-					outError("Tree has different taxa names!");
-				}
-				(*it2)->id = i++;
+	if (tree->leafNum != taxname.size())
+		outError("Tree has different number of taxa!");
+	if (sort_taxa) {
+		NodeVector taxa;
+		tree->getTaxa(taxa);
+		sort(taxa.begin(), taxa.end(), nodenamecmp);
+		int i = 0;
+		for (NodeVector::iterator it2 = taxa.begin(); it2 != taxa.end(); it2++) {
+			if ((*it2)->name != taxname[i]) {
+				cout << "Name 1: " <<  (*it2)->name << endl;
+				cout << "Name 2: " <<  taxname[i] << endl;
+				outError("Tree has different taxa names!");
 			}
+			(*it2)->id = i++;
 		}
-		isg = new SplitGraph();
-		tree->convertSplits(taxname, *isg);
-		//isg->getTaxa()->Report(cout);
-		//isg->report(cout);
-		for (itg = isg->begin(); itg != isg->end(); itg++) {
-			//SplitIntMap::iterator ass_it = hash_ss.find(*itg);
-			int value;
-			//if ((*itg)->getWeight()==0.0) cout << "zero weight!" << endl;
-			Split *sp = hash_ss.findSplit(*itg, value);
-			if (sp != NULL) {
-				//Split *sp = ass_it->first;
-				if (weighting_type != SW_COUNT)
-					sp->setWeight(sp->getWeight() + (*itg)->getWeight() * tree_weights[tree_id]);
-				else
-					sp->setWeight(sp->getWeight() + tree_weights[tree_id]);
-				hash_ss.setValue(sp, value + tree_weights[tree_id]);
-			}
-			else {
-				sp = new Split(*(*itg));
-				if (weighting_type != SW_COUNT)
-					sp->setWeight((*itg)->getWeight() * tree_weights[tree_id]);
-				else				
-					sp->setWeight(tree_weights[tree_id]);
-				sg.push_back(sp);
-				//SplitIntMap::value_type spair(sp, 1);
-				//hash_ss.insert(spair);
-				
-				hash_ss.insertSplit(sp, tree_weights[tree_id]);
- 			}
-            if (tag_str)
-                sp->name += "@" + convertIntToString(tree_id+1);
+	}
+	isg = new SplitGraph();
+	tree->convertSplits(taxname, *isg);
+	//isg->getTaxa()->Report(cout);
+	//isg->report(cout);
+	for (itg = isg->begin(); itg != isg->end(); itg++) {
+		//SplitIntMap::iterator ass_it = hash_ss.find(*itg);
+		int value;
+		//if ((*itg)->getWeight()==0.0) cout << "zero weight!" << endl;
+		Split *sp = hash_ss.findSplit(*itg, value);
+		if (sp != NULL) {
+			//Split *sp = ass_it->first;
+			if (weighting_type != SW_COUNT)
+				sp->setWeight(sp->getWeight() + (*itg)->getWeight() * weight);
+			else
+				sp->setWeight(sp->getWeight() + weight);
+			hash_ss.setValue(sp, value + weight);
 		}
-		delete isg;
+		else {
+			sp = new Split(*(*itg));
+			if (weighting_type != SW_COUNT)
+				sp->setWeight((*itg)->getWeight() * weight);
+			else				
+				sp->setWeight(weight);
+			sg.push_back(sp);
+			//SplitIntMap::value_type spair(sp, 1);
+			//hash_ss.insert(spair);
+			
+			hash_ss.insertSplit(sp, weight);
+		}
+		if (tag_str)
+			sp->name += "@" + convertIntToString(tree_id+1);
 	}
+	delete isg;
+}
 
+/**
+	visitor adding the splits of each tree read to a split system, used by MTreeSet::readSplits()
+*/
+class SplitCollector : public MTreeVisitor {
+public:
+	SplitCollector(MTreeSet &tree_set, IntVector &file_weights, vector<string> &taxname, SplitGraph &sg,
+		SplitIntMap &hash_ss, int weighting_type, char *tag_str, bool sort_taxa) :
+		tree_set(tree_set), file_weights(file_weights), taxname(taxname), sg(sg), hash_ss(hash_ss)
+	{
+		this->weighting_type = weighting_type;
+		this->tag_str = tag_str;
+		this->sort_taxa = sort_taxa;
+		first = true;
+		rooted = false;
+		initialized = !taxname.empty();
+		if (initialized)
+			tree_set.initSplits(taxname, sg, sort_taxa);
+	}
+
+	virtual void visitTree(MTree *tree, int tree_id, int weight) {
+		if (first) {
+			rooted = tree->rooted;
+			first = false;
+		} else if (tree->rooted != rooted)
+			outError("Rooted and unrooted trees are mixed up");
+		if (!initialized) {
+			taxname.resize(tree->leafNum);
+			tree->getTaxaName(taxname);
+			tree_set.initSplits(taxname, sg, sort_taxa);
+			initialized = true;
+		}
+		if (!file_weights.empty()) {
+			if (tree_id >= file_weights.size())
+				outError("Tree file and tree weight file have different number of entries");
+			weight = file_weights[tree_id];
+		}
+		if (weight == 0)
+			return;
+		tree_set.addSplits(tree, tree_id, weight, taxname, sg, hash_ss, weighting_type, tag_str, sort_taxa);
+	}
+
+protected:
+	MTreeSet &tree_set;
+	IntVector &file_weights;
+	vector<string> &taxname;
+	SplitGraph &sg;
+	SplitIntMap &hash_ss;
+	int weighting_type;
+	char *tag_str;
+	bool sort_taxa;
+	/** TRUE before the first tree */
+	bool first;
+	/** TRUE if the trees are rooted */
+	bool rooted;
+	/** TRUE if the taxa of sg were created */
+	bool initialized;
+};
+
+void MTreeSet::readSplits(const char *userTreeFile, bool &is_rooted, int burnin, int max_count,
+	const char *tree_weight_file, vector<string> &taxname, SplitGraph &sg, SplitIntMap &hash_ss,
+	int weighting_type, double weight_threshold, char *tag_str, bool sort_taxa)
+{
+	IntVector file_weights;
+	if (tree_weight_file)
+		readIntVector(tree_weight_file, burnin, max_count, file_weights);
+	if (verbose_mode >= VB_MED)
+		cout << "Converting collection of tree(s) into split system..." << endl;
+	SplitCollector collector(*this, file_weights, taxname, sg, hash_ss, weighting_type, tag_str, sort_taxa);
+	readTrees(userTreeFile, is_rooted, burnin, max_count, NULL, false, &collector);
+	if (tree_weight_file) {
+		if (tree_weights.size() != file_weights.size())
+			outError("Tree file and tree weight file have different number of entries");
+		tree_weights = file_weights;
+	}
+	summarizeSplits(sg, hash_ss, weighting_type, weight_threshold);
+}
+
+void MTreeSet::summarizeSplits(SplitGraph &sg, SplitIntMap &hash_ss, int weighting_type, double weight_threshold) {
+	SplitGraph::iterator itg;
 	if (weighting_type == SW_AVG_PRESENT) {
 		for (itg = sg.begin(); itg != sg.end(); itg++) {
 			int value = 0;
@@ -507,67 +599,14 @@ void MTreeSet::computeRFDist(int *rfdist, int mode, double weight_threshold) {
 	// exit if less than 2 trees
 	if (size() < 2)
 		return;
-#ifdef USE_HASH_MAP
-	cout << "Using hash_map" << endl;
-#else
-	cout << "Using map" << endl;
-#endif
 	cout << "Computing Robinson-Foulds distance..." << endl;
 
-	vector<string> taxname(front()->leafNum);
-	vector<SplitIntMap*> hs_vec;
-	vector<SplitGraph*> sg_vec;
-
-	front()->getTaxaName(taxname);
-
-
-	// converting trees into split system then stored in SplitIntMap for efficiency
-	for (iterator it = begin(); it != end(); it++) {
-		SplitGraph *sg = new SplitGraph();
-		SplitIntMap *hs = new SplitIntMap();
-
-		(*it)->convertSplits(taxname, *sg);
-		// make sure that taxon 0 is included
-		for (SplitGraph::iterator sit = sg->begin(); sit != sg->end(); sit++) {
-			if (!(*sit)->containTaxon(0)) (*sit)->invert();
-			hs->insertSplit((*sit), 1);
-		}
-		hs_vec.push_back(hs);
-		sg_vec.push_back(sg);
-	}
-
-	// now start the RF computation
-	int id = 0;
-	for (vector<SplitIntMap*>::iterator hsit = hs_vec.begin(); hsit+1 != hs_vec.end(); hsit++, id++) {
-		vector<SplitIntMap*>::iterator end_it = hs_vec.end();
-		if (mode == RF_ADJACENT_PAIR) end_it = hsit+2;
-		int id2 = id+1;
-		for (vector<SplitIntMap*>::iterator hsit2 = hsit+1; hsit2 != end_it; hsit2++, id2++) {
-			int diff_splits = 0;
-			SplitIntMap::iterator spit;
-			for (spit = (*hsit2)->begin(); spit != (*hsit2)->end(); spit++) {
-				if (spit->first->getWeight() >= weight_threshold && !(*hsit)->findSplit(spit->first)) diff_splits++;
-			}
-			for (spit = (*hsit)->begin(); spit != (*hsit)->end(); spit++) {
-				if (spit->first->getWeight() >= weight_threshold && !(*hsit2)->findSplit(spit->first)) diff_splits++;
-			}
-			//int rf_val = (*hsit)->size() + (*hsit2)->size() - 2*common_splits;
-			int rf_val = diff_splits;
-			if (mode == RF_ADJACENT_PAIR) 
-				rfdist[id] = rf_val;
-			else {
-				rfdist[id*size() + id2] = rfdist[id2*size() + id] = rf_val;
-			}
-		}
-	}
-	// delete memory 
-	for (id = size()-1; id >= 0; id--) {
-		delete hs_vec[id];
-		delete sg_vec[id];
-	}
+	TreeSplitIndex index(weight_threshold);
+	for (iterator it = begin(); it != end(); it++)
+		index.addTree(*it);
+	index.computeRFDist(rfdist, mode);
 }
 
-
 void MTreeSet::computeRFDist(int *rfdist, MTreeSet *treeset2, 
 	const char *info_file, const char *tree_file, int *incomp_splits) 
 {
@@ -578,6 +617,22 @@ void MTreeSet::computeRFDist(int *rfdist, MTreeSet *treeset2,
 	cout << "Using map" << endl;
 #endif
 
+	if (!info_file && !tree_file && !incomp_splits) {
+		TreeSplitIndex index;
+		for (iterator it = begin(); it != end(); it++)
+			index.addTree(*it);
+		for (iterator it = treeset2->begin(); it != treeset2->end(); it++)
+			index.addTree(*it);
+		int n = size(), m = treeset2->size();
+#ifdef _OPENMP
+		#pragma omp parallel for schedule(dynamic)
+#endif
+		for (int id = 0; id < n; id++)
+			for (int id2 = 0; id2 < m; id2++)
+				rfdist[id*m + id2] = index.computeRFDist(id, n + id2);
+		return;
+	}
+
 	ofstream oinfo;
 	ofstream otree;
 	if (info_file) oinfo.open(info_file);
@@ -787,3 +842,146 @@ int MTreeSet::categorizeDistinctTrees(IntVector &category) {
 }
 
 */
+
+/*********************************************
+	class TreeSplitIndex
+*********************************************/
+
+TreeSplitIndex::TreeSplitIndex(double weight_threshold) {
+	this->weight_threshold = weight_threshold;
+	split_size = 0;
+	tree_start.push_back(0);
+}
+
+void TreeSplitIndex::addTree(MTree *tree) {
+	NodeVector taxa;
+	tree->getTaxa(taxa);
+	sort(taxa.begin(), taxa.end(), nodenamecmp);
+	if (taxname.empty()) {
+		for (NodeVector::iterator it = taxa.begin(); it != taxa.end(); it++)
+			taxname.push_back((*it)->name);
+	}
+	if (taxa.size() != taxname.size())
+		outError("Tree has different number of taxa!");
+	for (int i = 0; i < taxa.size(); i++) {
+		if (taxa[i]->name != taxname[i])
+			outError("Tree has different taxa names!");
+		taxa[i]->id = i;
+	}
+
+	SplitGraph sg;
+	tree->convertSplits(taxname, sg);
+	if (split_size == 0 && !sg.empty())
+		split_size = sg.front()->size();
+	vector<pair<int, char> > splits;
+	for (int i = 0; i < sg.size(); i++) {
+		Split *sp = sg[i];
+		// trivial splits are shared by all trees
+		if (sp->trivial() >= 0)
+			continue;
+		if (!sp->containTaxon(0))
+			sp->invert();
+		assert(sp->size() == split_size);
+		splits.push_back(make_pair(getSplitID(*sp), sp->getWeight() >= weight_threshold));
+	}
+	sort(splits.begin(), splits.end());
+	for (vector<pair<int, char> >::iterator it = splits.begin(); it != splits.end(); it++) {
+		split_id.push_back(it->first);
+		split_counted.push_back(it->second);
+	}
+	tree_start.push_back(split_id.size());
+}
+
+int TreeSplitIndex::getSplitID(Split &sp) {
+	uint64_t hash = hashSplit(sp);
+	unordered_map<uint64_t, int>::iterator it = hash_split_id.find(hash);
+	int id = (it == hash_split_id.end()) ? -1 : it->second, last = -1;
+	for (; id >= 0; last = id, id = same_hash_next[id])
+		if (memcmp(&split_bits[(size_t)id*split_size], &sp[0], split_size*sizeof(UINT)) == 0)
+			return id;
+	id = same_hash_next.size();
+	same_hash_next.push_back(-1);
+	split_bits.insert(split_bits.end(), sp.begin(), sp.end());
+	if (last >= 0)
+		same_hash_next[last] = id;
+	else
+		hash_split_id[hash] = id;
+	return id;
+}
+
+void TreeSplitIndex::visitTree(MTree *tree, int tree_id, int weight) {
+	addTree(tree);
+}
+
+uint64_t TreeSplitIndex::hashSplit(Split &sp) {
+	uint64_t hash = 0;
+	for (Split::iterator it = sp.begin(); it != sp.end(); it++) {
+		hash = (hash ^ *it) * 0x9E3779B97F4A7C15ULL;
+		hash ^= hash >> 29;
+	}
+	return hash;
+}
+
+int TreeSplitIndex::computeRFDist(int tree1, int tree2) {
+	int i = tree_start[tree1], i_end = tree_start[tree1+1];
+	int j = tree_start[tree2], j_end = tree_start[tree2+1];
+	int diff_splits = 0;
+	while (i < i_end && j < j_end) {
+		if (split_id[i] < split_id[j]) {
+			diff_splits += split_counted[i++];
+		} else if (split_id[i] > split_id[j]) {
+			diff_splits += split_counted[j++];
+		} else {
+			i++;
+			j++;
+		}
+	}
+	for (; i < i_end; i++)
+		diff_splits += split_counted[i];
+	for (; j < j_end; j++)
+		diff_splits += split_counted[j];
+	return diff_splits;
+}
+
+void TreeSplitIndex::computeRFDist(int *rfdist, int mode) {
+	int ntrees = getNumTrees();
+	if (mode == RF_ADJACENT_PAIR) {
+#ifdef _OPENMP
+		#pragma omp parallel for schedule(static)
+#endif
+		for (int id = 0; id < ntrees-1; id++)
+			rfdist[id] = computeRFDist(id, id+1);
+		return;
+	}
+	// upper triangle in tiles of TILE_SIZE x TILE_SIZE trees, whose splits stay in cache
+	int ntiles = (ntrees + TILE_SIZE - 1) / TILE_SIZE;
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic)
+#endif
+	for (int tile = 0; tile < ntiles*ntiles; tile++) {
+		int row_tile = tile / ntiles, col_tile = tile % ntiles;
+		if (col_tile < row_tile)
+			continue;
+		int row_end = min((row_tile+1) * TILE_SIZE, ntrees);
+		int col_end = min((col_tile+1) * TILE_SIZE, ntrees);
+		for (int id = row_tile * TILE_SIZE; id < row_end; id++)
+			for (int id2 = max(col_tile * TILE_SIZE, id+1); id2 < col_end; id2++)
+				rfdist[(size_t)id*ntrees + id2] = rfdist[(size_t)id2*ntrees + id] = computeRFDist(id, id2);
+	}
+	for (int id = 0; id < ntrees; id++)
+		rfdist[(size_t)id*ntrees + id] = 0;
+}
+
+void TreeSplitIndex::computeRFDistRows(int *rfdist, int first_row, int num_rows) {
+	int ntrees = getNumTrees();
+	int ncol_tiles = (ntrees + TILE_SIZE - 1) / TILE_SIZE;
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic)
+#endif
+	for (int tile = 0; tile < ncol_tiles; tile++) {
+		int col_end = min((tile+1) * TILE_SIZE, ntrees);
+		for (int row = 0; row < num_rows; row++)
+			for (int id2 = tile * TILE_SIZE; id2 < col_end; id2++)
+				rfdist[(size_t)row*ntrees + id2] = (first_row+row == id2) ? 0 : computeRFDist(first_row+row, id2);
+	}
+}
@@ -23,9 +23,117 @@
 #include "mtree.h"
 #include "splitgraph.h"
 #include "alignment.h"
+#include <stdint.h>
 
 void readIntVector(const char *file_name, int burnin, int max_count, IntVector &vec);
 
+/**
+	Visitor of the trees read one at a time by MTreeSet::readTrees()
+*/
+class MTreeVisitor {
+public:
+	/**
+		process a tree, which is deleted afterwards
+		@param tree the tree just read
+		@param tree_id ID of the tree, i.e. index in MTreeSet::tree_weights
+		@param weight weight of the tree
+	*/
+	virtual void visitTree(MTree *tree, int tree_id, int weight) = 0;
+
+	virtual ~MTreeVisitor() {}
+};
+
+/**
+	Non-trivial splits of a collection of trees in flat arrays, for fast Robinson-Foulds distances.
+	Each distinct split, oriented to contain taxon 0, gets an ID and its bits are stored once;
+	it is looked up by a 64-bit fingerprint, and splits with equal fingerprints are told apart
+	by their bits. A tree is the sorted list of its split IDs, so that two trees are compared by
+	one merge.
+	Trees are added with addTree() or by passing the index as visitor to MTreeSet::readTrees().
+*/
+class TreeSplitIndex : public MTreeVisitor {
+public:
+
+	/** number of trees per side of a tile of the all-pairs distance matrix */
+	static const int TILE_SIZE = 64;
+
+	/**
+		constructor
+		@param weight_threshold splits with weight (branch length) below this threshold are not
+			counted when they are missing from the other tree, as in MTreeSet::computeRFDist()
+	*/
+	TreeSplitIndex(double weight_threshold = -1000);
+
+	/**
+		add the splits of a tree. Taxon IDs of the tree are assigned in alphabetical order
+		@param tree the tree, must have the same taxa as the first tree added
+	*/
+	void addTree(MTree *tree);
+
+	/** MTreeVisitor interface, call addTree() */
+	virtual void visitTree(MTree *tree, int tree_id, int weight);
+
+	/** @return number of trees added */
+	int getNumTrees() { return tree_start.size() - 1; }
+
+	/**
+		@return Robinson-Foulds distance between two trees
+	*/
+	int computeRFDist(int tree1, int tree2);
+
+	/**
+		compute the Robinson-Foulds distance between trees in parallel
+		@param rfdist (OUT) getNumTrees()-1 distances of adjacent trees for RF_ADJACENT_PAIR,
+			otherwise the getNumTrees()*getNumTrees() matrix
+		@param mode RF_ALL_PAIR or RF_ADJACENT_PAIR
+	*/
+	void computeRFDist(int *rfdist, int mode = RF_ALL_PAIR);
+
+	/**
+		compute rows of the all-pairs distance matrix in parallel, to print a matrix
+		that does not fit into memory block by block
+		@param rfdist (OUT) num_rows*getNumTrees() distances
+		@param first_row first tree of the rows
+		@param num_rows number of rows
+	*/
+	void computeRFDistRows(int *rfdist, int first_row, int num_rows);
+
+protected:
+
+	/** @return 64-bit fingerprint of a split */
+	uint64_t hashSplit(Split &sp);
+
+	/** @return ID of split sp, a new ID if the split was not seen before */
+	int getSplitID(Split &sp);
+
+	/** weight threshold, see constructor */
+	double weight_threshold;
+
+	/** alphabetically sorted taxa names of the first tree */
+	vector<string> taxname;
+
+	/** number of UINTs per split */
+	int split_size;
+
+	/** index of the first split of each tree, plus the total number of splits at the end */
+	IntVector tree_start;
+
+	/** IDs of the splits of all trees, sorted within each tree */
+	IntVector split_id;
+
+	/** split_size UINTs per distinct split, in the order of IDs */
+	vector<UINT> split_bits;
+
+	/** fingerprint to the ID of the first distinct split with this fingerprint */
+	unordered_map<uint64_t, int> hash_split_id;
+
+	/** for each distinct split, ID of the next split with the same fingerprint, or -1 */
+	IntVector same_hash_next;
+
+	/** 1 if the split counts towards the distance when missing from the other tree */
+	vector<char> split_counted;
+};
+
 /**
 Set of trees
 
@@ -76,9 +184,11 @@ public:
 		@param is_rooted (IN/OUT) true if tree is rooted
 		@param burnin the number of beginning trees to be discarded
 		@param max_count max number of trees to load
+		@param visitor if not NULL, each tree is passed to the visitor and deleted
+			instead of being added to the set, only tree_weights is filled
 	*/
 	void readTrees(const char *userTreeFile, bool &is_rooted, int burnin, int max_count,
-		IntVector *weights = NULL, bool compressed = false);
+		IntVector *weights = NULL, bool compressed = false, MTreeVisitor *visitor = NULL);
 
 	/**
 		assign the leaf IDs with their names for all trees
@@ -146,6 +256,57 @@ public:
 	void convertSplits(SplitGraph &sg, double split_threshold, 
 		int weighting_type, double weight_threshold);
 
+	/**
+		read trees from a file one at a time and convert them into the split system like
+		convertSplits(), without keeping the trees in memory. Afterwards the set contains
+		no tree, but tree_weights has one entry per tree read.
+		@param userTreeFile the name of the trees file
+		@param is_rooted (IN/OUT) true if tree is rooted
+		@param burnin the number of beginning trees to be discarded
+		@param max_count max number of trees to load
+		@param tree_weight_file file with one integer weight per tree, or NULL
+		@param taxname (IN/OUT) taxa names, taken from the first tree if empty
+		@param sg (OUT) resulting split graph
+		@param hash_ss (OUT) hash split set
+		@param weighting_type SW_COUNT, SW_SUM, SW_AVG_ALL or SW_AVG_PRESENT
+		@param weight_threshold minimum weight cutoff
+		@param tag_str TRUE to tag for each split, which trees it appears.
+		@param sort_taxa TRUE to sort taxa alphabetically
+	*/
+	void readSplits(const char *userTreeFile, bool &is_rooted, int burnin, int max_count,
+		const char *tree_weight_file, vector<string> &taxname, SplitGraph &sg, SplitIntMap &hash_ss,
+		int weighting_type, double weight_threshold, char *tag_str, bool sort_taxa = true);
+
+	/**
+		create the taxa of an empty split system, first step of convertSplits()
+		@param taxname taxa names, sorted if sort_taxa is TRUE
+		@param sg (OUT) split graph
+		@param sort_taxa TRUE to sort taxa alphabetically
+	*/
+	void initSplits(vector<string> &taxname, SplitGraph &sg, bool sort_taxa);
+
+	/**
+		add the splits of one tree to the split system, see convertSplits()
+		@param tree the tree
+		@param tree_id ID of the tree, used for tag_str
+		@param weight weight of the tree
+	*/
+	void addSplits(MTree *tree, int tree_id, int weight, vector<string> &taxname, SplitGraph &sg,
+		SplitIntMap &hash_ss, int weighting_type, char *tag_str, bool sort_taxa);
+
+	/**
+		average split weights and remove splits with weight <= weight_threshold, last step of convertSplits()
+	*/
+	void summarizeSplits(SplitGraph &sg, SplitIntMap &hash_ss, int weighting_type, double weight_threshold);
+
+	/**
+		remove splits that appear in at most split_threshold of the trees
+		@param sg (IN/OUT) split graph
+		@param hash_ss (IN/OUT) hash split set with split frequencies
+		@param split_threshold frequency threshold between 0 and 1
+	*/
+	void filterSplits(SplitGraph &sg, SplitIntMap &hash_ss, double split_threshold);
+
 	/**
 		compute the Robinson-Foulds distance between trees
 		@param rfdist (OUT) RF distance
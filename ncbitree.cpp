@@ -51,12 +51,10 @@ void NCBITree::readNCBINames(ifstream &in, const char *name_type) {
     int node_id;
     string node_name, unique_name;
 
-    in_line = in_column = 0;
 
     while (!in.eof()) {
         node_id = 0;
         if (!(in >> node_id)) break;
-        in_line++;
         if (node_id <= 0) throw "Wrong node ID";
         if (node_id > nodes.size()) throw "Too large node ID";
         if (nodes[node_id]) {
@@ -111,12 +109,10 @@ Node* NCBITree::readNCBITree(istream &in, int root_id, const char* taxon_level,
     string node_level;
     int node_id, parent_id, max_node_id = 0, num_nodes = 0;
     char ch;
-    in_line = in_column = 0;
 
     while (!in.eof()) {
         node_id = parent_id = 0;
         if (!(in >> node_id)) break;
-        in_line++;
         num_nodes ++;
         if (node_id <= 0) throw "Wrong node ID";
         if (node_id >= nodes.size()) throw "Too large node ID";
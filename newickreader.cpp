@@ -0,0 +1,123 @@
+/*
+ * newickreader.cpp
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#include "newickreader.h"
+
+NewickReader::NewickReader(istream &in, bool buffered) : in(in) {
+	this->buffered = buffered;
+	buf = new char[buffered ? BUFFER_SIZE : 1];
+	pos = end = buf;
+	at_eof = false;
+	line = 1;
+	column = 1;
+}
+
+NewickReader::~NewickReader() {
+	delete [] buf;
+}
+
+bool NewickReader::fill() {
+	if (at_eof)
+		return false;
+	if (!buffered) {
+		// may throw ios::failure at the end of the input, like istream::get() did before
+		int ch = in.get();
+		if (ch == EOF)
+			return false;
+		buf[0] = ch;
+		pos = buf;
+		end = buf + 1;
+		return true;
+	}
+	in.read(buf, BUFFER_SIZE);
+	pos = buf;
+	end = buf + in.gcount();
+	return pos != end;
+}
+
+void NewickReader::advance(char *p) {
+	for (char *nl = (char*)memchr(pos, 10, p - pos); nl; nl = (char*)memchr(pos, 10, p - pos)) {
+		line++;
+		column = 1;
+		pos = nl + 1;
+	}
+	column += p - pos;
+	pos = p;
+}
+
+char NewickReader::readNextChar(char current_ch) {
+	char ch;
+	if (current_ch == '[')
+		ch = current_ch;
+	else
+		get(ch);
+	while (controlchar(ch) && !at_eof)
+		get(ch);
+	// ignore comment
+	while (ch == '[' && !at_eof) {
+		while (ch != ']' && !at_eof)
+			get(ch);
+		if (ch != ']') throw "Comments not ended with ]";
+		get(ch);
+		while (controlchar(ch) && !at_eof)
+			get(ch);
+	}
+	return ch;
+}
+
+void NewickReader::readToken(string &str, char &ch) {
+	while (true) {
+		if (pos == end && !fill()) {
+			at_eof = true;
+			column++;
+			return;
+		}
+		char *p = pos;
+		while (p != end && !is_newick_token(*p) && !controlchar(*p))
+			p++;
+		str.append(pos, p - pos);
+		advance(p);
+		if (p != end) {
+			get(ch);
+			return;
+		}
+	}
+}
+
+bool NewickReader::skipTree() {
+	char ch = 0;
+	while (true) {
+		if (pos == end && !fill()) {
+			at_eof = true;
+			return false;
+		}
+		char *p = (char*)memchr(pos, ';', end - pos);
+		if (!p) {
+			advance(end);
+			continue;
+		}
+		advance(p);
+		get(ch);
+		return true;
+	}
+}
+
+bool NewickReader::skipSpaces() {
+	char ch;
+	while (true) {
+		if (pos == end && !fill()) {
+			at_eof = true;
+			return true;
+		}
+		if (!controlchar(*pos))
+			return false;
+		get(ch);
+	}
+}
+
+string NewickReader::reportInputInfo() {
+	return " (line " + convertIntToString(line) + " column " + convertIntToString(column-1) + ")";
+}
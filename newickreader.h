@@ -0,0 +1,125 @@
+/*
+ * newickreader.h
+ *
+ *  Created on: Oct 18, 2026
+ */
+
+#ifndef NEWICKREADER_H_
+#define NEWICKREADER_H_
+
+#include "tools.h"
+
+/**
+ * Character source for the NEWICK parser of MTree. In buffered mode the input stream
+ * (ifstream, igzstream or stringstream) is read in large chunks and names and branch lengths
+ * are cut out of the buffer as a whole, instead of one istream::get() per character.
+ * Line and column of the current position are tracked for error messages.
+ */
+class NewickReader {
+public:
+
+	/** size of one chunk in buffered mode */
+	static const int BUFFER_SIZE = 1 << 20;
+
+	/**
+	 * constructor
+	 * @param in input stream
+	 * @param buffered TRUE to read the stream in chunks of BUFFER_SIZE, then the position of the
+	 *        stream afterwards is undefined and only badbit may be set in in.exceptions().
+	 *        FALSE to read one character at a time, the stream then stands right after the last
+	 *        character consumed, e.g. after the semi-colon of a tree
+	 */
+	NewickReader(istream &in, bool buffered = true);
+
+	~NewickReader();
+
+	/** @return TRUE if the end of the input was reached */
+	bool eof() { return at_eof; }
+
+	/**
+	 * read one character
+	 * @param ch (OUT) character read, unchanged at the end of the input
+	 */
+	inline void get(char &ch) {
+		if (pos == end && !fill()) {
+			at_eof = true;
+			column++;
+			return;
+		}
+		ch = *pos++;
+		column++;
+		if (ch == 10) {
+			line++;
+			column = 1;
+		}
+	}
+
+	/**
+	 * read the next character, skipping control characters and comments [...]
+	 * @param current_ch current character, the comment starting with it is skipped if it is '['
+	 * @return next character
+	 */
+	char readNextChar(char current_ch = 0);
+
+	/**
+	 * append characters to a string up to the next NEWICK token or control character
+	 * @param str (IN/OUT) string to append to
+	 * @param ch (OUT) the character that ended the token, unchanged at the end of the input
+	 */
+	void readToken(string &str, char &ch);
+
+	/**
+	 * skip the rest of a tree up to and including the next semi-colon
+	 * @return FALSE if the end of the input was reached before
+	 */
+	bool skipTree();
+
+	/**
+	 * skip control characters
+	 * @return TRUE if the end of the input was reached
+	 */
+	bool skipSpaces();
+
+	/** @return " (line x column y)" of the current position */
+	string reportInputInfo();
+
+protected:
+
+	/**
+	 * read the next chunk of the input
+	 * @return FALSE if no character is left
+	 */
+	bool fill();
+
+	/**
+	 * move the current position forward within the buffer, updating line and column
+	 * @param p new position, between pos and end
+	 */
+	void advance(char *p);
+
+	/** input stream */
+	istream &in;
+
+	/** TRUE for reading in chunks */
+	bool buffered;
+
+	/** the buffer */
+	char *buf;
+
+	/** current position in the buffer */
+	char *pos;
+
+	/** end of the valid part of the buffer */
+	char *end;
+
+	/** TRUE if the end of the input was reached */
+	bool at_eof;
+
+	/** line of the current position */
+	int line;
+
+	/** column of the current position */
+	int column;
+};
+
+#endif /* NEWICKREADER_H_ */
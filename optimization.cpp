@@ -477,9 +477,10 @@ double Optimization::minimizeNewton(double x1, double xguess, double x2, double
 
 #define ALF 1.0e-4
 #define TOLX 1.0e-7
-static double maxarg1,maxarg2;
-#define FMAX(a,b) (maxarg1=(a),maxarg2=(b),(maxarg1) > (maxarg2) ?\
-        (maxarg1) : (maxarg2))
+// not the NR macro with static temporaries: several models may be optimized concurrently
+static inline double FMAX(double a, double b) {
+	return (a > b) ? a : b;
+}
 
 void Optimization::lnsrch(int n, double xold[], double fold, double g[], double p[], double x[],
                    double *f, double stpmax, int *check, double lower[], double upper[]) {
@@ -608,8 +609,9 @@ double Optimization::minimizeMultiDimen(double guess[], int ndim, double lower[]
 
 
 #define ITMAX 200
-static double sqrarg;
-#define SQR(a) ((sqrarg=(a)) == 0.0 ? 0.0 : sqrarg*sqrarg)
+static inline double SQR(double a) {
+	return a*a;
+}
 #define EPS 3.0e-8
 #define TOLX (4*EPS)
 #define STPMX 100.0
@@ -708,12 +710,10 @@ void Optimization::dfpmin(double p[], int n, double lower[], double upper[], dou
 	FREEALL
 }
 #undef ITMAX
-#undef SQR
 #undef EPS
 #undef TOLX
 #undef STPMX
 #undef FREEALL
-#undef FMAX
 
 
 /**
@@ -63,6 +63,7 @@
 #include "ecopdmtreeset.h"
 #include "gurobiwrapper.h"
 #include "timeutil.h"
+#include "mpihelper.h"
 //#include <unistd.h>
 #include <stdlib.h>
 #include "vectorclass/vectorclass.h"
@@ -1375,6 +1376,40 @@ void printRFDist(ostream &out, int *rfdist, int n, int m, int rf_dist_mode) {
 	}
 }
 
+/** the all-pairs RF distance matrix is printed block by block if larger than this (bytes) */
+const double RF_MAX_MATRIX_MEM = 1024.0 * 1024.0 * 1024.0;
+
+/**
+	compute and print the all-pairs RF distance matrix in blocks of rows, in the same format
+	as printRFDist(), for a number of trees whose matrix does not fit into memory
+*/
+void printRFDistRows(const char *filename, TreeSplitIndex &index) {
+	int n = index.getNumTrees();
+	int block_rows = max(1, (int)(64 * 1024 * 1024 / ((size_t)n * sizeof(int))));
+	int *rfdist = new int [(size_t)block_rows*n];
+	try {
+		ofstream out;
+		out.exceptions(ios::failbit | ios::badbit);
+		out.open(filename);
+		out << n << " " << n << endl;
+		for (int first_row = 0; first_row < n; first_row += block_rows) {
+			int num_rows = min(block_rows, n - first_row);
+			index.computeRFDistRows(rfdist, first_row, num_rows);
+			for (int i = 0; i < num_rows; i++) {
+				out << "Tree" << first_row+i << "      ";
+				for (int j = 0; j < n; j++)
+					out << " " << rfdist[(size_t)i*n+j];
+				out << endl;
+			}
+		}
+		out.close();
+		cout << "Robinson-Foulds distances printed to " << filename << endl;
+	} catch (ios::failure) {
+		outError(ERR_WRITE_OUTPUT, filename);
+	}
+	delete [] rfdist;
+}
+
 void computeRFDistExtended(const char *trees1, const char *trees2, const char *filename) {
 	cout << "Reading input trees 1 file " << trees1 << endl;
 	int ntrees = 0, ntrees2 = 0;
@@ -1439,15 +1474,33 @@ void computeRFDist(Params &params) {
 		return;
 	}
 
-	MTreeSet trees(params.user_file, params.is_rooted, params.tree_burnin, params.tree_max_count);
-	int n = trees.size(), m = trees.size();
+	MTreeSet trees;
+	int n, m;
 	int *rfdist;
 	int *incomp_splits = NULL;
 	string infoname = params.out_prefix;
 	infoname += ".rfinfo";
 	string treename = params.out_prefix;
 	treename += ".rftree";
-	if (params.rf_dist_mode == RF_TWO_TREE_SETS) {
+	if (params.rf_dist_mode != RF_TWO_TREE_SETS) {
+		// trees are not kept, only the IDs of their splits and the bits of each distinct split
+		TreeSplitIndex index(params.split_weight_threshold);
+		trees.readTrees(params.user_file, params.is_rooted, params.tree_burnin, params.tree_max_count,
+			NULL, false, &index);
+		n = m = index.getNumTrees();
+		cout << "Computing Robinson-Foulds distance..." << endl;
+		if (params.rf_dist_mode == RF_ALL_PAIR && (double)n*n*sizeof(int) > RF_MAX_MATRIX_MEM) {
+			printRFDistRows(filename.c_str(), index);
+			return;
+		}
+		// n-1 distances of adjacent trees, printed with a trailing 0
+		size_t size = (params.rf_dist_mode == RF_ADJACENT_PAIR) ? n : (size_t)n*n;
+		rfdist = new int [size];
+		memset(rfdist, 0, size * sizeof(int));
+		index.computeRFDist(rfdist, params.rf_dist_mode);
+	} else {
+		trees.init(params.user_file, params.is_rooted, params.tree_burnin, params.tree_max_count);
+		n = m = trees.size();
 		MTreeSet treeset2(params.second_tree, params.is_rooted, params.tree_burnin, params.tree_max_count);
 		cout << "Computing Robinson-Foulds distances between two sets of trees" << endl;
 		m = treeset2.size();
@@ -1461,10 +1514,6 @@ void computeRFDist(Params &params) {
 			trees.computeRFDist(rfdist, &treeset2, infoname.c_str(),treename.c_str(), incomp_splits);
 		else
 			trees.computeRFDist(rfdist, &treeset2);
-	} else {
-		rfdist = new int [n*n];
-		memset(rfdist, 0, n*n* sizeof(int));
-		trees.computeRFDist(rfdist, params.rf_dist_mode, params.split_weight_threshold);
 	}
 
 	if (verbose_mode >= VB_MED) printRFDist(cout, rfdist, n, m, params.rf_dist_mode);
@@ -2134,6 +2183,8 @@ Instruction set ID reported by vectorclass::instrset_detect
 */
 int instruction_set;
 
+size_t aligned_alloc_count = 0;
+
 int main(int argc, char *argv[])
 {
 
@@ -2179,6 +2230,8 @@ int main(int argc, char *argv[])
 	} /* local scope */
 	/*************************/
 
+	MPIHelper::getInstance().init(&argc, &argv);
+
 	//Params params;
 	parseArg(argc, argv, Params::getInstance());
 
@@ -2189,27 +2242,38 @@ int main(int argc, char *argv[])
     
     bool append_log = false;
     
-    if (!Params::getInstance().ignore_checkpoint && fileExists(filename)) {
+    // only the master loads the checkpoint, the other processes of the distributed tree search resume from its copy
+    if (MPIHelper::getInstance().isMaster() && !Params::getInstance().ignore_checkpoint && fileExists(filename)) {
         checkpoint->load();
-        if (checkpoint->hasKey("finished")) {
-            if (checkpoint->getBool("finished")) {
-                if (Params::getInstance().force_unfinished) {
-                    cout << "NOTE: Continue analysis although a previous run already finished" << endl;
-                } else {
-                    outError("Checkpoint (" + filename + ") indicates that a previous run successfully finished\n" +
-                        "Use `-redo` option if you really want to redo the analysis and overwrite all output files.");
-                    delete checkpoint;
-                    return EXIT_FAILURE;
-                } 
-            } else {
-                append_log = true;
-            }
-        } else {
+        if (!checkpoint->hasKey("finished")) {
             outWarning("Ignore invalid checkpoint file " + filename);
             checkpoint->clear();
         }
     }
+    MPIHelper::getInstance().broadcastCheckpoint(checkpoint);
+
+    if (checkpoint->hasKey("finished")) {
+        if (checkpoint->getBool("finished")) {
+            if (Params::getInstance().force_unfinished) {
+                cout << "NOTE: Continue analysis although a previous run already finished" << endl;
+            } else {
+                outError("Checkpoint (" + filename + ") indicates that a previous run successfully finished\n" +
+                    "Use `-redo` option if you really want to redo the analysis and overwrite all output files.");
+                delete checkpoint;
+                return EXIT_FAILURE;
+            } 
+        } else {
+            append_log = true;
+        }
+    }
 
+	if (!MPIHelper::getInstance().isMaster()) {
+		// other MPI processes only take part in the tree search: keep their files apart and the screen quiet
+		string rank_prefix = (string)Params::getInstance().out_prefix + ".rank" + convertIntToString(MPIHelper::getInstance().getProcessID());
+		Params::getInstance().out_prefix = new char[rank_prefix.length() + 1];
+		strcpy(Params::getInstance().out_prefix, rank_prefix.c_str());
+		verbose_mode = VB_QUIET;
+	}
 
 	_log_file = Params::getInstance().out_prefix;
 	_log_file += ".log";
@@ -2248,6 +2312,8 @@ int main(int argc, char *argv[])
 	instruction_set = instrset_detect();
 #if defined(BINARY32) || defined(__NOAVX__)
     instruction_set = min(instruction_set, 6);
+#elif defined(__NOAVX512__)
+    instruction_set = min(instruction_set, 8);
 #endif
 	if (instruction_set < 3) outError("Your CPU does not support SSE3!");
 	bool has_fma3 = (instruction_set >= 7) && hasFMA3();
@@ -2285,6 +2351,8 @@ int main(int argc, char *argv[])
 	cout << endl;
 
     checkpoint->get("iqtree.seed", Params::getInstance().ran_seed);
+    // independent random streams for the processes of the distributed tree search
+    Params::getInstance().ran_seed += MPIHelper::getInstance().getProcessID();
 	cout << "Seed:    " << Params::getInstance().ran_seed <<  " ";
 	init_random(Params::getInstance().ran_seed, true);
 
@@ -2294,6 +2362,8 @@ int main(int argc, char *argv[])
 
 	if (Params::getInstance().lk_no_avx)
 		instruction_set = min(instruction_set, 6);
+	if (Params::getInstance().lk_no_avx512)
+		instruction_set = min(instruction_set, 8);
 
 	cout << "Kernel:  ";
 	if (Params::getInstance().pll) {
@@ -2306,7 +2376,9 @@ int main(int argc, char *argv[])
 		switch (Params::getInstance().SSE) {
 		case LK_EIGEN: cout << "No SSE"; break;
 		case LK_EIGEN_SSE:
-			if (instruction_set >= 7) {
+			if (instruction_set >= 9) {
+				cout << "AVX-512";
+			} else if (instruction_set >= 7) {
 				cout << "AVX";
 			} else {
 				cout << "SSE3";
@@ -2486,9 +2558,12 @@ int main(int argc, char *argv[])
 	}
 
 	delete checkpoint;
+	if (!MPIHelper::getInstance().isMaster())
+		delete [] Params::getInstance().out_prefix;
 	time(&start_time);
 	cout << "Date and Time: " << ctime(&start_time);
 
 	finish_random();
+	MPIHelper::getInstance().finalize();
 	return EXIT_SUCCESS;
 }
@@ -52,6 +52,12 @@
 #include "model/modelset.h"
 #include "timeutil.h"
 #include "upperbounds.h"
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__)
+#include <unistd.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <dirent.h>
+#endif
 
 
 void reportReferences(Params &params, ofstream &out, string &original_model) {
@@ -1578,6 +1584,9 @@ void printFinalSearchInfo(Params &params, IQTree &iqtree, double search_cpu_time
 		}
 	}
 
+	if (!iqtree.isSuperTree() && iqtree.getModelFactory())
+		iqtree.getModelFactory()->reportTransMatrixCache(cout);
+
 	params.run_time = (getCPUTime() - params.startCPUTime);
 	cout << endl;
 	cout << "Total number of iterations: " << iqtree.stop_rule.getCurIt() << endl;
@@ -1935,6 +1944,19 @@ void runTreeReconstruction(Params &params, string &original_model, IQTree &iqtre
 		cout << endl;
 	}
 
+    if (params.lk_float) {
+        // tree search was done with single-precision partial likelihoods,
+        // switch to double precision for the final evaluation of the best tree
+        cout << "Switching to double-precision partial likelihoods" << endl;
+        iqtree.force_double_lh = true;
+        iqtree.setLikelihoodKernel(params.SSE);
+        if (!params.min_iterations) {
+            iqtree.initializeAllPartialLh();
+            iqtree.clearAllPartialLH();
+            iqtree.setCurScore(iqtree.computeLikelihood());
+        }
+    }
+
 	if (params.min_iterations) {
 		iqtree.readTreeString(iqtree.candidateTrees.getBestTrees()[0]);
         iqtree.initializeAllPartialLh();
@@ -2219,6 +2241,257 @@ void exhaustiveSearchGAMMAInvar(Params &params, IQTree &iqtree) {
 /**********************************************************
  * STANDARD NON-PARAMETRIC BOOTSTRAP
  ***********************************************************/
+
+/**
+ * create the bootstrap alignment of a replicate from the random stream with seed ran_seed+sample,
+ * so that checkpointing does not need to save bootstrap samples
+ * @param keep_stream TRUE to continue with this stream afterwards, FALSE to restore the previous one
+ */
+Alignment *createBootstrapReplicate(Params &params, Alignment *alignment, int sample, bool keep_stream) {
+    int *saved_randstream = randstream;
+    init_random(params.ran_seed + sample);
+
+	Alignment* bootstrap_alignment;
+	cout << "Creating bootstrap alignment (seed: " << params.ran_seed+sample << ")..." << endl;
+	if (alignment->isSuperAlignment())
+		bootstrap_alignment = new SuperAlignment;
+	else
+		bootstrap_alignment = new Alignment;
+	bootstrap_alignment->createBootstrapAlignment(alignment, NULL, params.bootstrap_spec);
+
+	if (!keep_stream) {
+        finish_random();
+        randstream = saved_randstream;
+	}
+	return bootstrap_alignment;
+}
+
+/** write the optional .bootlh and .bootaln entries of a replicate */
+void printBootstrapReplicate(Params &params, Alignment *alignment, Alignment *bootstrap_alignment, int sample,
+		string &bootlh_name, string &bootaln_name) {
+	if (params.print_tree_lh) {
+		double prob;
+		bootstrap_alignment->multinomialProb(*alignment, prob);
+		ofstream boot_lh;
+		if (sample == 0)
+			boot_lh.open(bootlh_name.c_str());
+		else
+			boot_lh.open(bootlh_name.c_str(), ios_base::out | ios_base::app);
+		boot_lh << "0\t" << prob << endl;
+		boot_lh.close();
+	}
+	if (params.print_bootaln)
+		bootstrap_alignment->printPhylip(bootaln_name.c_str(), true);
+}
+
+/** @return new tree for a bootstrap alignment, of the same kind as the original tree */
+IQTree *newBootstrapTree(Params &params, Alignment *bootstrap_alignment, IQTree *tree) {
+	IQTree *boot_tree;
+	if (bootstrap_alignment->isSuperAlignment()){
+		if(params.partition_type){
+			boot_tree = new PhyloSuperTreePlen((SuperAlignment*) bootstrap_alignment, (PhyloSuperTree*) tree);
+		} else {
+			boot_tree = new PhyloSuperTree((SuperAlignment*) bootstrap_alignment, (PhyloSuperTree*) tree);
+		}
+	} else
+		boot_tree = new IQTree(bootstrap_alignment);
+    boot_tree->num_precision = tree->num_precision;
+	return boot_tree;
+}
+
+/** append a tree to the .boottrees file */
+void appendBootstrapTree(string &boottrees_name, string tree_str) {
+	try {
+		ofstream tree_out;
+		tree_out.exceptions(ios::failbit | ios::badbit);
+		tree_out.open(boottrees_name.c_str(), ios_base::out | ios_base::app);
+		tree_out << tree_str << endl;
+		tree_out.close();
+	} catch (ios::failure) {
+		outError(ERR_WRITE_OUTPUT, boottrees_name);
+	}
+}
+
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__)
+
+extern string _log_file;
+extern "C" void startLogFile(bool append_log);
+extern "C" void endLogFile();
+
+/**
+ * run one bootstrap replicate in a forked process: its output files go to \a job_prefix,
+ * the resulting tree to job_prefix.boottree. Does not return.
+ */
+void runBootstrapJob(Params &params, string &original_model, Alignment *alignment, IQTree *tree,
+		int sample, string job_prefix, int num_threads) {
+	// a replicate interrupted with the whole run resumes from its own checkpoint
+	Checkpoint *checkpoint = new Checkpoint;
+	checkpoint->setFileName(job_prefix + ".ckp.gz");
+	checkpoint->setDumpInterval(params.checkpoint_dump_interval);
+	if (!params.ignore_checkpoint)
+		checkpoint->load();
+	bool resumed = !checkpoint->empty();
+
+	// own log file, quiet screen
+	endLogFile();
+	_log_file = job_prefix + ".log";
+	startLogFile(resumed);
+	verbose_mode = VB_QUIET;
+	params.out_prefix = new char[job_prefix.length() + 1];
+	strcpy(params.out_prefix, job_prefix.c_str());
+#ifdef _OPENMP
+	params.num_threads = num_threads;
+	omp_set_num_threads(num_threads);
+#endif
+
+	if (resumed)
+		cout << endl << "CHECKPOINT: Resuming bootstrap replicate from " << job_prefix << ".ckp.gz" << endl;
+	cout << "===> BOOTSTRAP REPLICATE NUMBER " << sample + 1 << endl << endl;
+	Alignment *bootstrap_alignment = createBootstrapReplicate(params, alignment, sample, true);
+	IQTree *boot_tree = newBootstrapTree(params, bootstrap_alignment, tree);
+	boot_tree->setCheckpoint(checkpoint);
+	vector<ModelInfo> model_info;
+	runTreeReconstruction(params, original_model, *boot_tree, model_info);
+
+	string boottree_name = job_prefix + ".boottree";
+	try {
+		ofstream tree_out;
+		tree_out.exceptions(ios::failbit | ios::badbit);
+		tree_out.open(boottree_name.c_str());
+		boot_tree->printTree(tree_out);
+		tree_out << endl;
+		tree_out.close();
+	} catch (ios::failure) {
+		outError(ERR_WRITE_OUTPUT, boottree_name);
+	}
+	endLogFile();
+	_exit(EXIT_SUCCESS);
+}
+
+/** remove the files of finished bootstrap jobs and their directory */
+void removeBootstrapJobDir(string &job_dir) {
+	DIR *dir = opendir(job_dir.c_str());
+	if (!dir)
+		return;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		string name = entry->d_name;
+		if (name != "." && name != "..")
+			remove((job_dir + "/" + name).c_str());
+	}
+	closedir(dir);
+	rmdir(job_dir.c_str());
+}
+
+/** terminate and reap the running bootstrap jobs, before giving up on the bootstrap analysis */
+void killBootstrapJobs(map<pid_t, int> &running) {
+	map<pid_t, int>::iterator it;
+	for (it = running.begin(); it != running.end(); it++)
+		kill(it->first, SIGTERM);
+	for (it = running.begin(); it != running.end(); it++)
+		waitpid(it->first, NULL, 0);
+	running.clear();
+}
+
+/**
+ * run bootstrap replicates from bootSample on concurrently, params.num_boot_jobs at a time, each in
+ * a forked process with an equal share of the threads. Trees are appended to the .boottrees file in
+ * replicate order; finished replicates that wait for an earlier one are kept in the checkpoint.
+ * Replicates are forked before this process starts any parallel region: OpenMP cannot be used
+ * with several threads in a child forked after that.
+ */
+void runBootstrapJobs(Params &params, string &original_model, Alignment *alignment, IQTree *tree,
+		int bootSample, string &boottrees_name, string &bootlh_name, string &bootaln_name) {
+	Checkpoint *checkpoint = tree->getCheckpoint();
+	int num_jobs = min(params.num_boot_jobs, params.num_bootstrap_samples - bootSample);
+	int num_threads = max(params.num_threads / num_jobs, 1);
+	cout << endl << "===> RUNNING " << num_jobs << " BOOTSTRAP REPLICATES CONCURRENTLY WITH "
+			<< num_threads << " THREAD(S) EACH" << endl << endl;
+
+	string job_dir = (string)params.out_prefix + ".bootjobs";
+	mkdir(job_dir.c_str(), 0755);
+
+	map<pid_t, int> running;
+	map<int, string> finished;
+	int sample, next_sample = bootSample;
+	// replicates finished by an interrupted run
+	for (sample = bootSample; sample < params.num_bootstrap_samples; sample++) {
+		string tree_str;
+		if (checkpoint->getString("bootTree" + convertIntToString(sample), tree_str))
+			finished[sample] = tree_str;
+	}
+	if (!finished.empty())
+		cout << "CHECKPOINT: " << finished.size() << " further bootstrap replicates restored" << endl;
+
+	while (true) {
+		// append trees in replicate order
+		while (finished.find(bootSample) != finished.end()) {
+			Alignment *bootstrap_alignment = NULL;
+			if (params.print_tree_lh || params.print_bootaln)
+				bootstrap_alignment = createBootstrapReplicate(params, alignment, bootSample, false);
+			if (bootstrap_alignment) {
+				printBootstrapReplicate(params, alignment, bootstrap_alignment, bootSample, bootlh_name, bootaln_name);
+				delete bootstrap_alignment;
+			}
+			appendBootstrapTree(boottrees_name, finished[bootSample]);
+			finished.erase(bootSample);
+			checkpoint->erase("bootTree" + convertIntToString(bootSample));
+			bootSample++;
+		}
+		checkpoint->put("bootSample", bootSample);
+		checkpoint->putBool("finished", false);
+		checkpoint->dump(true);
+		if (bootSample >= params.num_bootstrap_samples)
+			break;
+
+		// children must not inherit unwritten output
+		cout.flush();
+		while (running.size() < num_jobs && next_sample < params.num_bootstrap_samples) {
+			sample = next_sample++;
+			if (finished.find(sample) != finished.end())
+				continue;
+			string job_prefix = job_dir + "/rep" + convertIntToString(sample + 1);
+			pid_t pid = fork();
+			if (pid < 0) {
+				killBootstrapJobs(running);
+				outError("Cannot create process for bootstrap replicate " + convertIntToString(sample + 1));
+			}
+			if (pid == 0)
+				runBootstrapJob(params, original_model, alignment, tree, sample, job_prefix, num_threads);
+			running[pid] = sample;
+		}
+
+		int status;
+		pid_t pid = waitpid(-1, &status, 0);
+		if (pid < 0 || running.find(pid) == running.end())
+			continue;
+		sample = running[pid];
+		running.erase(pid);
+		string job_prefix = job_dir + "/rep" + convertIntToString(sample + 1);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+			killBootstrapJobs(running);
+			outError("Bootstrap replicate " + convertIntToString(sample + 1) + " failed, see " + job_prefix + ".log");
+		}
+		string tree_str;
+		try {
+			ifstream tree_in;
+			tree_in.exceptions(ios::failbit | ios::badbit);
+			tree_in.open((job_prefix + ".boottree").c_str());
+			getline(tree_in, tree_str);
+			tree_in.close();
+		} catch (ios::failure) {
+			killBootstrapJobs(running);
+			outError(ERR_READ_INPUT, job_prefix + ".boottree");
+		}
+		cout << "Bootstrap replicate " << sample + 1 << " finished" << endl;
+		finished[sample] = tree_str;
+		checkpoint->put("bootTree" + convertIntToString(sample), tree_str);
+	}
+	removeBootstrapJobDir(job_dir);
+}
+
+#endif
+
 void runStandardBootstrap(Params &params, string &original_model, Alignment *alignment, IQTree *tree) {
 	vector<ModelInfo> *model_info = new vector<ModelInfo>;
 	StrVector removed_seqs, twin_seqs;
@@ -2264,54 +2537,35 @@ void runStandardBootstrap(Params &params, string &original_model, Alignment *ali
 
     
     
+	bool parallel_boot = (params.num_boot_jobs > 1 && params.num_bootstrap_samples - bootSample > 1);
+	// the models selected on the last replicate are reused for partitions, which needs the serial loop
+	if (parallel_boot && original_model.substr(0,4) == "TEST" && tree->isSuperTree()) {
+		outWarning("Concurrent bootstrap replicates (-bjobs) not supported with partition model selection");
+		parallel_boot = false;
+	}
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__)
+	if (parallel_boot) {
+		outWarning("Concurrent bootstrap replicates (-bjobs) not supported on Windows");
+		parallel_boot = false;
+	}
+#else
+	if (parallel_boot) {
+		runBootstrapJobs(params, original_model, alignment, tree, bootSample, boottrees_name, bootlh_name, bootaln_name);
+		bootSample = params.num_bootstrap_samples;
+	}
+#endif
+
 	// do bootstrap analysis
 	for (int sample = bootSample; sample < params.num_bootstrap_samples; sample++) {
 		cout << endl << "===> START BOOTSTRAP REPLICATE NUMBER "
 				<< sample + 1 << endl << endl;
 
-        // 2015-12-17: initialize random stream for creating bootstrap samples
-        // mainly so that checkpointing does not need to save bootstrap samples
-        int *saved_randstream = randstream;
-        init_random(params.ran_seed + sample);
-
-		Alignment* bootstrap_alignment;
-		cout << "Creating bootstrap alignment (seed: " << params.ran_seed+sample << ")..." << endl;
-		if (alignment->isSuperAlignment())
-			bootstrap_alignment = new SuperAlignment;
-		else
-			bootstrap_alignment = new Alignment;
-		bootstrap_alignment->createBootstrapAlignment(alignment, NULL, params.bootstrap_spec);
-
-        // restore randstream
-        finish_random();
-        randstream = saved_randstream;
-
-		if (params.print_tree_lh) {
-			double prob;
-			bootstrap_alignment->multinomialProb(*alignment, prob);
-			ofstream boot_lh;
-			if (sample == 0)
-				boot_lh.open(bootlh_name.c_str());
-			else
-				boot_lh.open(bootlh_name.c_str(), ios_base::out | ios_base::app);
-			boot_lh << "0\t" << prob << endl;
-			boot_lh.close();
-		}
-		IQTree *boot_tree;
-		if (alignment->isSuperAlignment()){
-			if(params.partition_type){
-				boot_tree = new PhyloSuperTreePlen((SuperAlignment*) bootstrap_alignment, (PhyloSuperTree*) tree);
-			} else {
-				boot_tree = new PhyloSuperTree((SuperAlignment*) bootstrap_alignment, (PhyloSuperTree*) tree);
-			}
-		} else
-			boot_tree = new IQTree(bootstrap_alignment);
-		if (params.print_bootaln)
-			bootstrap_alignment->printPhylip(bootaln_name.c_str(), true);
+		Alignment *bootstrap_alignment = createBootstrapReplicate(params, alignment, sample, false);
+		printBootstrapReplicate(params, alignment, bootstrap_alignment, sample, bootlh_name, bootaln_name);
+		IQTree *boot_tree = newBootstrapTree(params, bootstrap_alignment, tree);
 
         // set checkpoint
         boot_tree->setCheckpoint(tree->getCheckpoint());
-        boot_tree->num_precision = tree->num_precision;
 
 		runTreeReconstruction(params, original_model, *boot_tree, *model_info);
 		// read in the output tree file
@@ -2327,15 +2581,7 @@ void runStandardBootstrap(Params &params, string &original_model, Alignment *ali
 //			outError(ERR_READ_INPUT, treefile_name);
 //		}
 		// write the tree into .boottrees file
-		try {
-			ofstream tree_out;
-			tree_out.exceptions(ios::failbit | ios::badbit);
-			tree_out.open(boottrees_name.c_str(), ios_base::out | ios_base::app);
-			tree_out << ss.str() << endl;
-			tree_out.close();
-		} catch (ios::failure) {
-			outError(ERR_WRITE_OUTPUT, boottrees_name);
-		}
+		appendBootstrapTree(boottrees_name, ss.str());
 		// fix bug: set the model for original tree after testing
 		if (original_model.substr(0,4) == "TEST" && tree->isSuperTree()) {
 			PhyloSuperTree *stree = ((PhyloSuperTree*)tree);
@@ -2456,6 +2702,30 @@ void runPhyloAnalysis(Params &params, Checkpoint *checkpoint) {
     
     checkpoint->putBool("finished", false);
     checkpoint->setDumpInterval(params.checkpoint_dump_interval);
+    checkpoint->setBinaryDump(params.checkpoint_binary);
+
+    if (params.lk_float && (params.partition_type || params.upper_bound || params.upper_bound_NNI)) {
+        outWarning("Single-precision partial likelihoods (-float) not supported for edge-linked partition model or upper bounds, using double precision");
+        params.lk_float = false;
+    }
+
+    if (params.lh_mem_limit && (params.partition_file || params.upper_bound || params.upper_bound_NNI)) {
+        outWarning("Memory limit for likelihood vectors (-mem) not supported for partition model or upper bounds, ignored");
+        params.lh_mem_limit = 0;
+    }
+
+    if (params.nni_parallel && params.num_threads > 1 && !params.partition_file) {
+        // UFBoot saves every tree of the NNI evaluation, which is done one branch at a time
+        if (params.gbo_replicates && params.iqp_assess_quartet != IQP_BOOTSTRAP)
+            cout << "NOTE: Parallel NNI evaluation (-nnipar) not used with ultrafast bootstrap" << endl;
+        else if (params.lh_mem_limit)
+            cout << "NOTE: Parallel NNI evaluation (-nnipar) not used with memory limit (-mem)" << endl;
+        else if (params.lh_mem_save != LM_ALL_BRANCH) {
+            // concurrent NNIs read partial likelihoods in all directions at once
+            cout << "NOTE: Parallel NNI evaluation (-nnipar) stores partial likelihoods of all branches (-nolhmemsave)" << endl;
+            params.lh_mem_save = LM_ALL_BRANCH;
+        }
+    }
 
 	/****************** read in alignment **********************/
 	if (params.partition_file) {
@@ -2705,9 +2975,20 @@ void assignBootstrapSupport(const char *input_trees, int burnin, int max_count,
 		}
 		scale /= sg.maxWeight();
 	} else {
-		boot_trees.init(input_trees, rooted, burnin, max_count,
-				tree_weight_file);
-		boot_trees.convertSplits(taxname, sg, hash_ss, SW_COUNT, -1, params->support_tag);
+		// trees are only kept in memory to report those not containing an INFO-labeled branch
+		bool keep_trees = false;
+		NodeVector nodes;
+		mytree.getInternalNodes(nodes);
+		for (NodeVector::iterator it = nodes.begin(); it != nodes.end(); it++)
+			if (strncmp((*it)->name.c_str(), "INFO", 4) == 0)
+				keep_trees = true;
+		if (keep_trees) {
+			boot_trees.init(input_trees, rooted, burnin, max_count,
+					tree_weight_file);
+			boot_trees.convertSplits(taxname, sg, hash_ss, SW_COUNT, -1, params->support_tag);
+		} else
+			boot_trees.readSplits(input_trees, rooted, burnin, max_count,
+					tree_weight_file, taxname, sg, hash_ss, SW_COUNT, -1, params->support_tag);
 		scale /= boot_trees.sumTreeWeights();
 	}
 	//sg.report(cout);
@@ -2798,9 +3079,10 @@ void computeConsensusTree(const char *input_trees, int burnin, int max_count,
 		 }*/
 		scale /= sg.maxWeight();
 	} else {
-		boot_trees.init(input_trees, rooted, burnin, max_count,
-				tree_weight_file);
-		boot_trees.convertSplits(sg, cutoff, SW_COUNT, weight_threshold);
+		vector<string> taxname;
+		boot_trees.readSplits(input_trees, rooted, burnin, max_count,
+				tree_weight_file, taxname, sg, hash_ss, SW_COUNT, weight_threshold, NULL);
+		boot_trees.filterSplits(sg, hash_ss, cutoff);
 		scale /= boot_trees.sumTreeWeights();
 		cout << sg.size() << " splits found" << endl;
 	}
@@ -2879,14 +3161,15 @@ void computeConsensusNetwork(const char *input_trees, int burnin, int max_count,
 		const char *out_prefix, const char* tree_weight_file) {
 	bool rooted = false;
 
-	// read the bootstrap tree file
-	MTreeSet boot_trees(input_trees, rooted, burnin, max_count,
-			tree_weight_file);
-
+	// read the bootstrap tree file and convert trees into splits one at a time
+	MTreeSet boot_trees;
 	SplitGraph sg;
-	//SplitIntMap hash_ss;
+	SplitIntMap hash_ss;
+	vector<string> taxname;
 
-	boot_trees.convertSplits(sg, cutoff, weight_summary, weight_threshold);
+	boot_trees.readSplits(input_trees, rooted, burnin, max_count,
+			tree_weight_file, taxname, sg, hash_ss, weight_summary, weight_threshold, NULL);
+	boot_trees.filterSplits(sg, hash_ss, cutoff);
 
 	string out_file;
 
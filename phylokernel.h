@@ -11,6 +11,9 @@
 #include "phylotree.h"
 #include "vectorclass/vectorclass.h"
 #include "vectorclass/vectormath_exp.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 inline Vec2d horizontal_add(Vec2d x[2]) {
 #if  INSTRSET >= 3  // SSE3
@@ -26,6 +29,26 @@ inline double horizontal_max(Vec2d const &a) {
     return max(x[0],x[1]);
 }
 
+/*
+ * load/store VCSIZE partial likelihoods kept as double or float (see PhyloTree::partial_lh_float);
+ * the arithmetic is always done in double precision
+ */
+inline void load_partial_lh(Vec2d &a, double const *p) {
+	a.load_a(p);
+}
+
+inline void load_partial_lh(Vec2d &a, float const *p) {
+	a = extend_low(Vec4f().load_partial(2, p));
+}
+
+inline void store_partial_lh(Vec2d const &a, double *p) {
+	a.store_a(p);
+}
+
+inline void store_partial_lh(Vec2d const &a, float *p) {
+	compress(a, a).store_partial(2, p);
+}
+
 #ifdef __AVX__
 
 inline Vec4d horizontal_add(Vec4d x[4]) {
@@ -50,8 +73,111 @@ inline double horizontal_max(Vec4d const &a) {
     return max(x[0],x[1]);
 }
 
+inline void load_partial_lh(Vec4d &a, double const *p) {
+	a.load_a(p);
+}
+
+inline void load_partial_lh(Vec4d &a, float const *p) {
+	a = _mm256_cvtps_pd(_mm_loadu_ps(p));
+}
+
+inline void store_partial_lh(Vec4d const &a, double *p) {
+	a.store_a(p);
+}
+
+inline void store_partial_lh(Vec4d const &a, float *p) {
+	_mm_storeu_ps(p, _mm256_cvtpd_ps(a));
+}
+
 #endif // __AVX__
 
+#if defined(__AVX512F__) && MAX_VECTOR_SIZE >= 512
+
+inline Vec8d horizontal_add(Vec8d x[8]) {
+	// fold upper into lower 256-bit halves, then reuse the AVX transpose-add
+	Vec4d low[4], high[4];
+	for (int i = 0; i < 4; i++) {
+		low[i] = x[i].get_low() + x[i].get_high();
+		high[i] = x[i+4].get_low() + x[i+4].get_high();
+	}
+	return Vec8d(horizontal_add(low), horizontal_add(high));
+}
+
+inline double horizontal_max(Vec8d const &a) {
+	return horizontal_max(max(a.get_low(), a.get_high()));
+}
+
+inline void load_partial_lh(Vec8d &a, double const *p) {
+	a.load_a(p);
+}
+
+inline void load_partial_lh(Vec8d &a, float const *p) {
+	a = _mm512_cvtps_pd(_mm256_loadu_ps(p));
+}
+
+inline void store_partial_lh(Vec8d const &a, double *p) {
+	a.store_a(p);
+}
+
+inline void store_partial_lh(Vec8d const &a, float *p) {
+	_mm256_storeu_ps(p, _mm512_cvtpd_ps(a));
+}
+
+#endif // __AVX512F__
+
+/** maximal value of the per-pattern scaling counter scale_num */
+#define MAX_SCALE_NUM 32767
+
+/**
+ * add to a per-pattern scaling counter, saturating at MAX_SCALE_NUM. With float partial likelihoods
+ * patterns are scaled far more often; a saturated pattern is still unscaled to (almost) zero,
+ * which is what its likelihood is in double precision anyway
+ */
+inline UBYTE addScaleNum(int scale_num, int nscale) {
+	return min(scale_num + nscale, MAX_SCALE_NUM);
+}
+
+/**
+ * per-pattern scaling of partial likelihoods stored as Numeric.
+ * double: one step of SCALING_THRESHOLD.
+ * float: as many steps of SCALING_THRESHOLD_FLOAT as needed to stay far away from the float underflow.
+ * Patterns with invariant sites are never scaled: once their variable part underflows,
+ * it is negligible compared with ptn_invar.
+ */
+template <class Numeric>
+struct PartialLhScaling {
+	static double threshold() { return SCALING_THRESHOLD; }
+
+	static double logThreshold() { return LOG_SCALING_THRESHOLD; }
+
+	/** @return number of scaling steps needed for a pattern with maximal partial likelihood lh_max */
+	static int getSteps(double lh_max) { return 1; }
+
+	/** @return factor to scale partial likelihoods by for nscale steps */
+	static double getFactor(int nscale) { return SCALING_THRESHOLD_INVER; }
+
+	/** @return factor to undo nscale >= 1 scaling steps of a pattern */
+	static double getUnscaleFactor(int nscale) { return SCALING_THRESHOLD; }
+};
+
+template <>
+struct PartialLhScaling<float> {
+	static double threshold() { return SCALING_THRESHOLD_FLOAT; }
+
+	static double logThreshold() { return LOG_SCALING_THRESHOLD_FLOAT; }
+
+	static int getSteps(double lh_max) {
+		int nscale = 1;
+		for (lh_max *= SCALING_THRESHOLD_FLOAT_INVER; lh_max < SCALING_THRESHOLD_FLOAT && lh_max > 0.0; lh_max *= SCALING_THRESHOLD_FLOAT_INVER)
+			nscale++;
+		return nscale;
+	}
+
+	static double getFactor(int nscale) { return ldexp(1.0, 32*nscale); }
+
+	static double getUnscaleFactor(int nscale) { return ldexp(1.0, -32*nscale); }
+};
+
 template <class Numeric, class VectorClass, const int VCSIZE>
 Numeric PhyloTree::dotProductSIMD(Numeric *x, Numeric *y, int size) {
 	VectorClass res = VectorClass().load_a(x) * VectorClass().load_a(y);
@@ -60,6 +186,93 @@ Numeric PhyloTree::dotProductSIMD(Numeric *x, Numeric *y, int size) {
 	return horizontal_add(res);
 }
 
+template <class Numeric, class VectorClass, const int VCSIZE>
+void PhyloTree::dotProductMultiSIMD(Numeric *x, Numeric *mat, size_t stride, int nrows, int size, Numeric *res) {
+    // rows are processed in tiles with one accumulator per row, patterns in blocks such that
+    // the block of x stays in L1 cache for the whole tile; each accumulator sees the same
+    // sequence of mul_add as in dotProductSIMD, so results are identical
+    const int ROW_TILE = 64;
+    const int PTN_BLOCK = 2048;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (int tile = 0; tile < nrows; tile += ROW_TILE) {
+        int tile_end = min(tile + ROW_TILE, nrows);
+        VectorClass acc[ROW_TILE];
+        int r, i;
+        for (r = 0; r < tile_end-tile; r++)
+            acc[r] = VectorClass(0.0);
+        for (int start = 0; start < size; start += PTN_BLOCK) {
+            int end = min(start + PTN_BLOCK, size);
+            // four rows at a time share the loads of x
+            for (r = tile; r+3 < tile_end; r += 4) {
+                Numeric *y0 = mat + r*stride, *y1 = y0 + stride, *y2 = y1 + stride, *y3 = y2 + stride;
+                VectorClass a0 = acc[r-tile], a1 = acc[r-tile+1], a2 = acc[r-tile+2], a3 = acc[r-tile+3];
+                for (i = start; i < end; i += VCSIZE) {
+                    VectorClass vx = VectorClass().load_a(&x[i]);
+                    a0 = mul_add(vx, VectorClass().load_a(&y0[i]), a0);
+                    a1 = mul_add(vx, VectorClass().load_a(&y1[i]), a1);
+                    a2 = mul_add(vx, VectorClass().load_a(&y2[i]), a2);
+                    a3 = mul_add(vx, VectorClass().load_a(&y3[i]), a3);
+                }
+                acc[r-tile] = a0;
+                acc[r-tile+1] = a1;
+                acc[r-tile+2] = a2;
+                acc[r-tile+3] = a3;
+            }
+            for (; r < tile_end; r++) {
+                Numeric *y = mat + r*stride;
+                VectorClass a = acc[r-tile];
+                for (i = start; i < end; i += VCSIZE)
+                    a = mul_add(VectorClass().load_a(&x[i]), VectorClass().load_a(&y[i]), a);
+                acc[r-tile] = a;
+            }
+        }
+        for (r = tile; r < tile_end; r++)
+            res[r] = horizontal_add(acc[r-tile]);
+    }
+}
+
+template <class Numeric, class VectorClass, const int VCSIZE>
+void PhyloTree::dotProductMatrixSIMD(Numeric *mat1, int nrows1, Numeric *mat2, int nrows2, size_t stride, Numeric *res) {
+    // columns are processed in blocks such that the block of mat2 stays in cache
+    // while it is multiplied with all rows of mat1
+    const size_t COL_BLOCK = 1024;
+    int r1, r2;
+    size_t i;
+    memset(res, 0, sizeof(Numeric)*nrows1*nrows2);
+    for (size_t start = 0; start < stride; start += COL_BLOCK) {
+        size_t end = min(start + COL_BLOCK, stride);
+        for (r1 = 0; r1 < nrows1; r1++) {
+            Numeric *x = mat1 + r1*stride;
+            Numeric *this_res = res + r1*nrows2;
+            // four rows of mat2 at a time share the loads of x
+            for (r2 = 0; r2+3 < nrows2; r2 += 4) {
+                Numeric *y0 = mat2 + r2*stride, *y1 = y0 + stride, *y2 = y1 + stride, *y3 = y2 + stride;
+                VectorClass a0(0.0), a1(0.0), a2(0.0), a3(0.0);
+                for (i = start; i < end; i += VCSIZE) {
+                    VectorClass vx = VectorClass().load_a(&x[i]);
+                    a0 = mul_add(vx, VectorClass().load_a(&y0[i]), a0);
+                    a1 = mul_add(vx, VectorClass().load_a(&y1[i]), a1);
+                    a2 = mul_add(vx, VectorClass().load_a(&y2[i]), a2);
+                    a3 = mul_add(vx, VectorClass().load_a(&y3[i]), a3);
+                }
+                this_res[r2] += horizontal_add(a0);
+                this_res[r2+1] += horizontal_add(a1);
+                this_res[r2+2] += horizontal_add(a2);
+                this_res[r2+3] += horizontal_add(a3);
+            }
+            for (; r2 < nrows2; r2++) {
+                Numeric *y = mat2 + r2*stride;
+                VectorClass a(0.0);
+                for (i = start; i < end; i += VCSIZE)
+                    a = mul_add(VectorClass().load_a(&x[i]), VectorClass().load_a(&y[i]), a);
+                this_res[r2] += horizontal_add(a);
+            }
+        }
+    }
+}
+
 /************************************************************************************************
  *
  *   Highly optimized vectorized versions of likelihood functions
@@ -67,15 +280,9 @@ Numeric PhyloTree::dotProductSIMD(Numeric *x, Numeric *y, int size) {
  *************************************************************************************************/
 
 
-template <class VectorClass, const int VCSIZE, const int nstates>
+template <class Numeric, class VectorClass, const int VCSIZE, const int nstates>
 void PhyloTree::computePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad) {
 
-    if (dad_branch->node->degree() > 3) {
-        // TODO: SIMD version for multifurcating node
-        computePartialLikelihoodEigen(dad_branch, dad);
-        return;
-    }
-
     // don't recompute the likelihood
 	assert(dad);
     if (dad_branch->partial_lh_computed & 1)
@@ -96,6 +303,15 @@ void PhyloTree::computePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, Phy
 		return;
 	}
 
+    if (node->degree() > 3) {
+        // multifurcating node
+        FOR_NEIGHBOR_IT(node, dad, it)
+            if ((((PhyloNeighbor*)*it)->partial_lh_computed & 1) == 0)
+                computePartialLikelihoodEigenSIMD<Numeric, VectorClass, VCSIZE, nstates>((PhyloNeighbor*)*it, node);
+        computeMultifurcatingPartialLikelihoodSIMD<Numeric, VectorClass, VCSIZE, nstates>(dad_branch, dad, 1, site_rate->getNRate());
+        return;
+    }
+
     size_t ptn, c;
     size_t orig_ntn = aln->size();
 
@@ -120,9 +336,9 @@ void PhyloTree::computePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, Phy
 		right = tmp;
 	}
 	if ((left->partial_lh_computed & 1) == 0)
-		computePartialLikelihoodEigenSIMD<VectorClass, VCSIZE, nstates>(left, node);
+		computePartialLikelihoodEigenSIMD<Numeric, VectorClass, VCSIZE, nstates>(left, node);
 	if ((right->partial_lh_computed & 1) == 0)
-		computePartialLikelihoodEigenSIMD<VectorClass, VCSIZE, nstates>(right, node);
+		computePartialLikelihoodEigenSIMD<Numeric, VectorClass, VCSIZE, nstates>(right, node);
 
     if (params->lh_mem_save == LM_PER_NODE && !dad_branch->partial_lh) {
         // re-orient partial_lh
@@ -156,8 +372,13 @@ void PhyloTree::computePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, Phy
 
 	dad_branch->lh_scale_factor = left->lh_scale_factor + right->lh_scale_factor;
 
-	VectorClass *eleft = (VectorClass*)aligned_alloc<double>(block*nstates);
-	VectorClass *eright = (VectorClass*)aligned_alloc<double>(block*nstates);
+	// temporaries live in the kernel buffer: eleft, eright, then the tip vectors and their pointers
+	size_t eigen_size = get_safe_upper_limit(block*nstates);
+	size_t tip_size = get_safe_upper_limit((aln->STATE_UNKNOWN+1)*block);
+	double *buffer = getKernelBuffer(2*eigen_size + 2*tip_size + 2*get_safe_upper_limit(nptn));
+	VectorClass *eleft = (VectorClass*)buffer;
+	VectorClass *eright = (VectorClass*)(buffer + eigen_size);
+	buffer += 2*eigen_size;
 
 	// precompute information buffer
 	for (c = 0; c < ncat; c++) {
@@ -184,8 +405,8 @@ void PhyloTree::computePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, Phy
 		// special treatment for TIP-TIP (cherry) case
 
 		// pre compute information for both tips
-		double *partial_lh_left = aligned_alloc<double>((aln->STATE_UNKNOWN+1)*block);
-		double *partial_lh_right = aligned_alloc<double>((aln->STATE_UNKNOWN+1)*block);
+		double *partial_lh_left = buffer;
+		double *partial_lh_right = buffer + tip_size;
 
 		vector<int>::iterator it;
 		for (it = aln->seq_states[left->node->id].begin(); it != aln->seq_states[left->node->id].end(); it++) {
@@ -232,8 +453,8 @@ void PhyloTree::computePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, Phy
 		}
 
 		// assign pointers for left and right partial_lh
-		double **lh_left_ptr = aligned_alloc<double*>(nptn);
-		double **lh_right_ptr = aligned_alloc<double*>(nptn);
+		double **lh_left_ptr = (double**)(buffer + 2*tip_size);
+		double **lh_right_ptr = (double**)(buffer + 2*tip_size + get_safe_upper_limit(nptn));
 		for (ptn = 0; ptn < orig_ntn; ptn++) {
 			lh_left_ptr[ptn] = &partial_lh_left[block *  (aln->at(ptn))[left->node->id]];
 			lh_right_ptr[ptn] = &partial_lh_right[block * (aln->at(ptn))[right->node->id]];
@@ -252,7 +473,7 @@ void PhyloTree::computePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, Phy
 #pragma omp parallel for private(ptn, c, x, i, j, vc_partial_lh_tmp, res)
 #endif
 		for (ptn = 0; ptn < nptn; ptn++) {
-	        double *partial_lh = dad_branch->partial_lh + ptn*block;
+	        Numeric *partial_lh = (Numeric*)dad_branch->partial_lh + ptn*block;
 
 	        double *lh_left = lh_left_ptr[ptn];
 	        double *lh_right = lh_right_ptr[ptn];
@@ -271,7 +492,7 @@ void PhyloTree::computePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, Phy
 						for (j = 0; j < VCSIZE; j++) {
 							res[j] = mul_add(vc_partial_lh_tmp[x], vc_inv_evec[(i+j)*nstates/VCSIZE+x], res[j]);
 						}
-					horizontal_add(res).store_a(&partial_lh[i]);
+					store_partial_lh(horizontal_add(res), &partial_lh[i]);
 				}
 
 				lh_left += nstates;
@@ -279,18 +500,13 @@ void PhyloTree::computePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, Phy
 				partial_lh += nstates;
 			}
 		}
-
-	    aligned_free(lh_left_ptr);
-	    aligned_free(lh_right_ptr);
-		aligned_free(partial_lh_right);
-		aligned_free(partial_lh_left);
 	} else if (left->node->isLeaf() && !right->node->isLeaf()) {
 		// special treatment to TIP-INTERNAL NODE case
 		// only take scale_num from the right subtree
 		memcpy(dad_branch->scale_num, right->scale_num, nptn * sizeof(UBYTE));
 
 		// pre compute information for left tip
-		double *partial_lh_left = aligned_alloc<double>((aln->STATE_UNKNOWN+1)*block);
+		double *partial_lh_left = buffer;
 
 
 		vector<int>::iterator it;
@@ -317,7 +533,7 @@ void PhyloTree::computePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, Phy
 		}
 
 		// assign pointers for partial_lh_left
-		double **lh_left_ptr = aligned_alloc<double*>(nptn);
+		double **lh_left_ptr = (double**)(buffer + tip_size);
 		for (ptn = 0; ptn < orig_ntn; ptn++) {
 			lh_left_ptr[ptn] = &partial_lh_left[block *  (aln->at(ptn))[left->node->id]];
 		}
@@ -336,15 +552,15 @@ void PhyloTree::computePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, Phy
 #pragma omp parallel for reduction(+: sum_scale) private (ptn, c, x, i, j, vc_lh_right, vc_partial_lh_tmp, res, vc_max, vright)
 #endif
 		for (ptn = 0; ptn < nptn; ptn++) {
-	        double *partial_lh = dad_branch->partial_lh + ptn*block;
-	        double *partial_lh_right = right->partial_lh + ptn*block;
+	        Numeric *partial_lh = (Numeric*)dad_branch->partial_lh + ptn*block;
+	        Numeric *partial_lh_right = (Numeric*)right->partial_lh + ptn*block;
 
 	        double *lh_left = lh_left_ptr[ptn];
 			vc_max = 0.0;
 			for (c = 0; c < ncat; c++) {
 				// compute real partial likelihood vector
 				for (i = 0; i < nstates/VCSIZE; i++)
-					vc_lh_right[i].load_a(&partial_lh_right[i*VCSIZE]);
+					load_partial_lh(vc_lh_right[i], &partial_lh_right[i*VCSIZE]);
 
 				for (x = 0; x < nstates/VCSIZE; x++) {
 					size_t addr = c*nstatesqr/VCSIZE+x*nstates;
@@ -369,7 +585,7 @@ void PhyloTree::computePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, Phy
 						}
 					}
 					VectorClass sum_res = horizontal_add(res);
-					sum_res.store_a(&partial_lh[i]);
+					store_partial_lh(sum_res, &partial_lh[i]);
 					vc_max = max(vc_max, abs(sum_res)); // take the maximum for scaling check
 				}
 				lh_left += nstates;
@@ -378,25 +594,25 @@ void PhyloTree::computePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, Phy
 			}
             // check if one should scale partial likelihoods
 			double lh_max = horizontal_max(vc_max);
-            if (lh_max < SCALING_THRESHOLD && ptn_invar[ptn] == 0.0) {
+            if (lh_max < PartialLhScaling<Numeric>::threshold() && ptn_invar[ptn] == 0.0) {
             	// now do the likelihood scaling
             	partial_lh -= block; // revert its pointer
-            	VectorClass scale_thres(SCALING_THRESHOLD_INVER);
+            	int nscale = PartialLhScaling<Numeric>::getSteps(lh_max);
+            	VectorClass scale_thres(PartialLhScaling<Numeric>::getFactor(nscale));
+            	VectorClass vc_lh;
 				for (i = 0; i < block; i+=VCSIZE) {
-					(VectorClass().load_a(&partial_lh[i]) * scale_thres).store_a(&partial_lh[i]);
+					load_partial_lh(vc_lh, &partial_lh[i]);
+					store_partial_lh(vc_lh * scale_thres, &partial_lh[i]);
 				}
 				// unobserved const pattern will never have underflow
-				sum_scale += LOG_SCALING_THRESHOLD * ptn_freq[ptn];
-				dad_branch->scale_num[ptn] += 1;
+				sum_scale += PartialLhScaling<Numeric>::logThreshold() * nscale * ptn_freq[ptn];
+				dad_branch->scale_num[ptn] = addScaleNum(dad_branch->scale_num[ptn], nscale);
 				partial_lh += block; // increase the pointer again
             }
 
 		}
 		dad_branch->lh_scale_factor += sum_scale;
 
-	    aligned_free(lh_left_ptr);
-		aligned_free(partial_lh_left);
-
 	} else {
 		// both left and right are internal node
 
@@ -411,17 +627,17 @@ void PhyloTree::computePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, Phy
 #pragma omp parallel for reduction (+: sum_scale) private(ptn, c, x, i, j, vc_max, vc_partial_lh_tmp, vc_lh_left, vc_lh_right, res, vleft, vright)
 #endif
 		for (ptn = 0; ptn < nptn; ptn++) {
-	        double *partial_lh = dad_branch->partial_lh + ptn*block;
-			double *partial_lh_left = left->partial_lh + ptn*block;
-			double *partial_lh_right = right->partial_lh + ptn*block;
+	        Numeric *partial_lh = (Numeric*)dad_branch->partial_lh + ptn*block;
+			Numeric *partial_lh_left = (Numeric*)left->partial_lh + ptn*block;
+			Numeric *partial_lh_right = (Numeric*)right->partial_lh + ptn*block;
 
-			dad_branch->scale_num[ptn] = left->scale_num[ptn] + right->scale_num[ptn];
+			dad_branch->scale_num[ptn] = addScaleNum(left->scale_num[ptn], right->scale_num[ptn]);
 			vc_max = 0.0;
 			for (c = 0; c < ncat; c++) {
 				// compute real partial likelihood vector
 				for (i = 0; i < nstates/VCSIZE; i++) {
-					vc_lh_left[i].load_a(&partial_lh_left[i*VCSIZE]);
-					vc_lh_right[i].load_a(&partial_lh_right[i*VCSIZE]);
+					load_partial_lh(vc_lh_left[i], &partial_lh_left[i*VCSIZE]);
+					load_partial_lh(vc_lh_right[i], &partial_lh_right[i*VCSIZE]);
 				}
 
 				for (x = 0; x < nstates/VCSIZE; x++) {
@@ -450,7 +666,7 @@ void PhyloTree::computePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, Phy
 							res[j] = mul_add(vc_partial_lh_tmp[x], vc_inv_evec[(i+j)*nstates/VCSIZE+x], res[j]);
 
 					VectorClass sum_res = horizontal_add(res);
-					sum_res.store_a(&partial_lh[i]);
+					store_partial_lh(sum_res, &partial_lh[i]);
 					vc_max = max(vc_max, abs(sum_res)); // take the maximum for scaling check
 				}
 				partial_lh += nstates;
@@ -460,16 +676,19 @@ void PhyloTree::computePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, Phy
 
             // check if one should scale partial likelihoods
 			double lh_max = horizontal_max(vc_max);
-            if (lh_max < SCALING_THRESHOLD && ptn_invar[ptn] == 0.0) {
+            if (lh_max < PartialLhScaling<Numeric>::threshold() && ptn_invar[ptn] == 0.0) {
 				// now do the likelihood scaling
             	partial_lh -= block; // revert its pointer
-            	VectorClass scale_thres(SCALING_THRESHOLD_INVER);
+            	int nscale = PartialLhScaling<Numeric>::getSteps(lh_max);
+            	VectorClass scale_thres(PartialLhScaling<Numeric>::getFactor(nscale));
+            	VectorClass vc_lh;
 				for (i = 0; i < block; i+=VCSIZE) {
-					(VectorClass().load_a(&partial_lh[i]) * scale_thres).store_a(&partial_lh[i]);
+					load_partial_lh(vc_lh, &partial_lh[i]);
+					store_partial_lh(vc_lh * scale_thres, &partial_lh[i]);
 				}
 				// unobserved const pattern will never have underflow
-				sum_scale += LOG_SCALING_THRESHOLD * ptn_freq[ptn];
-				dad_branch->scale_num[ptn] += 1;
+				sum_scale += PartialLhScaling<Numeric>::logThreshold() * nscale * ptn_freq[ptn];
+				dad_branch->scale_num[ptn] = addScaleNum(dad_branch->scale_num[ptn], nscale);
 				partial_lh += block; // increase the pointer again
             }
 
@@ -477,12 +696,229 @@ void PhyloTree::computePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, Phy
 		dad_branch->lh_scale_factor += sum_scale;
 
 	}
+}
+
+template <class Numeric, class VectorClass, const int VCSIZE, const int nstates>
+void PhyloTree::computeMultifurcatingPartialLikelihoodSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad,
+		size_t nmixture, size_t ncat_mixture) {
+
+    size_t nptn = aln->size() + model_factory->unobserved_ptns.size();
+    size_t orig_ntn = aln->size();
+    PhyloNode *node = (PhyloNode*)(dad_branch->node);
 
-	aligned_free(eright);
-	aligned_free(eleft);
+    size_t ptn, c, i, x, j;
+    size_t ncat = site_rate->getNRate();
+    assert(nstates == aln->num_states && nstates >= VCSIZE && VCSIZE == VectorClass().size());
+    assert(model->isReversible()); // only works with reversible model!
+    const size_t nstatesqr = nstates*nstates;
+    // a block consists of nslot vectors of nstates entries, each with its own (mixture, rate) pair
+    size_t nslot = nmixture * ncat_mixture;
+    size_t block = nslot * nstates;
+
+    if (!tip_partial_lh_computed)
+        computeTipPartialLikelihood();
+
+    if (params->lh_mem_save == LM_PER_NODE && !dad_branch->partial_lh) {
+        // re-orient partial_lh
+        bool done = false;
+        FOR_NEIGHBOR_IT(node, dad, it2) {
+            PhyloNeighbor *backnei = ((PhyloNeighbor*)(*it2)->node->findNeighbor(node));
+            if (backnei->partial_lh) {
+                dad_branch->partial_lh = backnei->partial_lh;
+                dad_branch->scale_num = backnei->scale_num;
+                backnei->partial_lh = NULL;
+                backnei->scale_num = NULL;
+                backnei->partial_lh_computed &= ~1; // clear bit
+                done = true;
+                break;
+            }
+        }
+        assert(done && "partial_lh is not re-oriented");
+    }
+
+	double *evec = model->getEigenvectors();
+	double *inv_evec = model->getInverseEigenvectors();
+	double *eval = model->getEigenvalues();
+	assert(inv_evec && evec);
+
+    size_t nchild = node->degree()-1, nleaf = 0;
+    dad_branch->lh_scale_factor = 0.0;
+	FOR_NEIGHBOR_IT(node, dad, it) {
+		dad_branch->lh_scale_factor += ((PhyloNeighbor*)*it)->lh_scale_factor;
+		if ((*it)->node->isLeaf())
+			nleaf++;
+	}
+
+	// temporaries live in the kernel buffer: inverse eigenvectors, echildren, partial_lh_leaves
+	// and one product vector per thread
+	size_t inv_evec_size = get_safe_upper_limit(nmixture*nstatesqr);
+	size_t echildren_size = get_safe_upper_limit(nchild*block*nstates);
+	size_t leaves_size = get_safe_upper_limit((aln->STATE_UNKNOWN+1)*block*nleaf);
+	size_t all_size = get_safe_upper_limit(block);
+#ifdef _OPENMP
+	size_t nthreads = omp_get_max_threads();
+#else
+	size_t nthreads = 1;
+#endif
+	double *buffer = getKernelBuffer(inv_evec_size + echildren_size + leaves_size + nthreads*all_size);
+
+	VectorClass *vc_inv_evec = (VectorClass*)buffer;
+	for (i = 0; i < nmixture*nstates; i++)
+		for (x = 0; x < nstates/VCSIZE; x++)
+			vc_inv_evec[i*nstates/VCSIZE+x].load_a(&inv_evec[i*nstates+x*VCSIZE]);
+
+    // precompute evec*exp(eval*t) for each child and partial likelihoods for each tip state
+    VectorClass *echildren = (VectorClass*)(buffer + inv_evec_size);
+    double *partial_lh_leaves = (nleaf) ? buffer + inv_evec_size + echildren_size : NULL;
+    VectorClass *echild = echildren;
+    double *partial_lh_leaf = partial_lh_leaves;
+
+	FOR_NEIGHBOR_IT(node, dad, it) {
+		PhyloNeighbor *child = (PhyloNeighbor*)*it;
+		for (c = 0; c < nslot; c++) {
+			size_t m = c / ncat_mixture;
+			VectorClass expchild[nstates/VCSIZE];
+			double len_child = site_rate->getRate(c % ncat) * child->length;
+			for (i = 0; i < nstates/VCSIZE; i++)
+				expchild[i] = exp(VectorClass().load_a(&eval[m*nstates+i*VCSIZE]) * VectorClass(len_child));
+			for (x = 0; x < nstates; x++)
+				for (i = 0; i < nstates/VCSIZE; i++)
+					echild[c*nstatesqr/VCSIZE+x*nstates/VCSIZE+i] =
+						VectorClass().load_a(&evec[m*nstatesqr+x*nstates+i*VCSIZE]) * expchild[i];
+		}
+
+		if (child->node->isLeaf()) {
+			vector<int>::iterator it;
+			for (it = aln->seq_states[child->node->id].begin(); it != aln->seq_states[child->node->id].end(); it++) {
+				int state = (*it);
+				VectorClass vc_tip_lh[nstates/VCSIZE];
+				VectorClass vchild[VCSIZE];
+				for (c = 0; c < nslot; c++) {
+					double *this_tip_lh = &tip_partial_lh[(state*nmixture + c/ncat_mixture)*nstates];
+					for (i = 0; i < nstates/VCSIZE; i++)
+						vc_tip_lh[i].load_a(&this_tip_lh[i*VCSIZE]);
+					for (x = 0; x < nstates; x+=VCSIZE) {
+						size_t addr = (c*nstates+x)*nstates/VCSIZE;
+						for (j = 0; j < VCSIZE; j++)
+							vchild[j] = echild[addr+j*nstates/VCSIZE] * vc_tip_lh[0];
+						for (i = 1; i < nstates/VCSIZE; i++)
+							for (j = 0; j < VCSIZE; j++)
+								vchild[j] = mul_add(echild[addr+j*nstates/VCSIZE+i], vc_tip_lh[i], vchild[j]);
+						horizontal_add(vchild).store_a(&partial_lh_leaf[state*block+c*nstates+x]);
+					}
+				}
+			}
+			size_t addr_unknown = aln->STATE_UNKNOWN * block;
+			for (x = 0; x < block; x++)
+				partial_lh_leaf[addr_unknown+x] = 1.0;
+			partial_lh_leaf += (aln->STATE_UNKNOWN+1)*block;
+		}
+		echild += block*nstates/VCSIZE;
+	}
+
+	double sum_scale = 0.0;
+
+#ifdef _OPENMP
+#pragma omp parallel private(ptn, c, x, i, j) reduction(+: sum_scale)
+#endif
+	{
+	// product of child likelihoods, in real (not eigen) space
+#ifdef _OPENMP
+	VectorClass *partial_lh_all = (VectorClass*)(buffer + inv_evec_size + echildren_size + leaves_size + omp_get_thread_num()*all_size);
+#else
+	VectorClass *partial_lh_all = (VectorClass*)(buffer + inv_evec_size + echildren_size + leaves_size);
+#endif
+	VectorClass vc_lh_child[nstates/VCSIZE];
+	VectorClass vchild[VCSIZE];
+	VectorClass res[VCSIZE];
+
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+	for (ptn = 0; ptn < nptn; ptn++) {
+		for (i = 0; i < block/VCSIZE; i++)
+			partial_lh_all[i] = 1.0;
+		dad_branch->scale_num[ptn] = 0;
+
+		double *partial_lh_leaf = partial_lh_leaves;
+		VectorClass *echild = echildren;
+
+		FOR_NEIGHBOR_IT(node, dad, it) {
+			PhyloNeighbor *child = (PhyloNeighbor*)*it;
+			if (child->node->isLeaf()) {
+				// external node
+				int state_child = (ptn < orig_ntn) ? (aln->at(ptn))[child->node->id] : model_factory->unobserved_ptns[ptn-orig_ntn];
+				double *child_lh = partial_lh_leaf + state_child*block;
+				for (i = 0; i < block/VCSIZE; i++)
+					partial_lh_all[i] *= VectorClass().load_a(&child_lh[i*VCSIZE]);
+				partial_lh_leaf += (aln->STATE_UNKNOWN+1)*block;
+			} else {
+				// internal node
+				Numeric *partial_lh_child = (Numeric*)child->partial_lh + ptn*block;
+				VectorClass *partial_lh = partial_lh_all;
+				VectorClass *echild_ptr = echild;
+				dad_branch->scale_num[ptn] = addScaleNum(dad_branch->scale_num[ptn], child->scale_num[ptn]);
+				for (c = 0; c < nslot; c++) {
+					for (i = 0; i < nstates/VCSIZE; i++)
+						load_partial_lh(vc_lh_child[i], &partial_lh_child[i*VCSIZE]);
+					for (x = 0; x < nstates/VCSIZE; x++) {
+						for (j = 0; j < VCSIZE; j++) {
+							vchild[j] = echild_ptr[0] * vc_lh_child[0];
+							for (i = 1; i < nstates/VCSIZE; i++)
+								vchild[j] = mul_add(echild_ptr[i], vc_lh_child[i], vchild[j]);
+							echild_ptr += nstates/VCSIZE;
+						}
+						partial_lh[x] *= horizontal_add(vchild);
+					}
+					partial_lh += nstates/VCSIZE;
+					partial_lh_child += nstates;
+				}
+			}
+			echild += block*nstates/VCSIZE;
+		}
+
+		// compute dot-product with inv_eigenvector
+		VectorClass vc_max = 0.0; // maximum of partial likelihood, for scaling check
+		Numeric *partial_lh = (Numeric*)dad_branch->partial_lh + ptn*block;
+		VectorClass *partial_lh_tmp = partial_lh_all;
+		for (c = 0; c < nslot; c++) {
+			VectorClass *this_inv_evec = &vc_inv_evec[(c/ncat_mixture)*nstatesqr/VCSIZE];
+			for (i = 0; i < nstates; i+=VCSIZE) {
+				for (j = 0; j < VCSIZE; j++) {
+					res[j] = partial_lh_tmp[0] * this_inv_evec[(i+j)*nstates/VCSIZE];
+					for (x = 1; x < nstates/VCSIZE; x++)
+						res[j] = mul_add(partial_lh_tmp[x], this_inv_evec[(i+j)*nstates/VCSIZE+x], res[j]);
+				}
+				VectorClass sum_res = horizontal_add(res);
+				store_partial_lh(sum_res, &partial_lh[i]);
+				vc_max = max(vc_max, abs(sum_res)); // take the maximum for scaling check
+			}
+			partial_lh += nstates;
+			partial_lh_tmp += nstates/VCSIZE;
+		}
+
+		// check if one should scale partial likelihoods
+		double lh_max = horizontal_max(vc_max);
+		if (lh_max < PartialLhScaling<Numeric>::threshold() && ptn_invar[ptn] == 0.0) {
+			// now do the likelihood scaling
+			partial_lh -= block; // revert its pointer
+			int nscale = PartialLhScaling<Numeric>::getSteps(lh_max);
+			VectorClass scale_thres(PartialLhScaling<Numeric>::getFactor(nscale));
+			VectorClass vc_lh;
+			for (i = 0; i < block; i+=VCSIZE) {
+				load_partial_lh(vc_lh, &partial_lh[i]);
+				store_partial_lh(vc_lh * scale_thres, &partial_lh[i]);
+			}
+			// unobserved const pattern will never have underflow
+			sum_scale += PartialLhScaling<Numeric>::logThreshold() * nscale * ptn_freq[ptn];
+			dad_branch->scale_num[ptn] = addScaleNum(dad_branch->scale_num[ptn], nscale);
+		}
+	} // for ptn
+	}
+	dad_branch->lh_scale_factor += sum_scale;
 }
 
-template <class VectorClass, const int VCSIZE, const int nstates>
+template <class Numeric, class VectorClass, const int VCSIZE, const int nstates>
 void PhyloTree::computeLikelihoodDervEigenSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad, double &df, double &ddf) {
     PhyloNode *node = (PhyloNode*) dad_branch->node;
     PhyloNeighbor *node_branch = (PhyloNeighbor*) node->findNeighbor(dad);
@@ -497,9 +933,9 @@ void PhyloTree::computeLikelihoodDervEigenSIMD(PhyloNeighbor *dad_branch, PhyloN
     	node_branch = tmp_nei;
     }
     if ((dad_branch->partial_lh_computed & 1) == 0)
-        computePartialLikelihoodEigenSIMD<VectorClass, VCSIZE, nstates>(dad_branch, dad);
+        computePartialLikelihoodEigenSIMD<Numeric, VectorClass, VCSIZE, nstates>(dad_branch, dad);
     if ((node_branch->partial_lh_computed & 1) == 0)
-        computePartialLikelihoodEigenSIMD<VectorClass, VCSIZE, nstates>(node_branch, node);
+        computePartialLikelihoodEigenSIMD<Numeric, VectorClass, VCSIZE, nstates>(node_branch, node);
     df = ddf = 0.0;
     size_t ncat = site_rate->getNRate();
 
@@ -513,9 +949,10 @@ void PhyloTree::computeLikelihoodDervEigenSIMD(PhyloNeighbor *dad_branch, PhyloN
     double *eval = model->getEigenvalues();
     assert(eval);
 
-	VectorClass *vc_val0 = (VectorClass*)aligned_alloc<double>(block);
-	VectorClass *vc_val1 = (VectorClass*)aligned_alloc<double>(block);
-	VectorClass *vc_val2 = (VectorClass*)aligned_alloc<double>(block);
+	size_t val_size = get_safe_upper_limit(block);
+	VectorClass *vc_val0 = (VectorClass*)getKernelBuffer(3*val_size);
+	VectorClass *vc_val1 = (VectorClass*)((double*)vc_val0 + val_size);
+	VectorClass *vc_val2 = (VectorClass*)((double*)vc_val0 + 2*val_size);
 
 	VectorClass vc_len = dad_branch->length;
 	for (c = 0; c < ncat; c++) {
@@ -542,33 +979,39 @@ void PhyloTree::computeLikelihoodDervEigenSIMD(PhyloNeighbor *dad_branch, PhyloN
 #pragma omp parallel for private(ptn, i)
 #endif
 			for (ptn = 0; ptn < orig_nptn; ptn++) {
-			    double *partial_lh_dad = dad_branch->partial_lh + ptn*block;
+			    Numeric *partial_lh_dad = (Numeric*)dad_branch->partial_lh + ptn*block;
 				double *theta = theta_all + ptn*block;
 				double *lh_dad = &tip_partial_lh[(aln->at(ptn))[dad->id] * nstates];
 				for (i = 0; i < block; i+=VCSIZE) {
-					(VectorClass().load_a(&lh_dad[i%nstates]) * VectorClass().load_a(&partial_lh_dad[i])).store_a(&theta[i]);
+					VectorClass vc_lh_dad;
+					load_partial_lh(vc_lh_dad, &partial_lh_dad[i]);
+					(VectorClass().load_a(&lh_dad[i%nstates]) * vc_lh_dad).store_a(&theta[i]);
 				}
 			}
 			// ascertainment bias correction
 			for (ptn = orig_nptn; ptn < nptn; ptn++) {
-			    double *partial_lh_dad = dad_branch->partial_lh + ptn*block;
+			    Numeric *partial_lh_dad = (Numeric*)dad_branch->partial_lh + ptn*block;
 				double *theta = theta_all + ptn*block;
 				double *lh_dad = &tip_partial_lh[model_factory->unobserved_ptns[ptn-orig_nptn] * nstates];
 				for (i = 0; i < block; i+=VCSIZE) {
-					(VectorClass().load_a(&lh_dad[i%nstates]) * VectorClass().load_a(&partial_lh_dad[i])).store_a(&theta[i]);
+					VectorClass vc_lh_dad;
+					load_partial_lh(vc_lh_dad, &partial_lh_dad[i]);
+					(VectorClass().load_a(&lh_dad[i%nstates]) * vc_lh_dad).store_a(&theta[i]);
 				}
 			}
 	    } else {
 	    	// both dad and node are internal nodes
-		    double *partial_lh_node = node_branch->partial_lh;
-		    double *partial_lh_dad = dad_branch->partial_lh;
+		    Numeric *partial_lh_node = (Numeric*)node_branch->partial_lh;
+		    Numeric *partial_lh_dad = (Numeric*)dad_branch->partial_lh;
 	    	size_t all_entries = nptn*block;
 #ifdef _OPENMP
 #pragma omp parallel for private(i)
 #endif
 	    	for (i = 0; i < all_entries; i+=VCSIZE) {
-				(VectorClass().load_a(&partial_lh_node[i]) * VectorClass().load_a(&partial_lh_dad[i]))
-						.store_a(&theta_all[i]);
+				VectorClass vc_lh_node, vc_lh_dad;
+				load_partial_lh(vc_lh_node, &partial_lh_node[i]);
+				load_partial_lh(vc_lh_dad, &partial_lh_dad[i]);
+				(vc_lh_node * vc_lh_dad).store_a(&theta_all[i]);
 			}
 	    }
 		if (nptn < maxptn) {
@@ -713,7 +1156,15 @@ void PhyloTree::computeLikelihoodDervEigenSIMD(PhyloNeighbor *dad_branch, PhyloN
 			ddf_const = horizontal_add(ddf_final)+ddf_ptn[0]+ddf_ptn[1]+ddf_ptn[2];
 			break;
 		default:
-			assert(0);
+			// VCSIZE=8 (AVX-512) can leave up to 7 trailing patterns
+			prob_const = horizontal_add(lh_final);
+			df_const = horizontal_add(df_final);
+			ddf_const = horizontal_add(ddf_final);
+			for (j = 0; j < (nptn-orig_nptn)%VCSIZE; j++) {
+				prob_const += lh_ptn[j];
+				df_const += df_ptn[j];
+				ddf_const += ddf_ptn[j];
+			}
 			break;
 		}
     	prob_const = 1.0 - prob_const;
@@ -724,13 +1175,10 @@ void PhyloTree::computeLikelihoodDervEigenSIMD(PhyloNeighbor *dad_branch, PhyloN
     	ddf += nsites *(ddf_frac + df_frac*df_frac);
 	}
     assert(!isnan(df));
-    aligned_free(vc_val2);
-    aligned_free(vc_val1);
-    aligned_free(vc_val0);
 }
 
 
-template <class VectorClass, const int VCSIZE, const int nstates>
+template <class Numeric, class VectorClass, const int VCSIZE, const int nstates>
 double PhyloTree::computeLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad) {
     PhyloNode *node = (PhyloNode*) dad_branch->node;
     PhyloNeighbor *node_branch = (PhyloNeighbor*) node->findNeighbor(dad);
@@ -745,9 +1193,9 @@ double PhyloTree::computeLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_branch, Ph
     	node_branch = tmp_nei;
     }
     if ((dad_branch->partial_lh_computed & 1) == 0)
-        computePartialLikelihoodEigenSIMD<VectorClass, VCSIZE, nstates>(dad_branch, dad);
+        computePartialLikelihoodEigenSIMD<Numeric, VectorClass, VCSIZE, nstates>(dad_branch, dad);
     if ((node_branch->partial_lh_computed & 1) == 0)
-        computePartialLikelihoodEigenSIMD<VectorClass, VCSIZE, nstates>(node_branch, node);
+        computePartialLikelihoodEigenSIMD<Numeric, VectorClass, VCSIZE, nstates>(node_branch, node);
     double tree_lh = node_branch->lh_scale_factor + dad_branch->lh_scale_factor;
     size_t ncat = site_rate->getNRate();
 
@@ -761,7 +1209,10 @@ double PhyloTree::computeLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_branch, Ph
     double *eval = model->getEigenvalues();
     assert(eval);
 
-    VectorClass *vc_val = (VectorClass*)aligned_alloc<double>(block);
+    // vc_val and the tip pointers live in the kernel buffer
+    size_t val_size = get_safe_upper_limit(block);
+    double *buffer = getKernelBuffer(val_size + maxptn);
+    VectorClass *vc_val = (VectorClass*)buffer;
 
 
 	for (c = 0; c < ncat; c++) {
@@ -783,7 +1234,7 @@ double PhyloTree::computeLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_branch, Ph
     	VectorClass lh_final(0.0), vc_freq;
 		VectorClass lh_ptn; // store likelihoods of VCSIZE consecutive patterns
 
-    	double **lh_states_dad = aligned_alloc<double*>(maxptn);
+    	double **lh_states_dad = (double**)(buffer + val_size);
     	for (ptn = 0; ptn < orig_nptn; ptn++)
     		lh_states_dad[ptn] = &tip_partial_lh[(aln->at(ptn))[dad->id] * nstates];
     	for (ptn = orig_nptn; ptn < nptn; ptn++)
@@ -794,7 +1245,7 @@ double PhyloTree::computeLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_branch, Ph
 
 		// copy dummy values because VectorClass will access beyond nptn
 		for (ptn = nptn; ptn < maxptn; ptn++)
-			memcpy(&dad_branch->partial_lh[ptn*block], dad_branch->partial_lh, block*sizeof(double));
+			memcpy((Numeric*)dad_branch->partial_lh + ptn*block, dad_branch->partial_lh, block*sizeof(Numeric));
 
 #ifdef _OPENMP
 #pragma omp parallel private(ptn, i, j, vc_tip_partial_lh, vc_partial_lh_dad, vc_ptn, vc_freq, lh_ptn)
@@ -804,7 +1255,7 @@ double PhyloTree::computeLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_branch, Ph
 #endif
    		// main loop over all patterns with a step size of VCSIZE
 		for (ptn = 0; ptn < orig_nptn; ptn+=VCSIZE) {
-			double *partial_lh_dad = dad_branch->partial_lh + ptn*block;
+			Numeric *partial_lh_dad = (Numeric*)dad_branch->partial_lh + ptn*block;
 
 			// initialize vc_tip_partial_lh
 			for (j = 0; j < VCSIZE; j++) {
@@ -812,14 +1263,14 @@ double PhyloTree::computeLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_branch, Ph
 				for (i = 0; i < nstates/VCSIZE; i++) {
 					vc_tip_partial_lh[j*(nstates/VCSIZE)+i].load_a(&lh_dad[i*VCSIZE]);
 				}
-				vc_partial_lh_dad[j].load_a(&partial_lh_dad[j*block]);
+				load_partial_lh(vc_partial_lh_dad[j], &partial_lh_dad[j*block]);
 				vc_ptn[j] = vc_val[0] * vc_tip_partial_lh[j*(nstates/VCSIZE)] * vc_partial_lh_dad[j];
 			}
 
 			// compute vc_ptn
 			for (i = 1; i < block/VCSIZE; i++)
 				for (j = 0; j < VCSIZE; j++) {
-					vc_partial_lh_dad[j].load_a(&partial_lh_dad[j*block+i*VCSIZE]);
+					load_partial_lh(vc_partial_lh_dad[j], &partial_lh_dad[j*block+i*VCSIZE]);
 					vc_ptn[j] = mul_add(vc_val[i] * vc_tip_partial_lh[j*(nstates/VCSIZE)+i%(nstates/VCSIZE)],
 							vc_partial_lh_dad[j], vc_ptn[j]);
 				}
@@ -870,7 +1321,7 @@ double PhyloTree::computeLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_branch, Ph
 			lh_final = 0.0;
 			lh_ptn = 0.0;
 			for (ptn = orig_nptn; ptn < nptn; ptn+=VCSIZE) {
-				double *partial_lh_dad = &dad_branch->partial_lh[ptn*block];
+				Numeric *partial_lh_dad = (Numeric*)dad_branch->partial_lh + ptn*block;
 				lh_final += lh_ptn;
 
 				// initialize vc_tip_partial_lh
@@ -879,14 +1330,14 @@ double PhyloTree::computeLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_branch, Ph
 					for (i = 0; i < nstates/VCSIZE; i++) {
 						vc_tip_partial_lh[j*(nstates/VCSIZE)+i].load(&lh_dad[i*VCSIZE]); // lh_dad is not aligned!
 					}
-					vc_partial_lh_dad[j].load_a(&partial_lh_dad[j*block]);
+					load_partial_lh(vc_partial_lh_dad[j], &partial_lh_dad[j*block]);
 					vc_ptn[j] = vc_val[0] * vc_tip_partial_lh[j*(nstates/VCSIZE)] * vc_partial_lh_dad[j];
 				}
 
 				// compute vc_ptn
 				for (i = 1; i < block/VCSIZE; i++)
 					for (j = 0; j < VCSIZE; j++) {
-						vc_partial_lh_dad[j].load_a(&partial_lh_dad[j*block+i*VCSIZE]);
+						load_partial_lh(vc_partial_lh_dad[j], &partial_lh_dad[j*block+i*VCSIZE]);
 						vc_ptn[j] = mul_add(vc_val[i] * vc_tip_partial_lh[j*(nstates/VCSIZE)+i%(nstates/VCSIZE)],
 								vc_partial_lh_dad[j], vc_ptn[j]);
 					}
@@ -894,7 +1345,7 @@ double PhyloTree::computeLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_branch, Ph
                 // bugfix 2016-01-21, prob_const can be rescaled
                 for (j = 0; j < VCSIZE; j++)
                     if (dad_branch->scale_num[ptn+j] >= 1)
-                        vc_ptn[j] = vc_ptn[j] * SCALING_THRESHOLD;
+                        vc_ptn[j] = vc_ptn[j] * PartialLhScaling<Numeric>::getUnscaleFactor(dad_branch->scale_num[ptn+j]);
 
 				// ptn_invar[ptn] is not aligned
 				lh_ptn = horizontal_add(vc_ptn) + VectorClass().load(&ptn_invar[ptn]);
@@ -904,10 +1355,13 @@ double PhyloTree::computeLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_branch, Ph
 			case 1: prob_const = horizontal_add(lh_final)+lh_ptn[0]; break;
 			case 2: prob_const = horizontal_add(lh_final)+lh_ptn[0]+lh_ptn[1]; break;
 			case 3: prob_const = horizontal_add(lh_final)+lh_ptn[0]+lh_ptn[1]+lh_ptn[2]; break;
-			default: assert(0); break;
+			default:
+				prob_const = horizontal_add(lh_final);
+				for (j = 0; j < (nptn-orig_nptn)%VCSIZE; j++)
+					prob_const += lh_ptn[j];
+				break;
 			}
 		}
-		aligned_free(lh_states_dad);
     } else {
     	// both dad and node are internal nodes
     	VectorClass vc_partial_lh_node[VCSIZE];
@@ -917,8 +1371,8 @@ double PhyloTree::computeLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_branch, Ph
 
 		// copy dummy values because VectorClass will access beyond nptn
 		for (ptn = nptn; ptn < maxptn; ptn++) {
-			memcpy(&dad_branch->partial_lh[ptn*block], dad_branch->partial_lh, block*sizeof(double));
-			memcpy(&node_branch->partial_lh[ptn*block], node_branch->partial_lh, block*sizeof(double));
+			memcpy((Numeric*)dad_branch->partial_lh + ptn*block, dad_branch->partial_lh, block*sizeof(Numeric));
+			memcpy((Numeric*)node_branch->partial_lh + ptn*block, node_branch->partial_lh, block*sizeof(Numeric));
 		}
 
 #ifdef _OPENMP
@@ -928,16 +1382,16 @@ double PhyloTree::computeLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_branch, Ph
 #pragma omp for nowait
 #endif
 		for (ptn = 0; ptn < orig_nptn; ptn+=VCSIZE) {
-			double *partial_lh_dad = dad_branch->partial_lh + ptn*block;
-			double *partial_lh_node = node_branch->partial_lh + ptn*block;
+			Numeric *partial_lh_dad = (Numeric*)dad_branch->partial_lh + ptn*block;
+			Numeric *partial_lh_node = (Numeric*)node_branch->partial_lh + ptn*block;
 
 			for (j = 0; j < VCSIZE; j++)
 				vc_ptn[j] = 0.0;
 
 			for (i = 0; i < block; i+=VCSIZE) {
 				for (j = 0; j < VCSIZE; j++) {
-					vc_partial_lh_node[j].load_a(&partial_lh_node[i+j*block]);
-					vc_partial_lh_dad[j].load_a(&partial_lh_dad[i+j*block]);
+					load_partial_lh(vc_partial_lh_node[j], &partial_lh_node[i+j*block]);
+					load_partial_lh(vc_partial_lh_dad[j], &partial_lh_dad[i+j*block]);
 					vc_ptn[j] = mul_add(vc_val[i/VCSIZE] * vc_partial_lh_node[j], vc_partial_lh_dad[j], vc_ptn[j]);
 				}
 			}
@@ -969,8 +1423,8 @@ double PhyloTree::computeLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_branch, Ph
 			// ascertainment bias correction
 			lh_final = 0.0;
 			lh_ptn = 0.0;
-			double *partial_lh_node = &node_branch->partial_lh[orig_nptn*block];
-			double *partial_lh_dad = &dad_branch->partial_lh[orig_nptn*block];
+			Numeric *partial_lh_node = (Numeric*)node_branch->partial_lh + orig_nptn*block;
+			Numeric *partial_lh_dad = (Numeric*)dad_branch->partial_lh + orig_nptn*block;
 
 			for (ptn = orig_nptn; ptn < nptn; ptn+=VCSIZE) {
 				lh_final += lh_ptn;
@@ -980,8 +1434,8 @@ double PhyloTree::computeLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_branch, Ph
 
 				for (i = 0; i < block; i+=VCSIZE) {
 					for (j = 0; j < VCSIZE; j++) {
-						vc_partial_lh_node[j].load_a(&partial_lh_node[i+j*block]);
-						vc_partial_lh_dad[j].load_a(&partial_lh_dad[i+j*block]);
+						load_partial_lh(vc_partial_lh_node[j], &partial_lh_node[i+j*block]);
+						load_partial_lh(vc_partial_lh_dad[j], &partial_lh_dad[i+j*block]);
 						vc_ptn[j] = mul_add(vc_val[i/VCSIZE] * vc_partial_lh_node[j], vc_partial_lh_dad[j], vc_ptn[j]);
 					}
 				}
@@ -989,7 +1443,7 @@ double PhyloTree::computeLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_branch, Ph
                 // bugfix 2016-01-21, prob_const can be rescaled
                 for (j = 0; j < VCSIZE; j++)
                     if (dad_branch->scale_num[ptn+j] + node_branch->scale_num[ptn+j] >= 1)
-                        vc_ptn[j] = vc_ptn[j] * SCALING_THRESHOLD;
+                        vc_ptn[j] = vc_ptn[j] * PartialLhScaling<Numeric>::getUnscaleFactor(dad_branch->scale_num[ptn+j] + node_branch->scale_num[ptn+j]);
 
 				// ptn_invar[ptn] is not aligned
 				lh_ptn = horizontal_add(vc_ptn) + VectorClass().load(&ptn_invar[ptn]);
@@ -1001,7 +1455,11 @@ double PhyloTree::computeLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_branch, Ph
 			case 1: prob_const = horizontal_add(lh_final)+lh_ptn[0]; break;
 			case 2: prob_const = horizontal_add(lh_final)+lh_ptn[0]+lh_ptn[1]; break;
 			case 3: prob_const = horizontal_add(lh_final)+lh_ptn[0]+lh_ptn[1]+lh_ptn[2]; break;
-			default: assert(0); break;
+			default:
+				prob_const = horizontal_add(lh_final);
+				for (j = 0; j < (nptn-orig_nptn)%VCSIZE; j++)
+					prob_const += lh_ptn[j];
+				break;
 			}
 		}
     }
@@ -1015,11 +1473,10 @@ double PhyloTree::computeLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_branch, Ph
     	tree_lh -= aln->getNSite()*prob_const;
     }
 
-    aligned_free(vc_val);
     return tree_lh;
 }
 
-template <class VectorClass, const int VCSIZE, const int nstates>
+template <class Numeric, class VectorClass, const int VCSIZE, const int nstates>
 double PhyloTree::computeLikelihoodFromBufferEigenSIMD() {
 
 
@@ -1037,7 +1494,7 @@ double PhyloTree::computeLikelihoodFromBufferEigenSIMD() {
     double *eval = model->getEigenvalues();
     assert(eval);
 
-	VectorClass *vc_val0 = (VectorClass*)aligned_alloc<double>(block);
+	VectorClass *vc_val0 = (VectorClass*)getKernelBuffer(block);
 
 	VectorClass vc_len = current_it->length;
 	for (c = 0; c < ncat; c++) {
@@ -1136,7 +1593,7 @@ double PhyloTree::computeLikelihoodFromBufferEigenSIMD() {
             memcpy(sum_scale_num, current_it->scale_num+orig_nptn, sizeof(UBYTE)*(nptn-orig_nptn));
         else {
             for (ptn = orig_nptn; ptn < nptn; ptn++)
-                sum_scale_num[ptn-orig_nptn] = current_it->scale_num[ptn] + current_it_back->scale_num[ptn];
+                sum_scale_num[ptn-orig_nptn] = addScaleNum(current_it->scale_num[ptn], current_it_back->scale_num[ptn]);
         }
 
         for (ptn = orig_nptn; ptn < nptn; ptn+=VCSIZE) {
@@ -1157,7 +1614,7 @@ double PhyloTree::computeLikelihoodFromBufferEigenSIMD() {
             // bugfix 2016-01-21, prob_const can be rescaled
             for (j = 0; j < VCSIZE; j++)
                 if (sum_scale_num[ptn+j-orig_nptn] >= 1)
-                    vc_ptn[j] = vc_ptn[j] * SCALING_THRESHOLD;
+                    vc_ptn[j] = vc_ptn[j] * PartialLhScaling<Numeric>::getUnscaleFactor(sum_scale_num[ptn+j-orig_nptn]);
 
 			// ptn_invar[ptn] is not aligned
 			lh_ptn = horizontal_add(vc_ptn) + VectorClass().load(&ptn_invar[ptn]);
@@ -1177,7 +1634,9 @@ double PhyloTree::computeLikelihoodFromBufferEigenSIMD() {
 			prob_const = horizontal_add(lh_final)+lh_ptn[0]+lh_ptn[1]+lh_ptn[2];
 			break;
 		default:
-			assert(0);
+			prob_const = horizontal_add(lh_final);
+			for (j = 0; j < (nptn-orig_nptn)%VCSIZE; j++)
+				prob_const += lh_ptn[j];
 			break;
 		}
     	prob_const = log(1.0 - prob_const);
@@ -1186,8 +1645,6 @@ double PhyloTree::computeLikelihoodFromBufferEigenSIMD() {
     		_pattern_lh[ptn] -= prob_const;
 	}
 
-    aligned_free(vc_val0);
-
     return tree_lh;
 }
 
@@ -19,12 +19,6 @@
 
 template <class VectorClass, const int VCSIZE, const int nstates>
 void PhyloTree::computeMixturePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad) {
-    if (dad_branch->node->degree() > 3) {
-        // TODO: SIMD version for multifurcating node
-        computeMixturePartialLikelihoodEigen(dad_branch, dad);
-        return;
-    }
-
     // don't recompute the likelihood
 	assert(dad);
     if (dad_branch->partial_lh_computed & 1)
@@ -43,6 +37,15 @@ void PhyloTree::computeMixturePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_bran
 		return;
 	}
 
+    if (node->degree() > 3) {
+        // multifurcating node
+        FOR_NEIGHBOR_IT(node, dad, it)
+            if ((((PhyloNeighbor*)*it)->partial_lh_computed & 1) == 0)
+                computeMixturePartialLikelihoodEigenSIMD<VectorClass, VCSIZE, nstates>((PhyloNeighbor*)*it, node);
+        computeMultifurcatingPartialLikelihoodSIMD<double, VectorClass, VCSIZE, nstates>(dad_branch, dad, model->getNMixtures(), site_rate->getNRate());
+        return;
+    }
+
     size_t ptn, c;
     size_t orig_ntn = aln->size();
 
@@ -94,7 +97,12 @@ void PhyloTree::computeMixturePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_bran
 	double *evec = model->getEigenvectors();
 	double *inv_evec = model->getInverseEigenvectors();
 
-	VectorClass *vc_inv_evec = aligned_alloc<VectorClass>(nmixture*nstatesqr/VCSIZE);
+	// temporaries live in the kernel buffer: vc_inv_evec, eleft, eright, then the tip vectors and their pointers
+	size_t inv_evec_size = get_safe_upper_limit(nmixture*nstatesqr);
+	size_t eigen_size = get_safe_upper_limit(block*nstates);
+	size_t tip_size = get_safe_upper_limit((aln->STATE_UNKNOWN+1)*block);
+	double *buffer = getKernelBuffer(inv_evec_size + 2*eigen_size + 2*tip_size + 2*get_safe_upper_limit(nptn));
+	VectorClass *vc_inv_evec = (VectorClass*)buffer;
 	assert(inv_evec && evec);
 	for (m = 0; m < nmixture; m++) {
 		for (i = 0; i < nstates; i++) {
@@ -107,8 +115,9 @@ void PhyloTree::computeMixturePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_bran
 
 	dad_branch->lh_scale_factor = left->lh_scale_factor + right->lh_scale_factor;
 
-	VectorClass *eleft = (VectorClass*)aligned_alloc<double>(block*nstates);
-	VectorClass *eright = (VectorClass*)aligned_alloc<double>(block*nstates);
+	VectorClass *eleft = (VectorClass*)(buffer + inv_evec_size);
+	VectorClass *eright = (VectorClass*)(buffer + inv_evec_size + eigen_size);
+	buffer += inv_evec_size + 2*eigen_size;
 
 	// precompute information buffer
 	for (c = 0; c < ncat; c++) {
@@ -138,8 +147,8 @@ void PhyloTree::computeMixturePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_bran
 		// special treatment for TIP-TIP (cherry) case
 
 		// pre compute information for both tips
-		double *partial_lh_left = aligned_alloc<double>((aln->STATE_UNKNOWN+1)*block);
-		double *partial_lh_right = aligned_alloc<double>((aln->STATE_UNKNOWN+1)*block);
+		double *partial_lh_left = buffer;
+		double *partial_lh_right = buffer + tip_size;
 
 		vector<int>::iterator it;
 		for (it = aln->seq_states[left->node->id].begin(); it != aln->seq_states[left->node->id].end(); it++) {
@@ -198,8 +207,8 @@ void PhyloTree::computeMixturePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_bran
 		}
 
 		// assign pointers for left and right partial_lh
-		double **lh_left_ptr = aligned_alloc<double*>(nptn);
-		double **lh_right_ptr = aligned_alloc<double*>(nptn);
+		double **lh_left_ptr = (double**)(buffer + 2*tip_size);
+		double **lh_right_ptr = (double**)(buffer + 2*tip_size + get_safe_upper_limit(nptn));
 		for (ptn = 0; ptn < orig_ntn; ptn++) {
 			lh_left_ptr[ptn] = &partial_lh_left[block *  (aln->at(ptn))[left->node->id]];
 			lh_right_ptr[ptn] = &partial_lh_right[block * (aln->at(ptn))[right->node->id]];
@@ -246,18 +255,13 @@ void PhyloTree::computeMixturePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_bran
 			}
 	        }
 		}
-
-	    aligned_free(lh_left_ptr);
-	    aligned_free(lh_right_ptr);
-		aligned_free(partial_lh_right);
-		aligned_free(partial_lh_left);
 	} else if (left->node->isLeaf() && !right->node->isLeaf()) {
 		// special treatment to TIP-INTERNAL NODE case
 		// only take scale_num from the right subtree
 		memcpy(dad_branch->scale_num, right->scale_num, nptn * sizeof(UBYTE));
 
 		// pre compute information for left tip
-		double *partial_lh_left = aligned_alloc<double>((aln->STATE_UNKNOWN+1)*block);
+		double *partial_lh_left = buffer;
 
 
 		vector<int>::iterator it;
@@ -291,7 +295,7 @@ void PhyloTree::computeMixturePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_bran
 		}
 
 		// assign pointers for partial_lh_left
-		double **lh_left_ptr = aligned_alloc<double*>(nptn);
+		double **lh_left_ptr = (double**)(buffer + tip_size);
 		for (ptn = 0; ptn < orig_ntn; ptn++) {
 			lh_left_ptr[ptn] = &partial_lh_left[block *  (aln->at(ptn))[left->node->id]];
 		}
@@ -369,9 +373,6 @@ void PhyloTree::computeMixturePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_bran
 		}
 		dad_branch->lh_scale_factor += sum_scale;
 
-	    aligned_free(lh_left_ptr);
-		aligned_free(partial_lh_left);
-
 	} else {
 		// both left and right are internal node
 
@@ -453,10 +454,6 @@ void PhyloTree::computeMixturePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_bran
 		dad_branch->lh_scale_factor += sum_scale;
 
 	}
-
-	aligned_free(eright);
-	aligned_free(eleft);
-	aligned_free(vc_inv_evec);
 }
 
 template <class VectorClass, const int VCSIZE, const int nstates>
@@ -494,9 +491,10 @@ void PhyloTree::computeMixtureLikelihoodDervEigenSIMD(PhyloNeighbor *dad_branch,
     double *eval = model->getEigenvalues();
     assert(eval);
 
-	VectorClass *vc_val0 = (VectorClass*)aligned_alloc<double>(block);
-	VectorClass *vc_val1 = (VectorClass*)aligned_alloc<double>(block);
-	VectorClass *vc_val2 = (VectorClass*)aligned_alloc<double>(block);
+	size_t val_size = get_safe_upper_limit(block);
+	VectorClass *vc_val0 = (VectorClass*)getKernelBuffer(3*val_size);
+	VectorClass *vc_val1 = (VectorClass*)((double*)vc_val0 + val_size);
+	VectorClass *vc_val2 = (VectorClass*)((double*)vc_val0 + 2*val_size);
 
 	VectorClass vc_len = dad_branch->length;
 	for (c = 0; c < ncat; c++) {
@@ -707,7 +705,14 @@ void PhyloTree::computeMixtureLikelihoodDervEigenSIMD(PhyloNeighbor *dad_branch,
 			ddf_const = horizontal_add(ddf_final)+ddf_ptn[0]+ddf_ptn[1]+ddf_ptn[2];
 			break;
 		default:
-			assert(0);
+			prob_const = horizontal_add(lh_final);
+			df_const = horizontal_add(df_final);
+			ddf_const = horizontal_add(ddf_final);
+			for (j = 0; j < (nptn-orig_nptn)%VCSIZE; j++) {
+				prob_const += lh_ptn[j];
+				df_const += df_ptn[j];
+				ddf_const += ddf_ptn[j];
+			}
 			break;
 		}
     	prob_const = 1.0 - prob_const;
@@ -717,10 +722,6 @@ void PhyloTree::computeMixtureLikelihoodDervEigenSIMD(PhyloNeighbor *dad_branch,
     	df += nsites * df_frac;
     	ddf += nsites *(ddf_frac + df_frac*df_frac);
 	}
-
-    aligned_free(vc_val2);
-    aligned_free(vc_val1);
-    aligned_free(vc_val0);
 }
 
 
@@ -757,7 +758,11 @@ double PhyloTree::computeMixtureLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_bra
     double *eval = model->getEigenvalues();
     assert(eval);
 
-    VectorClass *vc_val = (VectorClass*)aligned_alloc<double>(block);
+    // vc_val, the tip vectors of dad and the tip states live in the kernel buffer
+    size_t val_size = get_safe_upper_limit(block);
+    size_t tip_size = get_safe_upper_limit((aln->STATE_UNKNOWN+1)*block);
+    double *buffer = getKernelBuffer(val_size + tip_size + maxptn);
+    VectorClass *vc_val = (VectorClass*)buffer;
 
 	for (c = 0; c < ncat; c++) {
 		double len = site_rate->getRate(c)*dad_branch->length;
@@ -775,7 +780,7 @@ double PhyloTree::computeMixtureLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_bra
 
 	if (dad->isLeaf()) {
     	// special treatment for TIP-INTERNAL NODE case
-    	double *partial_lh_node = aligned_alloc<double>((aln->STATE_UNKNOWN+1)*block);
+    	double *partial_lh_node = buffer + val_size;
     	IntVector states_dad = aln->seq_states[dad->id];
     	states_dad.push_back(aln->STATE_UNKNOWN);
     	for (IntVector::iterator it = states_dad.begin(); it != states_dad.end(); it++) {
@@ -808,7 +813,7 @@ double PhyloTree::computeMixtureLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_bra
 //    	for (ptn = nptn; ptn < maxptn; ptn++)
 //    		lh_states_dad[ptn] = &tip_partial_lh[aln->STATE_UNKNOWN * nstates];
 
-		int *ptn_states_dad = aligned_alloc<int>(maxptn);
+		int *ptn_states_dad = (int*)(buffer + val_size + tip_size);
 		for (ptn = 0; ptn < orig_nptn; ptn++)
 			ptn_states_dad[ptn] = (aln->at(ptn))[dad->id];
 		for (ptn = orig_nptn; ptn < nptn; ptn++)
@@ -937,11 +942,13 @@ double PhyloTree::computeMixtureLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_bra
 			case 1: prob_const = horizontal_add(lh_final)+lh_ptn[0]; break;
 			case 2: prob_const = horizontal_add(lh_final)+lh_ptn[0]+lh_ptn[1]; break;
 			case 3: prob_const = horizontal_add(lh_final)+lh_ptn[0]+lh_ptn[1]+lh_ptn[2]; break;
-			default: assert(0); break;
+			default:
+				prob_const = horizontal_add(lh_final);
+				for (j = 0; j < (nptn-orig_nptn)%VCSIZE; j++)
+					prob_const += lh_ptn[j];
+				break;
 			}
 		}
-		aligned_free(ptn_states_dad);
-		aligned_free(partial_lh_node);
     } else {
     	// both dad and node are internal nodes
     	VectorClass vc_partial_lh_node[VCSIZE];
@@ -1035,7 +1042,11 @@ double PhyloTree::computeMixtureLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_bra
 			case 1: prob_const = horizontal_add(lh_final)+lh_ptn[0]; break;
 			case 2: prob_const = horizontal_add(lh_final)+lh_ptn[0]+lh_ptn[1]; break;
 			case 3: prob_const = horizontal_add(lh_final)+lh_ptn[0]+lh_ptn[1]+lh_ptn[2]; break;
-			default: assert(0); break;
+			default:
+				prob_const = horizontal_add(lh_final);
+				for (j = 0; j < (nptn-orig_nptn)%VCSIZE; j++)
+					prob_const += lh_ptn[j];
+				break;
 			}
 		}
     }
@@ -1048,7 +1059,6 @@ double PhyloTree::computeMixtureLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_bra
     	tree_lh -= aln->getNSite()*prob_const;
     }
 
-    aligned_free(vc_val);
     return tree_lh;
 }
 
@@ -1071,7 +1081,7 @@ double PhyloTree::computeMixtureLikelihoodFromBufferEigenSIMD() {
     double *eval = model->getEigenvalues();
     assert(eval);
 
-	VectorClass *vc_val0 = (VectorClass*)aligned_alloc<double>(block);
+	VectorClass *vc_val0 = (VectorClass*)getKernelBuffer(block);
 
 	VectorClass vc_len = current_it->length;
 	for (c = 0; c < ncat; c++) {
@@ -1213,7 +1223,9 @@ double PhyloTree::computeMixtureLikelihoodFromBufferEigenSIMD() {
 			prob_const = horizontal_add(lh_final)+lh_ptn[0]+lh_ptn[1]+lh_ptn[2];
 			break;
 		default:
-			assert(0);
+			prob_const = horizontal_add(lh_final);
+			for (j = 0; j < (nptn-orig_nptn)%VCSIZE; j++)
+				prob_const += lh_ptn[j];
 			break;
 		}
     	prob_const = log(1.0 - prob_const);
@@ -1222,8 +1234,6 @@ double PhyloTree::computeMixtureLikelihoodFromBufferEigenSIMD() {
     		_pattern_lh[ptn] -= prob_const;
 	}
 
-    aligned_free(vc_val0);
-
     return tree_lh;
 }
 
@@ -84,9 +84,106 @@ void PhyloTree::computeSitemodelPartialLikelihoodEigenSIMD(PhyloNeighbor *dad_br
 		right = tmp;
 	}
     
-    assert(node->degree() == 3); // does not work with multifurcating tree yet
-    
-    if (left->node->isLeaf() && right->node->isLeaf()) {
+    if (node->degree() > 3) {
+
+        /*--------------------- multifurcating node ------------------*/
+
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+: sum_scale) private(ptn, c, x, i, j) schedule(static)
+#endif
+		for (ptn = 0; ptn < nptn; ptn++) {
+			VectorClass partial_lh_tmp[nstates/VCSIZE];
+			VectorClass *partial_lh = (VectorClass*)(dad_branch->partial_lh + ptn*block);
+            VectorClass lh_max = 0.0;
+
+            VectorClass expchild[nstates/VCSIZE];
+            VectorClass *eval = (VectorClass*)(models->at(ptn)->getEigenvalues());
+            VectorClass *evec = (VectorClass*)(models->at(ptn)->getEigenvectors());
+            VectorClass *inv_evec = (VectorClass*)(models->at(ptn)->getInverseEigenvectors());
+            VectorClass vchild[VCSIZE];
+            VectorClass res[VCSIZE];
+            VectorClass len_child;
+            VectorClass *this_evec;
+
+			dad_branch->scale_num[ptn] = 0;
+            FOR_NEIGHBOR_IT(node, dad, it)
+                if (!(*it)->node->isLeaf())
+                    dad_branch->scale_num[ptn] += ((PhyloNeighbor*)*it)->scale_num[ptn];
+
+			for (c = 0; c < ncat; c++) {
+				for (x = 0; x < nstates/VCSIZE; x++)
+					partial_lh_tmp[x] = 1.0;
+
+				// compute real partial likelihood vector as product over all children
+                FOR_NEIGHBOR_IT(node, dad, it) {
+                    PhyloNeighbor *child = (PhyloNeighbor*)*it;
+                    VectorClass *partial_lh_child;
+                    if (child->node->isLeaf())
+                        partial_lh_child = (VectorClass*)(tip_partial_lh + child->node->id*tip_block_size + ptn*nstates);
+                    else
+                        partial_lh_child = (VectorClass*)(child->partial_lh + ptn*block + c*nstates);
+                    len_child = site_rate->getRate(c) * child->length;
+                    for (i = 0; i < nstates/VCSIZE; i++)
+                        expchild[i] = exp(eval[i]*len_child) * partial_lh_child[i];
+                    this_evec = evec;
+                    for (x = 0; x < nstates/VCSIZE; x++) {
+                        for (j = 0; j < VCSIZE; j++) {
+                            vchild[j] = 0.0;
+                            for (i = 0; i < nstates/VCSIZE; i++)
+                                vchild[j] = mul_add(this_evec[i], expchild[i], vchild[j]);
+                            this_evec += nstates/VCSIZE;
+                        }
+                        partial_lh_tmp[x] *= horizontal_add(vchild);
+                    }
+                }
+
+				// compute dot-product with inv_eigenvector
+                this_evec = inv_evec;
+				for (i = 0; i < nstates/VCSIZE; i++) {
+                    for (j = 0; j < VCSIZE; j++) {
+                        res[j] = 0.0;
+                        for (x = 0; x < nstates/VCSIZE; x++) {
+                            res[j] = mul_add(partial_lh_tmp[x], this_evec[x], res[j]);
+                        }
+                        this_evec += nstates/VCSIZE;
+                    }
+                    lh_max = max(lh_max, abs(partial_lh[i] = horizontal_add(res)));
+				}
+
+                partial_lh += nstates/VCSIZE;
+			}
+
+            // check if one should scale partial likelihoods
+            double dmax = horizontal_max(lh_max);
+            if (dmax < SCALING_THRESHOLD) {
+                partial_lh = (VectorClass*)(dad_branch->partial_lh + ptn*block);
+            	if (dmax == 0.0) {
+            		// for very shitty data
+            		for (c = 0; c < ncat; c++)
+            			memcpy(&partial_lh[c*nstates/VCSIZE], &tip_partial_lh[ptn*nstates], nstates*sizeof(double));
+					sum_scale += LOG_SCALING_THRESHOLD* 4 * ptn_freq[ptn];
+					dad_branch->scale_num[ptn] += 4;
+					int nsite = aln->getNSite();
+					for (i = 0, x = 0; i < nsite && x < ptn_freq[ptn]; i++)
+						if (aln->getPatternID(i) == ptn) {
+							outWarning((string)"Numerical underflow for site " + convertIntToString(i+1));
+							x++;
+						}
+            	} else {
+					// now do the likelihood scaling
+					for (i = 0; i < block/VCSIZE; i++) {
+						partial_lh[i] *= SCALING_THRESHOLD_INVER;
+					}
+					sum_scale += LOG_SCALING_THRESHOLD * ptn_freq[ptn];
+					dad_branch->scale_num[ptn] += 1;
+            	}
+            }
+
+		}
+		dad_branch->lh_scale_factor += sum_scale;
+
+        // end multifurcating treatment
+    } else if (left->node->isLeaf() && right->node->isLeaf()) {
 
         /*--------------------- TIP-TIP (cherry) case ------------------*/
 
@@ -557,8 +654,8 @@ double PhyloTree::computeSitemodelLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_b
 
     ModelSet *models = (ModelSet*)model;
     VectorClass tree_lh = 0.0;
-    VectorClass *cat_length = aligned_alloc<VectorClass>(ncat);
-    VectorClass *cat_prop = aligned_alloc<VectorClass>(ncat);
+    VectorClass *cat_length = (VectorClass*)getKernelBuffer(2*ncat*VCSIZE);
+    VectorClass *cat_prop = cat_length + ncat;
     for (c = 0; c < ncat; c++) {
         cat_length[c] = site_rate->getRate(c) * dad_branch->length;
         cat_prop[c] = site_rate->getProp(c);
@@ -712,8 +809,6 @@ double PhyloTree::computeSitemodelLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_b
 
 	assert(!isnan(tree_lh_final) && !isinf(tree_lh_final));
     
-    aligned_free(cat_prop);
-    aligned_free(cat_length);
 
     return tree_lh_final;
 }
@@ -734,8 +829,8 @@ double PhyloTree::computeSitemodelLikelihoodFromBufferEigenSIMD() {
     ModelSet *models = (ModelSet*)model;
     
     VectorClass tree_lh = 0.0;
-    VectorClass *cat_length = aligned_alloc<VectorClass>(ncat);
-    VectorClass *cat_prop = aligned_alloc<VectorClass>(ncat);
+    VectorClass *cat_length = (VectorClass*)getKernelBuffer(2*ncat*VCSIZE);
+    VectorClass *cat_prop = cat_length + ncat;
     for (c = 0; c < ncat; c++) {
         cat_length[c] = site_rate->getRate(c) * current_it->length;
         cat_prop[c] = site_rate->getProp(c);
@@ -791,8 +886,6 @@ double PhyloTree::computeSitemodelLikelihoodFromBufferEigenSIMD() {
 
     double tree_lh_final = horizontal_add(tree_lh) + current_it->lh_scale_factor + current_it_back->lh_scale_factor;
     
-    aligned_free(cat_prop);
-    aligned_free(cat_length);
     
     return tree_lh_final;
 }
@@ -28,12 +28,14 @@ PhyloSuperTree::PhyloSuperTree()
  : IQTree()
 {
 	totalNNIs = evalNNIs = 0;
+    num_big_parts = 0;
     rescale_codon_brlen = false;
 	// Initialize the counter for evaluated NNIs on subtrees. FOR THIS CASE IT WON'T BE initialized.
 }
 
 PhyloSuperTree::PhyloSuperTree(SuperAlignment *alignment, PhyloSuperTree *super_tree) :  IQTree(alignment) {
 	totalNNIs = evalNNIs = 0;
+    num_big_parts = 0;
     rescale_codon_brlen = super_tree->rescale_codon_brlen;
 	part_info = super_tree->part_info;
 	for (vector<Alignment*>::iterator it = alignment->partitions.begin(); it != alignment->partitions.end(); it++) {
@@ -506,6 +508,7 @@ void PhyloSuperTree::printBestPartitionRaxml(const char *filename) {
 
 PhyloSuperTree::PhyloSuperTree(Params &params) :  IQTree() {
 	totalNNIs = evalNNIs = 0;
+    num_big_parts = 0;
 
 	cout << "Reading partition model file " << params.partition_file << " ..." << endl;
 	if (detectInputFile(params.partition_file) == IN_NEXUS) {
@@ -919,6 +922,12 @@ void PhyloSuperTree::computePartitionOrder() {
     int i, ntrees = size();
     part_order.resize(ntrees);
     part_order_by_nptn.resize(ntrees);
+    part_ptn_offset.resize(ntrees);
+    size_t offset = 0;
+    for (i = 0; i < ntrees; i++) {
+        part_ptn_offset[i] = offset;
+        offset += at(i)->getAlnNPattern();
+    }
 #ifdef _OPENMP
     int *id = new int[ntrees];
     double *cost = new double[ntrees];
@@ -931,6 +940,18 @@ void PhyloSuperTree::computePartitionOrder() {
     quicksort(cost, 0, ntrees-1, id);
     for (i = 0; i < ntrees; i++) 
         part_order[i] = id[i];
+
+    // partitions costing more than 1/num_threads of the total are computed with all threads
+    // over their patterns, the remaining ones share the threads partition-wise (costs are negative)
+    double total_cost = 0.0;
+    for (i = 0; i < ntrees; i++)
+        total_cost += cost[i];
+    num_big_parts = 0;
+    if (params->num_threads > 1)
+        while (num_big_parts < ntrees && cost[num_big_parts] * params->num_threads < total_cost) {
+            total_cost -= cost[num_big_parts];
+            num_big_parts++;
+        }
         
     // compute part_order by number of patterns
     for (i = 0; i < ntrees; i++) {
@@ -955,21 +976,33 @@ void PhyloSuperTree::computePartitionOrder() {
 double PhyloSuperTree::computeLikelihood(double *pattern_lh) {
 	double tree_lh = 0.0;
 	int ntrees = size();
+    if (part_order.empty()) computePartitionOrder();
 	if (pattern_lh) {
-		//#ifdef _OPENMP
-		//#pragma omp parallel for reduction(+: tree_lh)
-		//#endif
-		for (int i = 0; i < ntrees; i++) {
-			part_info[i].cur_score = at(i)->computeLikelihood(pattern_lh);
+		// big partitions parallelize over their patterns
+		for (int j = 0; j < num_big_parts; j++) {
+            int i = part_order[j];
+			part_info[i].cur_score = at(i)->computeLikelihood(pattern_lh + part_ptn_offset[i]);
+			tree_lh += part_info[i].cur_score;
+		}
+		// each partition writes into its own slice of pattern_lh
+		#ifdef _OPENMP
+		#pragma omp parallel for reduction(+: tree_lh) schedule(dynamic) if(ntrees-num_big_parts > 1)
+		#endif
+		for (int j = num_big_parts; j < ntrees; j++) {
+            int i = part_order[j];
+			part_info[i].cur_score = at(i)->computeLikelihood(pattern_lh + part_ptn_offset[i]);
 			tree_lh += part_info[i].cur_score;
-			pattern_lh += at(i)->getAlnNPattern();
 		}
 	} else {
-        if (part_order.empty()) computePartitionOrder();
+		for (int j = 0; j < num_big_parts; j++) {
+            int i = part_order[j];
+			part_info[i].cur_score = at(i)->computeLikelihood();
+			tree_lh += part_info[i].cur_score;
+		}
 		#ifdef _OPENMP
-		#pragma omp parallel for reduction(+: tree_lh) schedule(dynamic) if(ntrees >= params->num_threads)
+		#pragma omp parallel for reduction(+: tree_lh) schedule(dynamic) if(ntrees-num_big_parts > 1)
 		#endif
-		for (int j = 0; j < ntrees; j++) {
+		for (int j = num_big_parts; j < ntrees; j++) {
             int i = part_order[j];
 			part_info[i].cur_score = at(i)->computeLikelihood();
 			tree_lh += part_info[i].cur_score;
@@ -979,18 +1012,38 @@ double PhyloSuperTree::computeLikelihood(double *pattern_lh) {
 }
 
 void PhyloSuperTree::computePatternLikelihood(double *pattern_lh, double *cur_logl, double *ptn_lh_cat, SiteLoglType wsl) {
-	int offset = 0, offset_lh_cat = 0;
+	int offset = 0, ntrees = size();
 	iterator it;
-	for (it = begin(); it != end(); it++) {
+    if (part_order.empty()) computePartitionOrder();
+    // offsets into ptn_lh_cat depend on the current number of categories
+    vector<size_t> offset_lh_cat;
+    if (ptn_lh_cat) {
+        offset_lh_cat.resize(ntrees);
+        size_t offset_cat = 0;
+        for (int i = 0; i < ntrees; i++) {
+            offset_lh_cat[i] = offset_cat;
+            if (at(i)->getModel()->isMixture() && !at(i)->getModelFactory()->fused_mix_rate)
+                offset_cat += at(i)->aln->getNPattern() * at(i)->site_rate->getNDiscreteRate() * at(i)->model->getNMixtures();
+            else
+                offset_cat += at(i)->aln->getNPattern() * at(i)->site_rate->getNDiscreteRate();
+        }
+    }
+	for (int j = 0; j < num_big_parts; j++) {
+        int i = part_order[j];
+		if (ptn_lh_cat)
+			at(i)->computePatternLikelihood(pattern_lh + part_ptn_offset[i], NULL, ptn_lh_cat + offset_lh_cat[i], wsl);
+		else
+			at(i)->computePatternLikelihood(pattern_lh + part_ptn_offset[i]);
+	}
+	#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic) if(ntrees-num_big_parts > 1)
+	#endif
+	for (int j = num_big_parts; j < ntrees; j++) {
+        int i = part_order[j];
 		if (ptn_lh_cat)
-			(*it)->computePatternLikelihood(pattern_lh + offset, NULL, ptn_lh_cat + offset_lh_cat, wsl);
+			at(i)->computePatternLikelihood(pattern_lh + part_ptn_offset[i], NULL, ptn_lh_cat + offset_lh_cat[i], wsl);
 		else
-			(*it)->computePatternLikelihood(pattern_lh + offset);
-		offset += (*it)->aln->getNPattern();
-        if ((*it)->getModel()->isMixture() && !(*it)->getModelFactory()->fused_mix_rate)
-            offset_lh_cat += (*it)->aln->getNPattern() * (*it)->site_rate->getNDiscreteRate() * (*it)->model->getNMixtures();
-        else
-            offset_lh_cat += (*it)->aln->getNPattern() * (*it)->site_rate->getNDiscreteRate();
+			at(i)->computePatternLikelihood(pattern_lh + part_ptn_offset[i]);
 	}
 	if (cur_logl) { // sanity check
 		double sum_logl = 0;
@@ -1013,10 +1066,17 @@ double PhyloSuperTree::optimizeAllBranches(int my_iterations, double tolerance,
 	double tree_lh = 0.0;
 	int ntrees = size();
     if (part_order.empty()) computePartitionOrder();
+	for (int j = 0; j < num_big_parts; j++) {
+        int i = part_order[j];
+		part_info[i].cur_score = at(i)->optimizeAllBranches(my_iterations, tolerance/min(ntrees,10), maxNRStep);
+		tree_lh += part_info[i].cur_score;
+		if (verbose_mode >= VB_MAX)
+			at(i)->printTree(cout, WT_BR_LEN + WT_NEWLINE);
+	}
 	#ifdef _OPENMP
-	#pragma omp parallel for reduction(+: tree_lh) schedule(dynamic) if(ntrees >= params->num_threads)
+	#pragma omp parallel for reduction(+: tree_lh) schedule(dynamic) if(ntrees-num_big_parts > 1)
 	#endif
-	for (int j = 0; j < ntrees; j++) {
+	for (int j = num_big_parts; j < ntrees; j++) {
         int i = part_order[j];
 		part_info[i].cur_score = at(i)->optimizeAllBranches(my_iterations, tolerance/min(ntrees,10), maxNRStep);
 		tree_lh += part_info[i].cur_score;
@@ -291,6 +291,13 @@ public:
     IntVector part_order;
     IntVector part_order_by_nptn;
 
+    /* offset of each partition into the concatenated pattern likelihood vector */
+    vector<size_t> part_ptn_offset;
+
+    /* number of leading partitions in part_order that are too costly to share a thread:
+       they are computed one after another, each using all threads over its patterns */
+    int num_big_parts;
+
     /* compute part_order vector */
     void computePartitionOrder();
 
@@ -400,6 +400,9 @@ bool checkModelFile(ifstream &in, bool is_partitioned, vector<ModelInfo> &infos)
 		info.name = str;
 		in >> info.df >> info.logl >> info.tree_len;
 		getline(in, str);
+        // models pruned by -mrace were not fully optimized
+        if (str.length() >= 6 && str.substr(str.length()-6) == "PRUNED")
+            continue;
         info.tree = "";
         if (*str.rbegin() == ';') {
             size_t pos = str.rfind('\t');
@@ -1158,6 +1161,86 @@ bool isMixtureModel(ModelsBlock *models_block, string &model_str) {
     return false;
 }
 
+/**
+    evaluate candidate models that do not depend on the result of a previous model
+    concurrently, each with its own copy of in_tree and its own ModelFactory.
+    The number of models running at the same time is limited by the available RAM.
+    @param[out] par_info result of model i, empty name if not evaluated
+    @param[out] par_model_lines corresponding line for the .model file
+*/
+void evaluateModelsConcurrently(Params &params, PhyloTree *in_tree, StrVector &model_names, vector<ModelInfo> &model_info,
+    ModelsBlock *models_block, string &set_name, int max_cats, vector<ModelInfo> &par_info, StrVector &par_model_lines)
+{
+    IntVector models;
+    for (int model = 0; model < model_names.size(); model++) {
+        string &name = model_names[model];
+        // +R models start from the previous +R estimate, '+' models depend on the best model so far
+        if (name[0] == '+' || name.find("+R") != string::npos || name.find("+ASC") != string::npos ||
+            isMixtureModel(models_block, name))
+            continue;
+        bool done = false;
+        for (vector<ModelInfo>::iterator it = model_info.begin(); it != model_info.end(); it++)
+            if (it->name == name) {
+                done = true;
+                break;
+            }
+        if (!done)
+            models.push_back(model);
+    }
+    par_info.resize(model_names.size());
+    par_model_lines.resize(model_names.size());
+    if (models.empty())
+        return;
+
+    int num_concurrent = 1;
+#ifdef _OPENMP
+    num_concurrent = min((int)models.size(), omp_get_max_threads());
+#endif
+    uint64_t mem_per_model = in_tree->getMemoryRequired(max_cats);
+    uint64_t mem_avail = getMemorySize() / 10 * 9;
+    if (mem_per_model > 0 && mem_per_model * num_concurrent > mem_avail)
+        num_concurrent = max((uint64_t)1, mem_avail / mem_per_model);
+    cout << "Evaluating " << models.size() << " models concurrently with " << num_concurrent << " threads ..." << endl;
+
+    VerboseMode saved_mode = verbose_mode;
+    verbose_mode = VB_QUIET;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) num_threads(num_concurrent)
+#endif
+    for (int i = 0; i < models.size(); i++) {
+        int model = models[i];
+        Params model_params = params;
+        model_params.model_name = model_names[model];
+        PhyloTree *tree = new PhyloTree;
+        tree->copyPhyloTree(in_tree);
+        tree->setParams(&model_params);
+        tree->optimize_by_newton = params.optimize_by_newton;
+        tree->num_precision = in_tree->num_precision;
+        tree->setLikelihoodKernel(params.SSE);
+        ModelFactory *model_fac = new ModelFactory(model_params, tree, models_block);
+        model_fac->joint_optimize = params.optimize_model_rate_joint;
+        tree->setModelFactory(model_fac);
+        tree->setModel(model_fac->model);
+        tree->setRate(model_fac->site_rate);
+        tree->initializeAllPartialLh();
+
+        ModelInfo &info = par_info[model];
+        info.set_name = set_name;
+        info.df = model_fac->getNParameters();
+        info.logl = model_fac->optimizeParameters(false, false, TOL_LIKELIHOOD_MODELTEST, TOL_GRADIENT_MODELTEST);
+        info.tree_len = tree->treeLength();
+        info.tree = tree->getTreeString();
+        info.name = tree->getModelName();
+        ostringstream ss;
+        printModelFile(ss, model_params, tree, info, set_name);
+        par_model_lines[model] = ss.str();
+
+        // also deletes model_fac, its model and site rate
+        delete tree;
+    }
+    verbose_mode = saved_mode;
+}
+
 string testModel(Params &params, PhyloTree* in_tree, vector<ModelInfo> &model_info, ostream &fmodel, ModelsBlock *models_block,
     string set_name, bool print_mem_usage) 
 {
@@ -1265,11 +1348,19 @@ string testModel(Params &params, PhyloTree* in_tree, vector<ModelInfo> &model_in
 		it->BIC_score = DBL_MAX;
 	}
 
+    // results of models evaluated concurrently beforehand
+    vector<ModelInfo> par_info;
+    StrVector par_model_lines;
+    if (params.model_test_parallel && set_name == "" && !params.model_test_and_tree && !params.print_site_lh)
+        evaluateModelsConcurrently(params, in_tree, model_names, model_info, models_block, set_name, max_cats,
+            par_info, par_model_lines);
+
 	uint64_t RAM_requirement = 0;
     int model_aic = -1, model_aicc = -1, model_bic = -1;
     string prev_tree_string = "";
     int prev_model_id = -1;
     int skip_model = 0;
+    int num_pruned = 0;
 
 	for (model = 0; model < model_names.size(); model++) {
 		//cout << model_names[model] << endl;
@@ -1406,6 +1497,7 @@ string testModel(Params &params, PhyloTree* in_tree, vector<ModelInfo> &model_in
         else
             info.name = tree->getModelName();
 		int model_id = -1;
+        bool pruned = false;
         if (skip_model) {
             assert(prev_model_id>=0);
             size_t pos_r = info.name.find("+R");
@@ -1433,6 +1525,11 @@ string testModel(Params &params, PhyloTree* in_tree, vector<ModelInfo> &model_in
 //            prev_tree_string = model_info[prev_model_id].tree;
 //            cout << "Skipped " << info.name << endl;
             }
+		} else if (!par_info.empty() && par_info[model].name == info.name && par_info[model].df == info.df) {
+            info.logl = par_info[model].logl;
+            info.tree_len = par_info[model].tree_len;
+            info.tree = par_info[model].tree;
+            fmodel << par_model_lines[model];
 		} else {
             if (params.model_test_and_tree) {
                 string original_model = params.model_name;
@@ -1483,9 +1580,30 @@ string testModel(Params &params, PhyloTree* in_tree, vector<ModelInfo> &model_in
                     tree->fixNegativeBranch(true);
                     tree->clearAllPartialLH();
                 }
-                info.logl = tree->getModelFactory()->optimizeParameters(false, false, TOL_LIKELIHOOD_MODELTEST, TOL_GRADIENT_MODELTEST);
+                if (params.model_test_race > 0.0 && model_bic >= 0) {
+                    // racing: do one optimization round, then drop the model if even an
+                    // optimistic lnL cannot beat the best score found so far
+                    int orig_iterations = params.num_param_iterations;
+                    params.num_param_iterations = 3;
+                    info.logl = tree->getModelFactory()->optimizeParameters(false, false, TOL_LIKELIHOOD_MODELTEST, TOL_GRADIENT_MODELTEST);
+                    params.num_param_iterations = orig_iterations;
+                    double AIC_bound, AICc_bound, BIC_bound;
+                    computeInformationScores(info.logl + params.model_test_race * info.df, info.df, ssize,
+                        AIC_bound, AICc_bound, BIC_bound);
+                    bool aic_lost = AIC_bound > model_info[model_aic].AIC_score;
+                    bool aicc_lost = AICc_bound > model_info[model_aicc].AICc_score;
+                    bool bic_lost = BIC_bound > model_info[model_bic].BIC_score;
+                    switch (params.model_test_criterion) {
+                    case MTC_AIC: pruned = aic_lost; break;
+                    case MTC_AICC: pruned = aicc_lost; break;
+                    case MTC_BIC: pruned = bic_lost; break;
+                    default: pruned = aic_lost && aicc_lost && bic_lost; break;
+                    }
+                }
+                if (!pruned)
+                    info.logl = tree->getModelFactory()->optimizeParameters(false, false, TOL_LIKELIHOOD_MODELTEST, TOL_GRADIENT_MODELTEST);
                 info.tree_len = tree->treeLength();
-                if (prev_model_id >= 0) {
+                if (prev_model_id >= 0 && !pruned) {
                     // check stop criterion for +R
                     size_t prev_pos_r = model_info[prev_model_id].name.find("+R");
                     size_t pos_r = info.name.find("+R");
@@ -1504,11 +1622,24 @@ string testModel(Params &params, PhyloTree* in_tree, vector<ModelInfo> &model_in
 //                info.tree = tree->getTreeString();
             }
 			// print information to .model file
-            info.tree = tree->getTreeString();
-            printModelFile(fmodel, params, tree, info, set_name);
+            if (pruned) {
+                // mark the line so that a rerun evaluates this model again
+                info.tree = "PRUNED";
+                printModelFile(fmodel, params, tree, info, set_name);
+                info.tree = "";
+                num_pruned++;
+            } else {
+                info.tree = tree->getTreeString();
+                printModelFile(fmodel, params, tree, info, set_name);
+            }
 		}
 		computeInformationScores(info.logl, info.df, ssize, info.AIC_score, info.AICc_score, info.BIC_score);
-        if (prev_model_id >= 0) {
+        if (pruned) {
+            // not fitted to the end: left out of the criteria, the weights and the report like a skipped model
+            info.AIC_score = DBL_MAX;
+            info.AICc_score = DBL_MAX;
+            info.BIC_score = DBL_MAX;
+        } else if (prev_model_id >= 0) {
             // check stop criterion for +R
             size_t prev_pos_r = model_info[prev_model_id].name.find("+R");
             size_t pos_r = info.name.find("+R");
@@ -1591,6 +1722,10 @@ string testModel(Params &params, PhyloTree* in_tree, vector<ModelInfo> &model_in
 		cout << -info.logl << " ";
 		cout.width(3);
 		cout << info.df << " ";
+        if (pruned) {
+            cout << "Pruned" << endl;
+            continue;
+        }
 		cout.width(12);
 		cout << info.AIC_score << " ";
 		cout.width(12);
@@ -1603,6 +1738,9 @@ string testModel(Params &params, PhyloTree* in_tree, vector<ModelInfo> &model_in
     if (model_bic < 0) 
         outError("No models were examined! Please check messages above");
 
+    if (num_pruned > 0 && set_name == "")
+        cout << num_pruned << " models were pruned after one optimization round (-mrace) and are not considered by AIC, AICc and BIC" << endl;
+
 	//cout.unsetf(ios::fixed);
 	/*
 	for (it = model_info.begin(); it != model_info.end(); it++)
@@ -1910,6 +2048,9 @@ public:
     double *rr_inv;
 };
 
+/** number of bootstrap replicates scored together in performAUTest() */
+const int AU_BOOT_BLOCK = 16;
+
 /**
     @param tree_lhs RELL score matrix of size #trees x #replicates
 */
@@ -1935,6 +2076,34 @@ void performAUTest(Params &params, PhyloTree *tree, double *pattern_lhs, vector<
     memset(bp, 0, sizeof(double)*ntrees*nscales);
     
     int k, tid, ptn;
+
+    // each partition is resampled separately as in Alignment::createBootstrapAlignment() with SCALE=
+    vector<Alignment*> partitions;
+    if (tree->aln->isSuperAlignment())
+        partitions = ((SuperAlignment*)tree->aln)->partitions;
+    else
+        partitions.push_back(tree->aln);
+    IntVector part_start, site_start, site_ptn;
+    double *ptn_freq = new double[nptn];
+    for (int part = 0; part < partitions.size(); part++) {
+        Alignment *aln = partitions[part];
+        int start = part_start.empty() ? 0 : part_start.back() + partitions[part-1]->getNPattern();
+        part_start.push_back(start);
+        site_start.push_back(site_ptn.size());
+        for (ptn = 0; ptn < aln->getNPattern(); ptn++)
+            ptn_freq[start + ptn] = aln->at(ptn).frequency;
+        for (int site = 0; site < aln->getNSite(); site++)
+            site_ptn.push_back(start + aln->getPatternID(site));
+    }
+    part_start.push_back(nptn);
+    site_start.push_back(site_ptn.size());
+
+    // replicates of all scales are processed in blocks of AU_BOOT_BLOCK, each thread draws
+    // the pattern frequencies of its blocks and scores all trees against them at once
+    size_t nblocks = (nboot + AU_BOOT_BLOCK - 1) / AU_BOOT_BLOCK;
+    int *bp_count = new int[ntrees*nscales];
+    memset(bp_count, 0, sizeof(int)*ntrees*nscales);
+
 #ifdef _OPENMP
     #pragma omp parallel private(k, tid, ptn)
     {
@@ -1943,51 +2112,82 @@ void performAUTest(Params &params, PhyloTree *tree, double *pattern_lhs, vector<
 #else
     int *rstream = randstream;
 #endif
-    size_t boot;
-    int *boot_sample = aligned_alloc<int>(maxnptn);
-    memset(boot_sample, 0, maxnptn*sizeof(int));
-    
-    double *boot_sample_dbl = aligned_alloc<double>(maxnptn);
-    
+    size_t block;
+    unsigned int *boot_sample = new unsigned int[nptn];
+    // padding of the rows must be zero
+    double *boot_freqs = aligned_alloc<double>(AU_BOOT_BLOCK*maxnptn);
+    memset(boot_freqs, 0, sizeof(double)*AU_BOOT_BLOCK*maxnptn);
+    double *boot_lhs = new double[ntrees*AU_BOOT_BLOCK];
+    int *this_bp_count = new int[ntrees*nscales];
+    memset(this_bp_count, 0, sizeof(int)*ntrees*nscales);
+
 #ifdef _OPENMP
     #pragma omp for schedule(static)
 #endif
-    for (k = 0; k < nscales; k++) {
-        string str = "SCALE=" + convertDoubleToString(r[k]);    
-		for (boot = 0; boot < nboot; boot++) {
-			tree->aln->createBootstrapAlignment(boot_sample, str.c_str(), rstream);
-            for (ptn = 0; ptn < maxnptn; ptn++)
-                boot_sample_dbl[ptn] = boot_sample[ptn];
+    for (block = 0; block < nscales*nblocks; block++) {
+        k = block / nblocks;
+        size_t first_boot = (block % nblocks) * AU_BOOT_BLOCK;
+        int nb = min((size_t)AU_BOOT_BLOCK, nboot - first_boot);
+        int boot;
+        for (boot = 0; boot < nb; boot++) {
+            double *this_freqs = boot_freqs + boot*maxnptn;
+            for (int part = 0; part < partitions.size(); part++) {
+                int part_nptn = part_start[part+1] - part_start[part];
+                int orig_nsite = site_start[part+1] - site_start[part];
+                int nsite = (int)round(r[k] * orig_nsite);
+                double *part_freqs = this_freqs + part_start[part];
+                if (nsite/8 < part_nptn) {
+                    // fewer sites than patterns: draw the sites
+                    int *part_site_ptn = &site_ptn[site_start[part]];
+                    memset(part_freqs, 0, sizeof(double)*part_nptn);
+                    for (int site = 0; site < nsite; site++)
+                        this_freqs[part_site_ptn[random_int(orig_nsite, rstream)]] += 1.0;
+                } else {
+                    // draw the pattern frequencies from the multinomial distribution directly
+                    unsigned int *part_sample = boot_sample + part_start[part];
+                    gsl_ran_multinomial(part_nptn, nsite, ptn_freq + part_start[part], part_sample, rstream);
+                    for (ptn = 0; ptn < part_nptn; ptn++)
+                        part_freqs[ptn] = part_sample[ptn];
+                }
+            }
+        }
+        // log-likelihoods of all trees for the block as one matrix-matrix product
+        (tree->*tree->dotProductMatrix)(pattern_lhs, ntrees, boot_freqs, nb, maxnptn, boot_lhs);
+        for (boot = 0; boot < nb; boot++) {
             double max_lh = -1e20;
             int max_tid = -1;
             for (tid = 0; tid < ntrees; tid++) {
-                double *pattern_lh = pattern_lhs + (tid*maxnptn);
-                double tree_lh;
-#ifdef BINARY32
-                tree_lh = tree->dotProductSIMD<double, Vec2d, 2>(pattern_lh, boot_sample_dbl, nptn);
-#else
-                if (instruction_set >= 7)
-                    tree_lh = tree->dotProductSIMD<double, Vec4d, 4>(pattern_lh, boot_sample_dbl, nptn);
-                else
-                    tree_lh = tree->dotProductSIMD<double, Vec2d, 2>(pattern_lh, boot_sample_dbl, nptn);
-#endif
+                double tree_lh = boot_lhs[tid*nb + boot];
                 if (tree_lh > max_lh) {
                     max_lh = tree_lh;
                     max_tid = tid;
-                } 
+                }
             }
-            bp[k*ntrees+max_tid] += nboot_inv;
+            this_bp_count[k*ntrees+max_tid]++;
         }
     }
 
-    aligned_free(boot_sample_dbl);
-    aligned_free(boot_sample);
+#ifdef _OPENMP
+    #pragma omp critical
+#endif
+    for (int i = 0; i < ntrees*nscales; i++)
+        bp_count[i] += this_bp_count[i];
+
+    delete [] this_bp_count;
+    delete [] boot_lhs;
+    aligned_free(boot_freqs);
+    delete [] boot_sample;
 
 #ifdef _OPENMP
     finish_random(rstream);
     }
 #endif
 
+    for (int i = 0; i < ntrees*nscales; i++)
+        bp[i] = bp_count[i] * nboot_inv;
+    delete [] bp_count;
+    delete [] ptn_freq;
+
     if (verbose_mode >= VB_MED) {
         cout << "scale";
         for (k = 0; k < nscales; k++)
@@ -62,13 +62,21 @@ void PhyloTree::init() {
     site_rate = NULL;
     optimize_by_newton = true;
     central_partial_lh = NULL;
+    partial_lh_float = false;
+    force_double_lh = false;
     nni_partial_lh = NULL;
     tip_partial_lh = NULL;
     tip_partial_lh_computed = false;
     ptn_freq_computed = false;
     central_scale_num = NULL;
     nni_scale_num = NULL;
+    num_nni_evaluations = 0;
+    nni_heap_allocs = 0;
+    kernel_buffer = NULL;
+    kernel_buffer_size = 0;
     central_partial_pars = NULL;
+    lh_pool_size = 0;
+    lh_pool_block_size = 0;
     model_factory = NULL;
 //    tmp_partial_lh1 = NULL;
 //    tmp_partial_lh2 = NULL;
@@ -172,6 +180,10 @@ PhyloTree::~PhyloTree() {
     if (nni_partial_lh)
         aligned_free(nni_partial_lh);
     nni_partial_lh = NULL;
+    if (kernel_buffer)
+        aligned_free(kernel_buffer);
+    kernel_buffer = NULL;
+    kernel_buffer_size = 0;
     if (central_partial_lh)
         aligned_free(central_partial_lh);
     central_partial_lh = NULL;
@@ -248,12 +260,14 @@ void PhyloTree::readTree(const char *infile, bool &is_rooted) {
 	MTree::readTree(infile, is_rooted);
     // 2015-10-14: has to reset this pointer when read in
     current_it = current_it_back = NULL;
+    clearPartialLhPool();
 }
 
 void PhyloTree::readTree(istream &in, bool &is_rooted) {
 	MTree::readTree(in, rooted);
     // 2015-10-14: has to reset this pointer when read in
     current_it = current_it_back = NULL;
+    clearPartialLhPool();
 	// remove taxa if necessary
 	if (removed_seqs.size() > 0)
 		removeTaxa(removed_seqs);
@@ -299,6 +313,7 @@ void PhyloTree::copyTree(MTree *tree) {
 
 void PhyloTree::copyTree(MTree *tree, string &taxa_set) {
     MTree::copyTree(tree, taxa_set);
+    clearPartialLhPool();
     if (!aln)
         return;
     // reset the ID with alignment
@@ -360,6 +375,7 @@ void PhyloTree::readTreeString(const string &tree_string) {
 //	str(tree_string);
 //	str.seekg(0, ios::beg);
 	freeNode();
+	clearPartialLhPool();
     
     // bug fix 2016-04-14: in case taxon name happens to be ID
 	MTree::readTree(str, rooted);
@@ -671,11 +687,7 @@ void PhyloTree::initializeAllPartialLh() {
     //size_t mem_size = ((getAlnNSite() % 2) == 0) ? getAlnNSite() : (getAlnNSite() + 1);
     size_t nptn = getAlnNPattern() + numStates; // extra #numStates for ascertainment bias correction
 
-    size_t mem_size;
-    if (instruction_set >= 7)
-    	mem_size = ((nptn +3)/4)*4;
-    else
-    	mem_size = ((nptn % 2) == 0) ? nptn : (nptn + 1);
+    size_t mem_size = get_safe_upper_limit(nptn);
 
     size_t block_size = mem_size * numStates * site_rate->getNRate() * ((model_factory->fused_mix_rate)? 1 : model->getNMixtures());
     // make sure _pattern_lh size is divisible by 4 (e.g., 9->12, 14->16)
@@ -705,7 +717,8 @@ void PhyloTree::initializeAllPartialLh() {
     assert(index == (nodeNum - 1) * 2);
     if (sse == LK_EIGEN || sse == LK_EIGEN_SSE) {
         if (params->lh_mem_save == LM_PER_NODE) {
-            assert(indexlh == nodeNum-leafNum);
+            // with the memory-capped pool, vectors are only assigned on demand
+            assert(indexlh == ((lh_pool_size) ? 0 : nodeNum-leafNum));
         } else {
             assert(indexlh == (nodeNum-1)*2-leafNum);
         }
@@ -732,6 +745,10 @@ void PhyloTree::deleteAllPartialLh() {
     if (nni_partial_lh)
         aligned_free(nni_partial_lh);
     nni_partial_lh = NULL;
+    if (kernel_buffer)
+        aligned_free(kernel_buffer);
+    kernel_buffer = NULL;
+    kernel_buffer_size = 0;
 
 	if (ptn_invar)
 		aligned_free(ptn_invar);
@@ -748,6 +765,13 @@ void PhyloTree::deleteAllPartialLh() {
 	central_scale_num = NULL;
 	central_partial_pars = NULL;
 
+	lh_pool_size = 0;
+	lh_pool_owner.clear();
+	lh_pool_pin.clear();
+	lh_pool_free.clear();
+	lh_pool_prev.clear();
+	lh_pool_next.clear();
+
 	ptn_invar = NULL;
 	ptn_freq = NULL;
 	ptn_freq_computed = false;
@@ -762,13 +786,8 @@ void PhyloTree::deleteAllPartialLh() {
  
 uint64_t PhyloTree::getMemoryRequired(size_t ncategory) {
 	size_t nptn = aln->getNPattern() + aln->num_states; // +num_states for ascertainment bias correction
-	uint64_t block_size;
-	if (instruction_set >= 7)
-		// block size must be divisible by 4
-		block_size = ((nptn+3)/4)*4;
-	else
-		// block size must be divisible by 2
-		block_size = ((nptn % 2) == 0) ? nptn : (nptn + 1);
+	// block size must be divisible by the SIMD vector size
+	uint64_t block_size = get_safe_upper_limit(nptn);
     block_size = block_size * aln->num_states;
     if (site_rate)
     	block_size *= site_rate->getNRate();
@@ -776,6 +795,7 @@ uint64_t PhyloTree::getMemoryRequired(size_t ncategory) {
     	block_size *= ncategory;
     if (model && !model_factory->fused_mix_rate)
     	block_size *= model->getNMixtures();
+    block_size = getPartialLhStorage(block_size);
     uint64_t mem_size = ((uint64_t) leafNum*4) * block_size *sizeof(double) + 2 + (leafNum) * 4 * nptn * sizeof(UBYTE);
     if (params->SSE == LK_EIGEN || params->SSE == LK_EIGEN_SSE) {
     	mem_size -= ((uint64_t)leafNum) * ((uint64_t)block_size*sizeof(double) + nptn * sizeof(UBYTE));
@@ -789,6 +809,10 @@ uint64_t PhyloTree::getMemoryRequired(size_t ncategory) {
     else
         tip_partial_lh_size = aln->num_states * (aln->STATE_UNKNOWN+1) * sizeof(double);
     mem_size += tip_partial_lh_size;
+    // partial likelihoods not fitting into -mem are recomputed on demand
+    if (params->lh_mem_limit && params->lh_mem_save == LM_PER_NODE && mem_size > params->lh_mem_limit &&
+        (params->SSE == LK_EIGEN || params->SSE == LK_EIGEN_SSE))
+        mem_size = params->lh_mem_limit;
     if (params->gbo_replicates)
         mem_size += params->gbo_replicates*nptn*sizeof(BootValType);
     return mem_size;
@@ -796,18 +820,14 @@ uint64_t PhyloTree::getMemoryRequired(size_t ncategory) {
 
 void PhyloTree::getMemoryRequired(uint64_t &partial_lh_entries, uint64_t &scale_num_entries, uint64_t &partial_pars_entries) {
 	size_t nptn = aln->getNPattern() + aln->num_states; // +num_states for ascertainment bias correction
-	uint64_t block_size;
-	if (instruction_set >= 7)
-		// block size must be divisible by 4
-		block_size = ((nptn+3)/4)*4;
-	else
-		// block size must be divisible by 2
-		block_size = ((nptn % 2) == 0) ? nptn : (nptn + 1);
+	// block size must be divisible by the SIMD vector size
+	uint64_t block_size = get_safe_upper_limit(nptn);
     block_size = block_size * aln->num_states;
     if (site_rate)
     	block_size *= site_rate->getNRate();
     if (model && !model_factory->fused_mix_rate)
     	block_size *= model->getNMixtures();
+    block_size = getPartialLhStorage(block_size);
 
 	uint64_t tip_partial_lh_size = aln->num_states * (aln->STATE_UNKNOWN+1) * model->getNMixtures();
     if (sse == LK_EIGEN || sse == LK_EIGEN_SSE) {
@@ -835,17 +855,13 @@ void PhyloTree::initializeAllPartialLh(int &index, int &indexlh, PhyloNode *node
     size_t pars_block_size = getBitsBlockSize();
     size_t nptn = aln->size()+aln->num_states; // +num_states for ascertainment bias correction
     size_t block_size;
-    if (instruction_set >= 7)
-    	// block size must be divisible by 4
-    	nptn = ((nptn+3)/4)*4;
-	else
-		// block size must be divisible by 2
-		nptn = ((nptn % 2) == 0) ? nptn : (nptn + 1);
+    // block size must be divisible by the SIMD vector size (2 for SSE, 4 for AVX, 8 for AVX-512)
+    nptn = get_safe_upper_limit(nptn);
 
     size_t scale_block_size = nptn;
 //    size_t tip_block_size = nptn * model->num_states;
 
-    block_size = nptn * model->num_states * site_rate->getNRate() * ((model_factory->fused_mix_rate)? 1 : model->getNMixtures());
+    block_size = getPartialLhStorage(nptn * model->num_states * site_rate->getNRate() * ((model_factory->fused_mix_rate)? 1 : model->getNMixtures()));
     if (!node) {
         node = (PhyloNode*) root;
         // allocate the big central partial likelihoods memory
@@ -857,16 +873,32 @@ void PhyloTree::initializeAllPartialLh(int &index, int &indexlh, PhyloNode *node
             size_t IT_NUM = (params->nni5) ? 6 : 2;
             nni_partial_lh = aligned_alloc<double>(IT_NUM*block_size);
             nni_scale_num = aligned_alloc<UBYTE>(IT_NUM*scale_block_size);
+            nni_neighbors.resize(6, PhyloNeighbor(NULL, 0.0));
         }
+        // temporaries of the likelihood kernels, enlarged here if the model has changed
+        getKernelBuffer(getKernelBufferSize());
 
 
+        if (central_partial_lh && params->lh_mem_limit && lh_pool_block_size != block_size) {
+            // vector size changed (e.g. other number of categories), so does the number of slots fitting into -mem
+            aligned_free(central_partial_lh);
+            central_partial_lh = NULL;
+            if (central_scale_num)
+                aligned_free(central_scale_num);
+            central_scale_num = NULL;
+        }
+
         if (!central_partial_lh) {
         	uint64_t tip_partial_lh_size = aln->num_states * (aln->STATE_UNKNOWN+1) * model->getNMixtures();
             if (model->isSiteSpecificModel() && (sse == LK_EIGEN || sse == LK_EIGEN_SSE))
                 tip_partial_lh_size = get_safe_upper_limit(aln->size()) * model->num_states * leafNum;
+            lh_pool_size = computePartialLhPoolSize(block_size, tip_partial_lh_size);
+            lh_pool_block_size = block_size;
             uint64_t mem_size = ((uint64_t)leafNum * 4 - 6) * (uint64_t) block_size + 2 + tip_partial_lh_size;
             if (sse == LK_EIGEN || sse == LK_EIGEN_SSE) {
-                if (params->lh_mem_save == LM_PER_NODE) {
+                if (lh_pool_size) {
+                    mem_size = (uint64_t)lh_pool_size * (uint64_t)block_size + 2 + tip_partial_lh_size;
+                } else if (params->lh_mem_save == LM_PER_NODE) {
                     mem_size -= ((uint64_t)leafNum * 3 - 4) * (uint64_t)block_size;
                 } else {
                     mem_size -= (uint64_t)leafNum * (uint64_t)block_size;
@@ -885,7 +917,9 @@ void PhyloTree::initializeAllPartialLh(int &index, int &indexlh, PhyloNode *node
 
         // now always assign tip_partial_lh
         if (sse == LK_EIGEN || sse == LK_EIGEN_SSE) {
-            if (params->lh_mem_save == LM_PER_NODE) {
+            if (lh_pool_size) {
+                tip_partial_lh = central_partial_lh + (lh_pool_size*block_size);
+            } else if (params->lh_mem_save == LM_PER_NODE) {
                 tip_partial_lh = central_partial_lh + ((nodeNum - leafNum)*block_size);
             } else {
                 tip_partial_lh = central_partial_lh + (((nodeNum - 1)*2-leafNum)*block_size);
@@ -896,7 +930,9 @@ void PhyloTree::initializeAllPartialLh(int &index, int &indexlh, PhyloNode *node
         if (!central_scale_num) {
         	uint64_t mem_size = (leafNum - 1) * 4 * scale_block_size;
         	if (sse == LK_EIGEN || sse == LK_EIGEN_SSE) {
-                if (params->lh_mem_save == LM_PER_NODE) {
+                if (lh_pool_size) {
+                    mem_size = (uint64_t)lh_pool_size * (uint64_t) scale_block_size;
+                } else if (params->lh_mem_save == LM_PER_NODE) {
                     mem_size -= ((uint64_t)leafNum*3 - 2) * (uint64_t) scale_block_size;
                 } else {
                     mem_size -= (uint64_t)leafNum * (uint64_t) scale_block_size;
@@ -927,6 +963,8 @@ void PhyloTree::initializeAllPartialLh(int &index, int &indexlh, PhyloNode *node
         }
         index = 0;
         indexlh = 0;
+        // all pool slots become free, as partial_lh of all neighbors is reset below
+        clearPartialLhPool();
     }
     if (dad) {
         // assign a region in central_partial_lh to both Neihgbors (dad->node, and node->dad)
@@ -942,7 +980,7 @@ void PhyloTree::initializeAllPartialLh(int &index, int &indexlh, PhyloNode *node
         
         // now initialize partial_lh and scale_num
         if (params->lh_mem_save == LM_PER_NODE && (sse == LK_EIGEN || sse == LK_EIGEN_SSE)) {
-            if (!node->isLeaf()) { // only allocate memory to internal node
+            if (!node->isLeaf() && !lh_pool_size) { // only allocate memory to internal node, pool slots are assigned on demand
                 nei->partial_lh = NULL; // do not allocate memory for tip, use tip_partial_lh instead
                 nei->scale_num = NULL;
                 nei2->scale_num = central_scale_num + ((indexlh) * scale_block_size);
@@ -986,25 +1024,209 @@ void PhyloTree::initializeAllPartialLh(int &index, int &indexlh, PhyloNode *node
     FOR_NEIGHBOR_IT(node, dad, it) initializeAllPartialLh(index, indexlh, (PhyloNode*) (*it)->node, node);
 }
 
+size_t PhyloTree::computePartialLhPoolSize(size_t block_size, uint64_t tip_partial_lh_size) {
+    if (!params->lh_mem_limit || params->lh_mem_save != LM_PER_NODE || isSuperTree() ||
+        !(sse == LK_EIGEN || sse == LK_EIGEN_SSE))
+        return 0;
+    size_t max_slots = nodeNum - leafNum; // one vector per internal node
+    size_t IT_NUM = (params->nni5) ? 6 : 2;
+    uint64_t slot_bytes = (uint64_t)block_size * sizeof(double) + get_safe_upper_limit(aln->size()+aln->num_states) * sizeof(UBYTE);
+    // memory for tip vectors, NNI buffers and theta_all is needed anyway
+    uint64_t fixed_bytes = (tip_partial_lh_size + (IT_NUM+1) * (uint64_t)block_size) * sizeof(double);
+    uint64_t nslots = (params->lh_mem_limit > fixed_bytes) ? (params->lh_mem_limit - fixed_bytes) / slot_bytes : 0;
+    if (nslots >= max_slots)
+        return 0;
+    // since larger subtrees are computed first, about log2(#taxa) finished subtrees are pinned at a time
+    size_t min_slots = 4;
+    for (int n = leafNum; n > 1; n /= 2)
+        min_slots++;
+    if (min_slots >= max_slots)
+        return 0;
+    if (nslots < min_slots)
+        outError("Memory limit (-mem) is too small, please allow at least " +
+            convertInt64ToString((fixed_bytes + min_slots * slot_bytes) / 1048576 + 1) + " MB");
+    if (verbose_mode >= VB_MED)
+        cout << "Memory limit allows " << nslots << " out of " << max_slots
+             << " partial likelihood vectors, the others are recomputed on demand" << endl;
+    return nslots;
+}
+
+int PhyloTree::getPartialLhSlot(PhyloNeighbor *nei) {
+    if (!lh_pool_size || !nei->partial_lh || nei->partial_lh < central_partial_lh)
+        return -1;
+    size_t slot = (nei->partial_lh - central_partial_lh) / lh_pool_block_size;
+    if (slot >= lh_pool_size || lh_pool_owner[slot] != nei)
+        return -1;
+    return slot;
+}
+
+void PhyloTree::pinPartialLh(PhyloNeighbor *nei, int delta) {
+    int slot = getPartialLhSlot(nei);
+    if (slot < 0)
+        return;
+    if (lh_pool_pin[slot] == 0)
+        unlinkPartialLhSlot(slot);
+    lh_pool_pin[slot] += delta;
+    assert(lh_pool_pin[slot] >= 0);
+    if (lh_pool_pin[slot] == 0)
+        appendPartialLhSlot(slot);
+}
+
+void PhyloTree::unlinkPartialLhSlot(int slot) {
+    lh_pool_next[lh_pool_prev[slot]] = lh_pool_next[slot];
+    lh_pool_prev[lh_pool_next[slot]] = lh_pool_prev[slot];
+}
+
+void PhyloTree::appendPartialLhSlot(int slot) {
+    int head = lh_pool_size;
+    lh_pool_prev[slot] = lh_pool_prev[head];
+    lh_pool_next[slot] = head;
+    lh_pool_next[lh_pool_prev[head]] = slot;
+    lh_pool_prev[head] = slot;
+}
+
+void PhyloTree::assignPartialLhSlot(PhyloNeighbor *dad_branch) {
+    int slot;
+    if (!lh_pool_free.empty()) {
+        slot = lh_pool_free.back();
+        lh_pool_free.pop_back();
+    } else {
+        // least recently used unpinned slot
+        slot = lh_pool_next[lh_pool_size];
+        if (slot == lh_pool_size)
+            outError("Memory limit (-mem) is too small to compute partial likelihoods on this tree, please increase it");
+        unlinkPartialLhSlot(slot);
+        // evict: it will be recomputed when needed again
+        PhyloNeighbor *owner = lh_pool_owner[slot];
+        owner->partial_lh = NULL;
+        owner->scale_num = NULL;
+        owner->partial_lh_computed &= ~1; // clear bit
+    }
+    size_t scale_block_size = get_safe_upper_limit(aln->size()+aln->num_states);
+    dad_branch->partial_lh = central_partial_lh + (slot * lh_pool_block_size);
+    dad_branch->scale_num = central_scale_num + (slot * scale_block_size);
+    lh_pool_owner[slot] = dad_branch;
+    lh_pool_pin[slot] = 0;
+    appendPartialLhSlot(slot);
+}
+
+void PhyloTree::clearPartialLhPool() {
+    // slot owners belong to the freed nodes
+    lh_pool_owner.assign(lh_pool_size, NULL);
+    lh_pool_pin.assign(lh_pool_size, 0);
+    lh_pool_free.clear();
+    for (int slot = lh_pool_size-1; slot >= 0; slot--)
+        lh_pool_free.push_back(slot);
+    // empty LRU list
+    lh_pool_prev.assign(lh_pool_size+1, lh_pool_size);
+    lh_pool_next.assign(lh_pool_size+1, lh_pool_size);
+}
+
+static bool largerSubtree(const pair<int, PhyloNeighbor*> &a, const pair<int, PhyloNeighbor*> &b) {
+    return a.first > b.first;
+}
+
+int PhyloTree::countPendingPartialLh(PhyloNeighbor *dad_branch, PhyloNode *dad) {
+    if (dad_branch->partial_lh_computed & 1)
+        return 0;
+    PhyloNode *node = (PhyloNode*)dad_branch->node;
+    int count = 1;
+    FOR_NEIGHBOR_IT(node, dad, it)
+        count += countPendingPartialLh((PhyloNeighbor*)*it, node);
+    lh_pool_pending[node->id] = count;
+    return count;
+}
+
+void PhyloTree::computePartialLikelihoodPool(PhyloNeighbor *dad_branch, PhyloNode *dad) {
+    if (dad_branch->partial_lh_computed & 1) {
+        pinPartialLh(dad_branch, 0);
+        return;
+    }
+    // subtree sizes are counted once per traversal, only over the part to be computed
+    if (lh_pool_pending.size() < nodeNum)
+        lh_pool_pending.resize(nodeNum);
+    countPendingPartialLh(dad_branch, dad);
+    computePartialLikelihoodPoolSubtree(dad_branch, dad);
+}
+
+void PhyloTree::computePartialLikelihoodPoolSubtree(PhyloNeighbor *dad_branch, PhyloNode *dad) {
+    if (dad_branch->partial_lh_computed & 1) {
+        pinPartialLh(dad_branch, 0);
+        return;
+    }
+    PhyloNode *node = (PhyloNode*)dad_branch->node;
+    if (node->isLeaf()) {
+        (this->*computePartialLikelihoodPointer)(dad_branch, dad);
+        return;
+    }
+
+    // pin children already computed, then compute the others (larger subtree first) and pin them
+    vector<pair<int, PhyloNeighbor*> > subtrees;
+    FOR_NEIGHBOR_IT(node, dad, it) {
+        PhyloNeighbor *child = (PhyloNeighbor*)*it;
+        if (child->partial_lh_computed & 1)
+            pinPartialLh(child, 1);
+        else
+            subtrees.push_back(make_pair(lh_pool_pending[child->node->id], child));
+    }
+    stable_sort(subtrees.begin(), subtrees.end(), largerSubtree);
+    for (vector<pair<int, PhyloNeighbor*> >::iterator it = subtrees.begin(); it != subtrees.end(); it++) {
+        computePartialLikelihoodPoolSubtree(it->second, node);
+        pinPartialLh(it->second, 1);
+    }
+
+    // children are now available, the kernel will not recurse
+    if (!dad_branch->partial_lh)
+        assignPartialLhSlot(dad_branch);
+    (this->*computePartialLikelihoodPointer)(dad_branch, dad);
+    pinPartialLh(dad_branch, 0);
+
+    FOR_NEIGHBOR_IT(node, dad, it)
+        pinPartialLh((PhyloNeighbor*)*it, -1);
+}
+
 double *PhyloTree::newPartialLh() {
-    double *ret = aligned_alloc<double>((aln->size()+aln->num_states+3) * aln->num_states * site_rate->getNRate() *
-                             ((model_factory->fused_mix_rate)? 1 : model->getNMixtures()));
+    double *ret = aligned_alloc<double>(getPartialLhStorage(get_safe_upper_limit(aln->size()+aln->num_states) * aln->num_states * site_rate->getNRate() *
+                             ((model_factory->fused_mix_rate)? 1 : model->getNMixtures())));
     return ret;
 }
 
 int PhyloTree::getPartialLhBytes() {
     size_t nptn = aln->size()+aln->num_states; // +num_states for ascertainment bias correction
-    size_t block_size;
-    if (instruction_set >= 7)
-    	// block size must be divisible by 4
-    	block_size = ((nptn+3)/4)*4;
-	else
-		// block size must be divisible by 2
-		block_size = ((nptn % 2) == 0) ? nptn : (nptn + 1);
+    // block size must be divisible by the SIMD vector size
+    size_t block_size = get_safe_upper_limit(nptn);
 
     block_size = block_size * model->num_states * site_rate->getNRate() * ((model_factory->fused_mix_rate)? 1 : model->getNMixtures());
 
-	return block_size * sizeof(double);
+	return getPartialLhStorage(block_size) * sizeof(double);
+}
+
+uint64_t PhyloTree::getPartialLhStorage(uint64_t entries) {
+    if (partial_lh_float)
+        return (entries + 1) / 2;
+    return entries;
+}
+
+double *PhyloTree::getKernelBuffer(size_t size) {
+    if (size > kernel_buffer_size) {
+        if (kernel_buffer)
+            aligned_free(kernel_buffer);
+        kernel_buffer = aligned_alloc<double>(size);
+        kernel_buffer_size = size;
+    }
+    return kernel_buffer;
+}
+
+size_t PhyloTree::getKernelBufferSize() {
+    size_t nstates = aln->num_states;
+    // the kernels round the number of patterns up to the SIMD vector size
+    size_t nptn = get_safe_upper_limit(aln->size() + aln->num_states) + 8;
+    size_t block = nstates * site_rate->getNRate() * ((model_factory->fused_mix_rate)? 1 : model->getNMixtures());
+    size_t eigen_size = get_safe_upper_limit(block * nstates);
+    size_t tip_size = get_safe_upper_limit((aln->STATE_UNKNOWN+1) * block);
+    // computePartialLikelihood of a cherry: inverse eigenvectors, evec*exp(eval*t) of both children,
+    // tip vectors of both children and pointers to them. This covers computeLikelihoodDerv and computeLikelihoodBranch
+    return 3 * eigen_size + 2 * tip_size + 2 * nptn;
 }
 
 int PhyloTree::getScaleNumBytes() {
@@ -2473,45 +2695,104 @@ double PhyloTree::correctDist(double *dist_mat) {
     return longest_dist;
 }
 
+/**
+    set the variance of a pairwise distance according to the least-square weighting
+*/
+inline void setDistVariance(LEAST_SQUARE_VAR ls_var_type, double dist, double d2l, double &var) {
+    if (ls_var_type == OLS)
+        var = 1.0;
+    else if (ls_var_type == WLS_PAUPLIN)
+        var = 0.0;
+    else if (ls_var_type == WLS_FIRST_TAYLOR)
+        var = dist;
+    else if (ls_var_type == WLS_FITCH_MARGOLIASH)
+        var = dist * dist;
+    else if (ls_var_type == WLS_SECOND_TAYLOR)
+        var = -1.0 / d2l;
+}
+
 double PhyloTree::computeDist(double *dist_mat, double *var_mat) {
     int nseqs = aln->getNSeq();
     int pos = 0;
     int num_pairs = nseqs * (nseqs - 1) / 2;
     double longest_dist = 0.0;
-    int *row_id = new int[num_pairs];
-    int *col_id = new int[num_pairs];
-
-    row_id[0] = 0;
-    col_id[0] = 1;
-    for (pos = 1; pos < num_pairs; pos++) {
-        row_id[pos] = row_id[pos - 1];
-        col_id[pos] = col_id[pos - 1] + 1;
-        if (col_id[pos] >= nseqs) {
-            row_id[pos]++;
-            col_id[pos] = row_id[pos] + 1;
+
+    if (!params->compute_obs_dist && AlignmentPairwiseBatch::isSupported(this)) {
+        // pairs are grouped by blocks of sequences, each block pair forms one tile
+        int block_size = AlignmentPairwiseBatch::BLOCK_SIZE;
+        vector<int> tile_start;
+        int *row_id = new int[num_pairs];
+        int *col_id = new int[num_pairs];
+        for (int block1 = 0; block1 < nseqs; block1 += block_size)
+            for (int block2 = block1; block2 < nseqs; block2 += block_size) {
+                int start = pos;
+                for (int seq1 = block1; seq1 < min(block1 + block_size, nseqs); seq1++)
+                    for (int seq2 = max(block2, seq1 + 1); seq2 < min(block2 + block_size, nseqs); seq2++) {
+                        row_id[pos] = seq1;
+                        col_id[pos] = seq2;
+                        pos++;
+                    }
+                if (pos > start)
+                    tile_start.push_back(start);
+            }
+        assert(pos == num_pairs);
+        tile_start.push_back(num_pairs);
+        int num_tiles = tile_start.size() - 1;
+        AlignmentPairwiseBatch batch(this);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for (int tile = 0; tile < num_tiles; tile++) {
+            int start = tile_start[tile];
+            int size = tile_start[tile+1] - start;
+            DoubleVector dist(size), d2l(size);
+            int i;
+            for (i = 0; i < size; i++)
+                dist[i] = dist_mat[row_id[start+i] * nseqs + col_id[start+i]];
+            batch.optimizeDist(size, row_id + start, col_id + start, &dist[0], &d2l[0]);
+            for (i = 0; i < size; i++) {
+                int sym_pos = row_id[start+i] * nseqs + col_id[start+i];
+                dist_mat[sym_pos] = dist[i];
+                setDistVariance(params->ls_var_type, dist[i], d2l[i], var_mat[sym_pos]);
+            }
         }
-    }
-    // compute the upper-triangle of distance matrix
+        delete[] col_id;
+        delete[] row_id;
+    } else {
+        int *row_id = new int[num_pairs];
+        int *col_id = new int[num_pairs];
+
+        row_id[0] = 0;
+        col_id[0] = 1;
+        for (pos = 1; pos < num_pairs; pos++) {
+            row_id[pos] = row_id[pos - 1];
+            col_id[pos] = col_id[pos - 1] + 1;
+            if (col_id[pos] >= nseqs) {
+                row_id[pos]++;
+                col_id[pos] = row_id[pos] + 1;
+            }
+        }
+        // model parameters are fixed here, transition matrices may be shared between pairs
+        bool start_storing = model_factory && !model_factory->is_storing;
+        if (start_storing)
+            model_factory->startStoringTransMatrix();
+        // compute the upper-triangle of distance matrix
 #ifdef _OPENMP
 #pragma omp parallel for private(pos)
 #endif
 
-    for (pos = 0; pos < num_pairs; pos++) {
-        int seq1 = row_id[pos];
-        int seq2 = col_id[pos];
-        double d2l; // moved here for thread-safe (OpenMP)
-        int sym_pos = seq1 * nseqs + seq2;
-        dist_mat[sym_pos] = computeDist(seq1, seq2, dist_mat[sym_pos], d2l);
-        if (params->ls_var_type == OLS)
-            var_mat[sym_pos] = 1.0;
-        else if (params->ls_var_type == WLS_PAUPLIN)
-            var_mat[sym_pos] = 0.0;
-        else if (params->ls_var_type == WLS_FIRST_TAYLOR)
-            var_mat[sym_pos] = dist_mat[sym_pos];
-        else if (params->ls_var_type == WLS_FITCH_MARGOLIASH)
-            var_mat[sym_pos] = dist_mat[sym_pos] * dist_mat[sym_pos];
-        else if (params->ls_var_type == WLS_SECOND_TAYLOR)
-            var_mat[sym_pos] = -1.0 / d2l;
+        for (pos = 0; pos < num_pairs; pos++) {
+            int seq1 = row_id[pos];
+            int seq2 = col_id[pos];
+            double d2l; // moved here for thread-safe (OpenMP)
+            int sym_pos = seq1 * nseqs + seq2;
+            dist_mat[sym_pos] = computeDist(seq1, seq2, dist_mat[sym_pos], d2l);
+            setDistVariance(params->ls_var_type, dist_mat[sym_pos], d2l, var_mat[sym_pos]);
+        }
+        if (start_storing)
+            model_factory->stopStoringTransMatrix();
+        delete[] col_id;
+        delete[] row_id;
     }
 
     // copy upper-triangle into lower-triangle and set diagonal = 0
@@ -2529,8 +2810,6 @@ double PhyloTree::computeDist(double *dist_mat, double *var_mat) {
             if (dist_mat[pos] > longest_dist)
                 longest_dist = dist_mat[pos];
         }
-    delete[] col_id;
-    delete[] row_id;
 
     /*
      if (longest_dist > MAX_GENETIC_DIST * 0.99)
@@ -2620,13 +2899,17 @@ void PhyloTree::computeBioNJ(Params &params, Alignment *alignment, string &dist_
     string bionj_file = params.out_prefix;
     bionj_file += ".bionj";
     cout << "Computing BIONJ tree..." << endl;
-    BioNj bionj;
-    bionj.create(dist_file.c_str(), bionj_file.c_str());
 //    bool my_rooted = false;
     bool non_empty_tree = (root != NULL);
-//    if (root)
-//        freeNode();
-    readTreeFile(bionj_file.c_str());
+    if (dist_matrix && removed_seqs.empty() && aln->getNSeq() >= 3) {
+        // build the tree straight from dist_matrix; .bionj is only written for the user
+        computeNJTree(dist_matrix, true);
+        printTree(bionj_file.c_str());
+    } else {
+        BioNj bionj;
+        bionj.create(dist_file.c_str(), bionj_file.c_str());
+        readTreeFile(bionj_file.c_str());
+    }
 
     if (non_empty_tree) {
         initializeAllPartialLh();
@@ -2634,6 +2917,238 @@ void PhyloTree::computeBioNJ(Params &params, Alignment *alignment, string &dist_
 //    setAlignment(alignment);
 }
 
+/**
+    @return TRUE if pair (q1,a1,b1) is better than (q2,a2,b2): smaller criterion, ties broken by slot indices
+*/
+inline bool betterNJPair(double q1, int a1, int b1, double q2, int a2, int b2) {
+    if (q1 != q2) return q1 < q2;
+    if (a1 != a2) return a1 < a2;
+    return b1 < b2;
+}
+
+void PhyloTree::computeNJTree(double *dist_mat, bool bionj) {
+    int n = aln->getNSeq();
+    assert(n >= 3);
+    size_t stride = n;
+    int i, k, r;
+    // Working matrices are kept in single precision like the original BIONJ code.
+    // When two clusters are joined the matrix is compacted, so that rows 0..r-1
+    // always hold the r active clusters and the scan stays on contiguous memory.
+    float *D = aligned_alloc<float>(stride * n);
+    float *V = (bionj) ? aligned_alloc<float>(stride * n) : NULL;
+    double *S = new double[n];
+    // rapid-NJ style bound: Q(i,j) >= (r-2)*rowmin[i] - S[i] - max(S)
+    double *rowmin = new double[n];
+    int *rowarg = new int[n];
+    bool *recompute = new bool[n];
+    NodeVector clusters(n);
+
+    freeNode();
+    rooted = false;
+    for (i = 0; i < n; i++)
+        clusters[i] = newNode(i, aln->getSeqName(i).c_str());
+    leafNum = n;
+    Node *first_leaf = clusters[0];
+
+    for (i = 0; i < n; i++) {
+        D[i*stride+i] = 0.0;
+        for (k = 0; k < i; k++)
+            D[i*stride+k] = D[k*stride+i] = 0.5 * (dist_mat[i*stride+k] + dist_mat[k*stride+i]);
+    }
+    // initial variances are the distances themselves
+    if (V)
+        memcpy(V, D, sizeof(float) * stride * n);
+    for (i = 0; i < n; i++) {
+        S[i] = 0.0;
+        for (k = 0; k < n; k++)
+            S[i] += D[i*stride+k];
+        recompute[i] = true;
+    }
+
+    for (r = n; r > 3; r--) {
+        double r2 = r - 2;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 64) if (r >= 1024)
+#endif
+        for (i = 0; i < r; i++) {
+            if (!recompute[i]) continue;
+            const float *Di = D + i*stride;
+            double min_dist = numeric_limits<double>::max();
+            int min_arg = -1;
+            for (int j = 0; j < r; j++)
+                if (j != i && Di[j] < min_dist) {
+                    min_dist = Di[j];
+                    min_arg = j;
+                }
+            rowmin[i] = min_dist;
+            rowarg[i] = min_arg;
+            recompute[i] = false;
+        }
+
+        // seed the search with the row of smallest bound
+        double max_sum = S[0];
+        for (i = 1; i < r; i++)
+            if (S[i] > max_sum) max_sum = S[i];
+        int seed = 0;
+        double seed_bound = r2 * rowmin[0] - S[0];
+        for (i = 1; i < r; i++)
+            if (r2 * rowmin[i] - S[i] < seed_bound) {
+                seed_bound = r2 * rowmin[i] - S[i];
+                seed = i;
+            }
+        double best_q = numeric_limits<double>::max();
+        int best_a = -1, best_b = -1;
+        for (k = 0; k < r; k++) {
+            if (k == seed) continue;
+            int a = max(seed, k), b = min(seed, k);
+            double q = (r2 * D[a*stride+b] - S[b]) - S[a];
+            if (betterNJPair(q, a, b, best_q, best_a, best_b)) {
+                best_q = q;
+                best_a = a;
+                best_b = b;
+            }
+        }
+
+        // scan the lower triangle, skipping rows whose bound exceeds the best pair so far
+#ifdef _OPENMP
+#pragma omp parallel if (r >= 1024)
+#endif
+        {
+            double my_q = best_q;
+            int my_a = best_a, my_b = best_b;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 64)
+#endif
+            for (i = 1; i < r; i++) {
+                if (r2 * rowmin[i] - S[i] - max_sum > my_q + 1e-9 * (fabs(my_q) + 1.0))
+                    continue;
+                const float *Di = D + i*stride;
+                double row_q = numeric_limits<double>::max();
+                int row_arg = -1;
+                for (int j = 0; j < i; j++) {
+                    double q = r2 * Di[j] - S[j];
+                    if (q < row_q) {
+                        row_q = q;
+                        row_arg = j;
+                    }
+                }
+                row_q -= S[i];
+                if (betterNJPair(row_q, i, row_arg, my_q, my_a, my_b)) {
+                    my_q = row_q;
+                    my_a = i;
+                    my_b = row_arg;
+                }
+            }
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+            if (betterNJPair(my_q, my_a, my_b, best_q, best_a, best_b)) {
+                best_q = my_q;
+                best_a = my_a;
+                best_b = my_b;
+            }
+        }
+
+        // join clusters a and b into a new cluster u stored in slot a
+        int a = best_a, b = best_b;
+        double dab = D[a*stride+b];
+        double la = 0.5 * (dab + (S[a] - S[b]) / r2);
+        double lb = dab - la;
+        double lambda = 0.5, vab = 0.0;
+        if (V) {
+            vab = V[a*stride+b];
+            if (vab != 0.0) {
+                double sum = 0.0;
+                for (k = 0; k < r; k++)
+                    if (k != a && k != b)
+                        sum += V[b*stride+k] - V[a*stride+k];
+                lambda = 0.5 + sum / (2.0 * r2 * vab);
+                if (lambda > 1.0) lambda = 1.0;
+                if (lambda < 0.0) lambda = 0.0;
+            }
+        }
+        Node *node = newNode();
+        node->addNeighbor(clusters[a], la);
+        clusters[a]->addNeighbor(node, la);
+        node->addNeighbor(clusters[b], lb);
+        clusters[b]->addNeighbor(node, lb);
+        clusters[a] = node;
+
+        double sum_u = 0.0;
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+: sum_u) if (r >= 1024)
+#endif
+        for (k = 0; k < r; k++) {
+            if (k == a || k == b) continue;
+            float dak = D[a*stride+k], dbk = D[b*stride+k];
+            float duk = lambda * (dak - la) + (1.0 - lambda) * (dbk - lb);
+            D[a*stride+k] = D[k*stride+a] = duk;
+            if (V)
+                V[a*stride+k] = V[k*stride+a] = lambda * V[a*stride+k] + (1.0 - lambda) * V[b*stride+k]
+                    - lambda * (1.0 - lambda) * vab;
+            S[k] += (double)duk - dak - dbk;
+            sum_u += duk;
+            if (rowarg[k] == a || rowarg[k] == b)
+                recompute[k] = true;
+            else if (duk < rowmin[k]) {
+                rowmin[k] = duk;
+                rowarg[k] = a;
+            }
+        }
+        S[a] = sum_u;
+        recompute[a] = true;
+
+        // move the last active cluster into the emptied slot b
+        int last = r - 1;
+        if (b != last) {
+            for (k = 0; k < last; k++) {
+                if (k == b) continue;
+                D[b*stride+k] = D[k*stride+b] = D[last*stride+k];
+                if (V)
+                    V[b*stride+k] = V[k*stride+b] = V[last*stride+k];
+            }
+            D[b*stride+b] = 0.0;
+            S[b] = S[last];
+            clusters[b] = clusters[last];
+            rowmin[b] = rowmin[last];
+            rowarg[b] = rowarg[last];
+            recompute[b] = recompute[last];
+            for (k = 0; k < last; k++)
+                if (rowarg[k] == last)
+                    rowarg[k] = b;
+        }
+    }
+
+    // connect the last three clusters to a central node
+    Node *center = newNode();
+    for (i = 0; i < 3; i++) {
+        int j = (i + 1) % 3;
+        k = (i + 2) % 3;
+        double len = 0.5 * (D[i*stride+j] + D[i*stride+k] - D[j*stride+k]);
+        center->addNeighbor(clusters[i], len);
+        clusters[i]->addNeighbor(center, len);
+    }
+
+    delete [] recompute;
+    delete [] rowarg;
+    delete [] rowmin;
+    delete [] S;
+    if (V)
+        aligned_free(V);
+    aligned_free(D);
+
+    root = first_leaf;
+    nodeNum = leafNum;
+    initializeTree();
+    current_it = current_it_back = NULL;
+    clearPartialLhPool();
+    if (isSuperTree()) {
+        ((PhyloSuperTree*) this)->mapTrees();
+    } else {
+    	clearAllPartialLH();
+    }
+}
+
 int PhyloTree::setNegativeBranch(bool force, double newlen, Node *node, Node *dad) {
     if (!node) node = root;
     int fixed = 0;
@@ -2796,8 +3311,8 @@ void PhyloTree::doNNI(NNIMove &move, bool clearLH) {
     PhyloNeighbor *node12_it = (PhyloNeighbor*) node1->findNeighbor(node2); // return neighbor of node1 which points to node 2
     PhyloNeighbor *node21_it = (PhyloNeighbor*) node2->findNeighbor(node1); // return neighbor of node2 which points to node 1
 
-    // reorient partial_lh before swap
-    if (params->lh_mem_save == LM_PER_NODE && !isSuperTree() && (sse == LK_EIGEN || sse == LK_EIGEN_SSE)) {
+    // reorient partial_lh before swap (not needed for the memory pool, which has no vector per node)
+    if (params->lh_mem_save == LM_PER_NODE && !lh_pool_size && !isSuperTree() && (sse == LK_EIGEN || sse == LK_EIGEN_SSE)) {
         node12_it->reorientPartialLh(node1);
         node21_it->reorientPartialLh(node2);
     }
@@ -2913,14 +3428,17 @@ NNIMove PhyloTree::getBestNNIForBran(PhyloNode *node1, PhyloNode *node2, NNIMove
 	}
 	assert(id == IT_NUM);
 
+	num_nni_evaluations++;
+	size_t start_allocs = aligned_alloc_count;
+
 	Neighbor *saved_nei[6];
-	// save Neighbor and allocate new Neighbor pointer
+	// save Neighbor and stand in a reused Neighbor from the NNI workspace
 	for (id = 0; id < IT_NUM; id++) {
 		saved_nei[id] = (*saved_it[id]);
-		*saved_it[id] = new PhyloNeighbor(saved_nei[id]->node, saved_nei[id]->length);
-		((PhyloNeighbor*) (*saved_it[id]))->partial_lh = nni_partial_lh + id*partial_lh_size;
-		((PhyloNeighbor*) (*saved_it[id]))->scale_num = nni_scale_num + id*scale_num_size;
-//		((PhyloNeighbor*) (*saved_it[id]))->scale_num = newScaleNum();
+		nni_neighbors[id] = PhyloNeighbor(saved_nei[id]->node, saved_nei[id]->length);
+		nni_neighbors[id].partial_lh = nni_partial_lh + id*partial_lh_size;
+		nni_neighbors[id].scale_num = nni_scale_num + id*scale_num_size;
+		*saved_it[id] = &nni_neighbors[id];
 	}
 
 	// get the Neighbor again since it is replaced for saving purpose
@@ -2929,12 +3447,10 @@ NNIMove PhyloTree::getBestNNIForBran(PhyloNode *node1, PhyloNode *node2, NNIMove
 
     int cnt;
 
-	//NNIMove nniMoves[2];
-    bool newNNIMoves = false;
+	NNIMove localMoves[2];
     if (!nniMoves) {
 		//   Initialize the 2 NNI moves
-    	newNNIMoves = true;
-    	nniMoves = new NNIMove[2];
+    	nniMoves = localMoves;
     	nniMoves[0].ptnlh = nniMoves[1].ptnlh = NULL;
     	nniMoves[0].node1 = NULL;
 
@@ -3039,7 +3555,6 @@ NNIMove PhyloTree::getBestNNIForBran(PhyloNode *node1, PhyloNode *node2, NNIMove
 		 if (*saved_it[id] == current_it) current_it = (PhyloNeighbor*) saved_nei[id];
 		 if (*saved_it[id] == current_it_back) current_it_back = (PhyloNeighbor*) saved_nei[id];
 
-		 delete (*saved_it[id]);
 		 (*saved_it[id]) = saved_nei[id];
 	 }
 //	 aligned_free(new_partial_lh);
@@ -3059,13 +3574,66 @@ NNIMove PhyloTree::getBestNNIForBran(PhyloNode *node1, PhyloNode *node2, NNIMove
 	 } else {
 		 res = nniMoves[1];
 	 }
-	if (newNNIMoves) {
-		delete [] nniMoves;
-	}
+	nni_heap_allocs += aligned_alloc_count - start_allocs;
 	return res;
 }
 
 
+void PhyloTree::attachNNIWorker(PhyloTree *master) {
+	assert(master->central_partial_lh && !master->lh_pool_size);
+	// shared with master, read-only except the nodes around the branch being evaluated
+	root = master->root;
+	leafNum = master->leafNum;
+	nodeNum = master->nodeNum;
+	branchNum = master->branchNum;
+	rooted = master->rooted;
+	aln = master->aln;
+	params = master->params;
+	model = master->model;
+	site_rate = master->site_rate;
+	model_factory = master->model_factory;
+	optimize_by_newton = master->optimize_by_newton;
+	central_partial_lh = master->central_partial_lh;
+	central_scale_num = master->central_scale_num;
+	tip_partial_lh = master->tip_partial_lh;
+	tip_partial_lh_computed = master->tip_partial_lh_computed;
+	ptn_freq = master->ptn_freq;
+	ptn_freq_computed = master->ptn_freq_computed;
+	ptn_invar = master->ptn_invar;
+	curScore = master->curScore;
+	current_it = current_it_back = NULL;
+	// setLikelihoodKernel() may re-allocate the partial likelihoods, which are master's here
+	copyLikelihoodKernel(master);
+
+	// private scratch buffers, same sizes as in initializeAllPartialLh()
+	if (!nni_partial_lh) {
+		size_t mem_size = get_safe_upper_limit(aln->size() + aln->num_states);
+		size_t nmix = (model_factory->fused_mix_rate) ? 1 : model->getNMixtures();
+		size_t IT_NUM = (params->nni5) ? 6 : 2;
+		_pattern_lh = aligned_alloc<double>(mem_size);
+		_pattern_lh_cat = aligned_alloc<double>(mem_size * site_rate->getNDiscreteRate() * nmix);
+		theta_all = aligned_alloc<double>(mem_size * model->num_states * site_rate->getNRate() * nmix);
+		nni_partial_lh = aligned_alloc<double>(IT_NUM*getPartialLhStorage(mem_size * model->num_states * site_rate->getNRate() * nmix));
+		nni_scale_num = aligned_alloc<UBYTE>(IT_NUM*mem_size);
+		nni_neighbors.resize(6, PhyloNeighbor(NULL, 0.0));
+	}
+	getKernelBuffer(getKernelBufferSize());
+}
+
+void PhyloTree::detachNNIWorker() {
+	root = NULL;
+	aln = NULL;
+	model = NULL;
+	site_rate = NULL;
+	model_factory = NULL;
+	central_partial_lh = NULL;
+	central_scale_num = NULL;
+	tip_partial_lh = NULL;
+	ptn_freq = NULL;
+	ptn_invar = NULL;
+	current_it = current_it_back = NULL;
+}
+
 /****************************************************************************
  Subtree Pruning and Regrafting by maximum likelihood
  ****************************************************************************/
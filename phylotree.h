@@ -39,6 +39,9 @@
 
 extern int instruction_set;
 
+/** number of aligned_alloc() calls so far, summed over all threads */
+extern size_t aligned_alloc_count;
+
 
 const double TOL_BRANCH_LEN = 0.000001; // NEVER TOUCH THIS CONSTANT AGAIN PLEASE!
 const double TOL_LIKELIHOOD = 0.001; // NEVER TOUCH THIS CONSTANT AGAIN PLEASE!
@@ -52,13 +55,20 @@ const double TOL_LIKELIHOOD_PARAMOPT = 0.001; // BQM: newly introduced for Model
 #define SCALING_THRESHOLD_INVER 115792089237316195423570985008687907853269984665640564039457584007913129639936.0
 #define SCALING_THRESHOLD (1.0/SCALING_THRESHOLD_INVER)
 #define LOG_SCALING_THRESHOLD log(SCALING_THRESHOLD)
+// 2^32: partial likelihoods stored as float (-float option) are rescaled much earlier
+#define SCALING_THRESHOLD_FLOAT_INVER 4294967296.0
+#define SCALING_THRESHOLD_FLOAT (1.0/SCALING_THRESHOLD_FLOAT_INVER)
+#define LOG_SCALING_THRESHOLD_FLOAT log(SCALING_THRESHOLD_FLOAT)
 
 const int SPR_DEPTH = 2;
 
 //using namespace Eigen;
 
 inline size_t get_safe_upper_limit(size_t cur_limit) {
-	if (instruction_set >= 7)
+	if (instruction_set >= 9)
+		// AVX-512
+		return ((cur_limit+7)/8)*8;
+	else if (instruction_set >= 7)
 		// AVX
 		return ((cur_limit+3)/4)*4;
 	else
@@ -67,7 +77,10 @@ inline size_t get_safe_upper_limit(size_t cur_limit) {
 }
 
 inline size_t get_safe_upper_limit_float(size_t cur_limit) {
-	if (instruction_set >= 7)
+	if (instruction_set >= 9)
+		// AVX-512
+		return ((cur_limit+15)/16)*16;
+	else if (instruction_set >= 7)
 		// AVX
 		return ((cur_limit+7)/8)*8;
 	else
@@ -89,8 +102,12 @@ inline size_t get_safe_upper_limit_float(size_t cur_limit) {
 
 template< class T>
 inline T *aligned_alloc(size_t size) {
-	size_t MEM_ALIGNMENT = (instruction_set >= 7) ? 32 : 16;
+	size_t MEM_ALIGNMENT = (instruction_set >= 9) ? 64 : ((instruction_set >= 7) ? 32 : 16);
     void *mem;
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+    aligned_alloc_count++;
 
 #if defined WIN32 || defined _WIN32 || defined __WIN32__
     #if (defined(__MINGW32__) || defined(__clang__)) && defined(BINARY32)
@@ -489,14 +506,47 @@ public:
     typedef BootValType (PhyloTree::*DotProductType)(BootValType *x, BootValType *y, int size);
     DotProductType dotProduct;
 
+    /**
+        dot products of x with all rows of a matrix (matrix-vector product)
+        @param x vector of length size, padded to a multiple of the vector size
+        @param mat row-major matrix with nrows rows
+        @param stride distance between consecutive rows
+        @param[out] res nrows dot products
+    */
+    template <class Numeric, class VectorClass, const int VCSIZE>
+    void dotProductMultiSIMD(Numeric *x, Numeric *mat, size_t stride, int nrows, int size, Numeric *res);
+
+    typedef void (PhyloTree::*DotProductMultiType)(BootValType *x, BootValType *mat, size_t stride, int nrows, int size, BootValType *res);
+    DotProductMultiType dotProductMulti;
+
     typedef double (PhyloTree::*DotProductDoubleType)(double *x, double *y, int size);
     DotProductDoubleType dotProductDouble;
 
+    /**
+        dot products of all rows of mat1 with all rows of mat2 (matrix-matrix product), not
+        parallelized such that several threads can call it for different blocks
+        @param mat1 row-major matrix with nrows1 rows
+        @param mat2 row-major matrix with nrows2 rows
+        @param stride distance between consecutive rows, the rows are padded with zeros up to it
+        @param[out] res dot products of size nrows1 x nrows2
+    */
+    template <class Numeric, class VectorClass, const int VCSIZE>
+    void dotProductMatrixSIMD(Numeric *mat1, int nrows1, Numeric *mat2, int nrows2, size_t stride, Numeric *res);
+
+    typedef void (PhyloTree::*DotProductMatrixType)(double *mat1, int nrows1, double *mat2, int nrows2, size_t stride, double *res);
+    DotProductMatrixType dotProductMatrix;
+
 #if defined(BINARY32) || defined(__NOAVX__)
     void setDotProductAVX() {}
 #else
     void setDotProductAVX();
 #endif
+
+#if defined(BINARY32) || defined(__NOAVX__) || defined(__NOAVX512__)
+    void setDotProductAVX512() {}
+#else
+    void setDotProductAVX512();
+#endif
     /**
             this function return the parsimony or likelihood score of the tree. Default is
             to compute the parsimony score. Override this function if you define a new
@@ -611,6 +661,62 @@ public:
      */
     void computeAllPartialLh(PhyloNode *node = NULL, PhyloNode *dad = NULL);
 
+    /**
+     * @param block_size number of doubles per partial likelihood vector
+     * @param tip_partial_lh_size number of doubles for tip_partial_lh
+     * @return number of partial likelihood slots that fit into the -mem limit,
+     * or 0 if the limit allows one vector per internal node (no pool needed)
+     */
+    size_t computePartialLhPoolSize(size_t block_size, uint64_t tip_partial_lh_size);
+
+    /**
+     * compute the partial likelihood of a subtree when vectors come from the memory-capped pool:
+     * children are computed first (larger subtrees first) and pinned, so that they are not evicted
+     * while their siblings or the subtree itself are computed
+     * @param dad_branch the branch leading to the subtree
+     * @param dad its dad, used to direct the tranversal
+     */
+    void computePartialLikelihoodPool(PhyloNeighbor *dad_branch, PhyloNode *dad);
+
+    /**
+     * recursive part of computePartialLikelihoodPool(), lh_pool_pending must be filled for the subtree
+     */
+    void computePartialLikelihoodPoolSubtree(PhyloNeighbor *dad_branch, PhyloNode *dad);
+
+    /**
+     * count the partial likelihood vectors to compute in a subtree and store the count of every
+     * pending subtree in lh_pool_pending, only descending into branches not computed yet
+     * @return number of vectors to compute, 0 if the subtree is already computed
+     */
+    int countPendingPartialLh(PhyloNeighbor *dad_branch, PhyloNode *dad);
+
+    /**
+     * assign a free pool slot to dad_branch, evicting the least recently used unpinned vector if needed
+     */
+    void assignPartialLhSlot(PhyloNeighbor *dad_branch);
+
+    /** remove a slot from the LRU list of unpinned slots */
+    void unlinkPartialLhSlot(int slot);
+
+    /** append a slot to the LRU list of unpinned slots as the most recently used */
+    void appendPartialLhSlot(int slot);
+
+    /**
+     * @return pool slot held by nei, -1 if none
+     */
+    int getPartialLhSlot(PhyloNeighbor *nei);
+
+    /**
+     * change the pin count of the pool slot held by nei (if any) and mark it as recently used
+     * @param delta +1 to pin, -1 to unpin, 0 to only move it to the end of the LRU list
+     */
+    void pinPartialLh(PhyloNeighbor *nei, int delta);
+
+    /**
+     * release all pool slots, called when the tree nodes are freed
+     */
+    void clearPartialLhPool();
+
     /**
      * compute all partial parsimony vector if not computed before
      */
@@ -624,6 +730,22 @@ public:
     /** get the number of bytes occupied by partial_lh */
     int getPartialLhBytes();
 
+    /**
+     * @param entries number of partial likelihood entries
+     * @return number of doubles needed to store them (half as many if partial_lh_float)
+     */
+    uint64_t getPartialLhStorage(uint64_t entries);
+
+    /**
+     * scratch memory of the likelihood kernels, used instead of allocating temporaries on every call
+     * @param size number of doubles needed
+     * @return kernel_buffer, enlarged if it holds fewer than size doubles
+     */
+    double *getKernelBuffer(size_t size);
+
+    /** @return number of doubles of kernel_buffer needed by the kernels on a bifurcating tree */
+    size_t getKernelBufferSize();
+
     /**
             allocate memory for a scale num vector
      */
@@ -670,7 +792,7 @@ public:
 
     void computeSitemodelPartialLikelihoodEigen(PhyloNeighbor *dad_branch, PhyloNode *dad = NULL);
 
-    template <class VectorClass, const int VCSIZE, const int nstates>
+    template <class Numeric, class VectorClass, const int VCSIZE, const int nstates>
     void computePartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad = NULL);
 
     template <class VectorClass, const int VCSIZE, const int nstates>
@@ -682,6 +804,18 @@ public:
     template <class VectorClass, const int VCSIZE, const int nstates>
     void computeSitemodelPartialLikelihoodEigenSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad = NULL);
 
+    /**
+            SIMD partial likelihood at a multifurcating node, shared by the normal, mixture and mixrate kernels.
+            The subtrees below dad_branch must already be computed.
+            @param dad_branch the branch leading to the subtree
+            @param dad its dad, used to direct the tranversal
+            @param nmixture number of eigen-decompositions (1 for non-mixture models)
+            @param ncat_mixture number of consecutive rate categories sharing the same eigen-decomposition
+     */
+    template <class Numeric, class VectorClass, const int VCSIZE, const int nstates>
+    void computeMultifurcatingPartialLikelihoodSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad,
+    		size_t nmixture, size_t ncat_mixture);
+
     /****************************************************************************
             computing likelihood on a branch
      ****************************************************************************/
@@ -715,7 +849,7 @@ public:
 
     double computeSitemodelLikelihoodBranchEigen(PhyloNeighbor *dad_branch, PhyloNode *dad);
 
-    template <class VectorClass, const int VCSIZE, const int nstates>
+    template <class Numeric, class VectorClass, const int VCSIZE, const int nstates>
     double computeLikelihoodBranchEigenSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad);
 
     template <class VectorClass, const int VCSIZE, const int nstates>
@@ -742,7 +876,7 @@ public:
     typedef double (PhyloTree::*ComputeLikelihoodFromBufferType)();
     ComputeLikelihoodFromBufferType computeLikelihoodFromBufferPointer;
 
-    template <class VectorClass, const int VCSIZE, const int nstates>
+    template <class Numeric, class VectorClass, const int VCSIZE, const int nstates>
     double computeLikelihoodFromBufferEigenSIMD();
 
     template <class VectorClass, const int VCSIZE, const int nstates>
@@ -954,7 +1088,7 @@ public:
 
     void computeSitemodelLikelihoodDervEigen(PhyloNeighbor *dad_branch, PhyloNode *dad, double &df, double &ddf);
 
-    template <class VectorClass, const int VCSIZE, const int nstates>
+    template <class Numeric, class VectorClass, const int VCSIZE, const int nstates>
     void computeLikelihoodDervEigenSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad, double &df, double &ddf);
 
     template <class VectorClass, const int VCSIZE, const int nstates>
@@ -1004,6 +1138,70 @@ public:
      */
     int computeParsimonyTree(const char *out_prefix, Alignment *alignment);
 
+    /**
+     * create a stand-alone joint node with three neighbors, used to join partial parsimony
+     * vectors without touching the tree. Each thread needs its own joint.
+     * @return the joint node
+     */
+    PhyloNode *newParsimonyJoint();
+
+    /**
+     * delete a joint created by newParsimonyJoint()
+     * @param joint the joint node
+     */
+    void deleteParsimonyJoint(PhyloNode *joint);
+
+    /**
+     * join two partial parsimony vectors via a joint node, read-only on the input vectors
+     * @param joint joint node from newParsimonyJoint()
+     * @param left_pars, right_pars partial parsimony vectors of the two subtrees to join
+     * @param joint_pars (OUT) partial parsimony vector of the joined subtree
+     * @param end_pars if not NULL, partial parsimony vector of a third subtree attached to the joint
+     * @return parsimony score of the three subtrees joined if end_pars is given, 0 otherwise
+     */
+    int computeJointParsimony(PhyloNode *joint, UINT *left_pars, UINT *right_pars, UINT *joint_pars, UINT *end_pars = NULL);
+
+    /**
+     * compute partial parsimony vectors that were invalidated by inserting added_node,
+     * in rounds of increasing distance to added_node; vectors of one round are computed in parallel
+     * @param added_node the node last inserted into the tree
+     */
+    void computePartialParsimonyAround(PhyloNode *added_node);
+
+    /**
+     * improve a parsimony tree by SPR moves: all moves are scored in parallel on the current
+     * tree, then improving moves are re-checked and applied one by one
+     * @param radius maximal distance of the regrafting branch from the pruning point
+     * @return parsimony score of the resulting tree
+     */
+    int optimizeSPRParsimony(int radius);
+
+    /**
+     * invalidate the partial parsimony vectors pointing towards node, except the one from dad.
+     * Stops at vectors already invalid, as all vectors further out are invalid then as well
+     * @param force invalidate the vectors next to node even if they are marked invalid
+     */
+    void clearReversePartialParsimony(PhyloNode *node, PhyloNode *dad, bool force);
+
+    /**
+     * find the best regrafting branch within radius for the subtree of node s pruned at its neighbor p
+     * @param p pruning point, must be an internal node
+     * @param s root of the pruned subtree, neighbor of p
+     * @param radius maximal distance of the regrafting branch
+     * @param joint joint node of the calling thread
+     * @param buffers radius+1 partial parsimony vectors of the calling thread
+     * @param best_node, best_dad (OUT) ends of the best regrafting branch, NULL if no improvement
+     * @return the score gain of the best move, 0 if no improvement
+     */
+    int evaluateSPRParsimony(PhyloNode *p, PhyloNode *s, int radius, PhyloNode *joint, UINT **buffers,
+            PhyloNode* &best_node, PhyloNode* &best_dad);
+
+    /**
+     * recursive helper for evaluateSPRParsimony(): score regrafting on branch (dad,node) and beyond
+     */
+    void searchSPRParsimony(PhyloNode *node, PhyloNode *dad, UINT *dad_pars, UINT *subtree_pars, int depth, int radius,
+            PhyloNode *joint, UINT **buffers, int &best_score, PhyloNode* &best_node, PhyloNode* &best_dad);
+
 
     /****************************************************************************
             Branch length optimization by maximum likelihood
@@ -1160,6 +1358,22 @@ public:
      */
     virtual NNIMove getBestNNIForBran(PhyloNode *node1, PhyloNode *node2, NNIMove *nniMoves = NULL);
 
+    /**
+       turn this (empty) tree into a worker view of master for concurrent NNI evaluation:
+       topology, alignment, model and partial likelihoods are shared with master,
+       only the scratch buffers written by getBestNNIForBran (theta_all, _pattern_lh,
+       nni_partial_lh, nni_scale_num) are private. Buffers are kept across calls.
+       All partial likelihoods of master must be computed beforehand.
+       @param master the tree to evaluate NNIs on
+     */
+    void attachNNIWorker(PhyloTree *master);
+
+    /**
+       release the data shared with master by attachNNIWorker, so that deleting
+       this worker frees only its own scratch buffers
+     */
+    void detachNNIWorker();
+
     /**
             Do an NNI
             @param move reference to an NNI move object containing information about the move
@@ -1274,6 +1488,14 @@ public:
             @param dist_file distance matrix file
      */
     void computeBioNJ(Params &params, Alignment *alignment, string &dist_file);
+
+    /**
+            build a NJ or BIONJ tree directly from an in-memory distance matrix, replacing
+            the current tree. Leaf IDs are the sequence IDs of the alignment.
+            @param dist_mat nseq*nseq distance matrix in row-major order
+            @param bionj TRUE for BIONJ (Gascuel 1997), FALSE for classic Neighbor-Joining
+     */
+    void computeNJTree(double *dist_mat, bool bionj = true);
     /**
             Neighbor-joining/parsimony tree might contain negative branch length. This
             function will fix this.
@@ -1454,11 +1676,24 @@ public:
 
     virtual void setLikelihoodKernel(LikelihoodKernel lk);
 
+    /**
+        take over the likelihood and parsimony kernels already chosen by master,
+        without touching the partial likelihood buffers (which may be shared with master)
+        @param master tree whose kernels are copied
+     */
+    void copyLikelihoodKernel(PhyloTree *master);
+
 #if defined(BINARY32) || defined(__NOAVX__)
     virtual void setLikelihoodKernelAVX() {}
 #else
     virtual void setLikelihoodKernelAVX();
 #endif
+
+#if defined(BINARY32) || defined(__NOAVX__) || defined(__NOAVX512__)
+    virtual void setLikelihoodKernelAVX512() {}
+#else
+    virtual void setLikelihoodKernelAVX512();
+#endif
     /****************************************************************************
             Public variables
      ****************************************************************************/
@@ -1488,6 +1723,18 @@ public:
      */
     LikelihoodKernel sse;
 
+    /**
+     *      TRUE if partial_lh vectors are stored as float instead of double (see Params::lk_float),
+     *      only supported by the normal SIMD kernels
+     */
+    bool partial_lh_float;
+
+    /**
+     *      TRUE to keep partial_lh vectors in double precision even if Params::lk_float is set,
+     *      e.g. for the final evaluation after a single-precision tree search
+     */
+    bool force_double_lh;
+
     /**
      * for UpperBounds: Initial tree log-likelihood
      */
@@ -1540,6 +1787,12 @@ public:
 
 	size_t num_partial_lh_computations;
 
+	/** number of branches evaluated by getBestNNIForBran */
+	size_t num_nni_evaluations;
+
+	/** number of aligned_alloc() calls while getBestNNIForBran was running, see aligned_alloc_count */
+	size_t nni_heap_allocs;
+
 	/** remove identical sequences from the tree */
     virtual void removeIdenticalSeqs(Params &params);
 
@@ -1740,6 +1993,45 @@ protected:
     UBYTE *central_scale_num;
     UBYTE *nni_scale_num; // used for NNI functions
 
+    /**
+            neighbor objects standing in for the branches around an NNI in getBestNNIForBran,
+            allocated once and reused for every evaluated branch
+     */
+    vector<PhyloNeighbor> nni_neighbors;
+
+    /** scratch memory of the likelihood kernels, see getKernelBuffer() */
+    double *kernel_buffer;
+
+    /** number of doubles in kernel_buffer */
+    size_t kernel_buffer_size;
+
+    /**
+            number of partial_lh slots in central_partial_lh if memory is capped (-mem), 0 otherwise.
+            In this case partial_lh vectors are assigned on demand and evicted in LRU order.
+     */
+    size_t lh_pool_size;
+
+    /** number of doubles per slot when the pool was allocated */
+    size_t lh_pool_block_size;
+
+    /** branch currently holding each slot, NULL if the slot is free */
+    vector<PhyloNeighbor*> lh_pool_owner;
+
+    /** number of pending computations needing each slot; pinned slots are never evicted */
+    vector<int> lh_pool_pin;
+
+    /** free slots, taken from the back */
+    vector<int> lh_pool_free;
+
+    /**
+     * doubly-linked list of the unpinned slots held by a branch, from least to most recently used;
+     * index lh_pool_size is the head of the list
+     */
+    vector<int> lh_pool_prev, lh_pool_next;
+
+    /** number of partial likelihood vectors to compute below each node, see countPendingPartialLh() */
+    vector<int> lh_pool_pending;
+
     /**
             the main memory storing all partial parsimony states for all neighbors of the tree.
             The variable partial_pars in PhyloNeighbor will be assigned to a region inside this variable.
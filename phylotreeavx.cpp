@@ -24,11 +24,14 @@ void PhyloTree::setParsimonyKernelAVX() {
 void PhyloTree::setDotProductAVX() {
 #ifdef BOOT_VAL_FLOAT
 		dotProduct = &PhyloTree::dotProductSIMD<float, Vec8f, 8>;
+		dotProductMulti = &PhyloTree::dotProductMultiSIMD<float, Vec8f, 8>;
 #else
 		dotProduct = &PhyloTree::dotProductSIMD<double, Vec4d, 4>;
+		dotProductMulti = &PhyloTree::dotProductMultiSIMD<double, Vec4d, 4>;
 #endif
 
         dotProductDouble = &PhyloTree::dotProductSIMD<double, Vec4d, 4>;
+        dotProductMatrix = &PhyloTree::dotProductMatrixSIMD<double, Vec4d, 4>;
 }
 
 void PhyloTree::setLikelihoodKernelAVX() {
@@ -74,10 +77,17 @@ void PhyloTree::setLikelihoodKernelAVX() {
 //		        cout << "Fast-AVX-mixture" << endl;
 			}
 		} else {
-			computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<Vec4d, 4, 4>;
-			computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<Vec4d, 4, 4>;
-			computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<Vec4d, 4, 4>;
-			computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<Vec4d, 4, 4>;
+			if (partial_lh_float) {
+				computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<float, Vec4d, 4, 4>;
+				computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<float, Vec4d, 4, 4>;
+				computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<float, Vec4d, 4, 4>;
+				computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<float, Vec4d, 4, 4>;
+			} else {
+				computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<double, Vec4d, 4, 4>;
+				computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<double, Vec4d, 4, 4>;
+				computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<double, Vec4d, 4, 4>;
+				computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<double, Vec4d, 4, 4>;
+			}
 //	        cout << "Fast-AVX" << endl;
 		}
 		break;
@@ -97,10 +107,17 @@ void PhyloTree::setLikelihoodKernelAVX() {
 //		        cout << "Fast-AVX-mixture" << endl;
 			}
 		} else {
-			computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<Vec4d, 4, 20>;
-			computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<Vec4d, 4, 20>;
-			computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<Vec4d, 4, 20>;
-			computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<Vec4d, 4, 20>;
+			if (partial_lh_float) {
+				computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<float, Vec4d, 4, 20>;
+				computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<float, Vec4d, 4, 20>;
+				computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<float, Vec4d, 4, 20>;
+				computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<float, Vec4d, 4, 20>;
+			} else {
+				computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<double, Vec4d, 4, 20>;
+				computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<double, Vec4d, 4, 20>;
+				computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<double, Vec4d, 4, 20>;
+				computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<double, Vec4d, 4, 20>;
+			}
 //	        cout << "Fast-AVX" << endl;
 		}
 		break;
@@ -120,10 +137,17 @@ void PhyloTree::setLikelihoodKernelAVX() {
 //		        cout << "Fast-AVX-mixture" << endl;
 			}
 		} else {
-			computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<Vec4d, 4, 64>;
-			computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<Vec4d, 4, 64>;
-			computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<Vec4d, 4, 64>;
-			computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<Vec4d, 4, 64>;
+			if (partial_lh_float) {
+				computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<float, Vec4d, 4, 64>;
+				computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<float, Vec4d, 4, 64>;
+				computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<float, Vec4d, 4, 64>;
+				computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<float, Vec4d, 4, 64>;
+			} else {
+				computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<double, Vec4d, 4, 64>;
+				computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<double, Vec4d, 4, 64>;
+				computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<double, Vec4d, 4, 64>;
+				computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<double, Vec4d, 4, 64>;
+			}
 //	        cout << "Fast-AVX" << endl;
 		}
 		break;
@@ -0,0 +1,74 @@
+/*
+ * phylotreeavx512.cpp
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+// Vec8d and Vec16f are only declared when 512-bit vectors are enabled
+#define MAX_VECTOR_SIZE 512
+
+#include "phylokernel.h"
+#include "phylokernelmixture.h"
+#include "phylokernelmixrate.h"
+#include "phylokernelsitemodel.h"
+#include "vectorclass/vectorclass.h"
+
+#ifndef __AVX512F__
+#error "You must compile this file with AVX-512 enabled!"
+#endif
+
+void PhyloTree::setDotProductAVX512() {
+#ifdef BOOT_VAL_FLOAT
+		dotProduct = &PhyloTree::dotProductSIMD<float, Vec16f, 16>;
+		dotProductMulti = &PhyloTree::dotProductMultiSIMD<float, Vec16f, 16>;
+#else
+		dotProduct = &PhyloTree::dotProductSIMD<double, Vec8d, 8>;
+		dotProductMulti = &PhyloTree::dotProductMultiSIMD<double, Vec8d, 8>;
+#endif
+
+        dotProductDouble = &PhyloTree::dotProductSIMD<double, Vec8d, 8>;
+        dotProductMatrix = &PhyloTree::dotProductMatrixSIMD<double, Vec8d, 8>;
+}
+
+void PhyloTree::setLikelihoodKernelAVX512() {
+    // kernels vectorize over states, thus Vec8d only fits when num_states is divisible by 8;
+    // all other cases (DNA, protein, site-specific models) keep the AVX kernels
+    if (model_factory && model_factory->model->isSiteSpecificModel()) {
+        setLikelihoodKernelAVX();
+        return;
+    }
+
+	switch(aln->num_states) {
+	case 64:
+		setParsimonyKernelAVX();
+		if (model_factory && model_factory->model->isMixture()) {
+			if (model_factory->fused_mix_rate) {
+				computeLikelihoodBranchPointer = &PhyloTree::computeMixrateLikelihoodBranchEigenSIMD<Vec8d, 8, 64>;
+				computeLikelihoodDervPointer = &PhyloTree::computeMixrateLikelihoodDervEigenSIMD<Vec8d, 8, 64>;
+				computePartialLikelihoodPointer = &PhyloTree::computeMixratePartialLikelihoodEigenSIMD<Vec8d, 8, 64>;
+				computeLikelihoodFromBufferPointer = &PhyloTree::computeMixrateLikelihoodFromBufferEigenSIMD<Vec8d, 8, 64>;
+			} else {
+				computeLikelihoodBranchPointer = &PhyloTree::computeMixtureLikelihoodBranchEigenSIMD<Vec8d, 8, 64>;
+				computeLikelihoodDervPointer = &PhyloTree::computeMixtureLikelihoodDervEigenSIMD<Vec8d, 8, 64>;
+				computePartialLikelihoodPointer = &PhyloTree::computeMixturePartialLikelihoodEigenSIMD<Vec8d, 8, 64>;
+				computeLikelihoodFromBufferPointer = &PhyloTree::computeMixtureLikelihoodFromBufferEigenSIMD<Vec8d, 8, 64>;
+			}
+		} else {
+			if (partial_lh_float) {
+				computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<float, Vec8d, 8, 64>;
+				computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<float, Vec8d, 8, 64>;
+				computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<float, Vec8d, 8, 64>;
+				computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<float, Vec8d, 8, 64>;
+			} else {
+				computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<double, Vec8d, 8, 64>;
+				computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<double, Vec8d, 8, 64>;
+				computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<double, Vec8d, 8, 64>;
+				computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<double, Vec8d, 8, 64>;
+			}
+		}
+		break;
+	default:
+		setLikelihoodKernelAVX();
+		break;
+	}
+}
@@ -11,6 +11,10 @@
 #include "vectorclass/vectorclass.h"
 #include "phylosupertree.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 /***********************************************************/
 /****** optimized version of parsimony kernel **************/
 /***********************************************************/
@@ -342,6 +346,23 @@ int PhyloTree::computeParsimonyTree(const char *out_prefix, Alignment *alignment
     UINT *tmp_partial_pars;
     tmp_partial_pars = newBitsBlock();
 
+    // parallel mode: insertion branches are scored concurrently, each thread joins the
+    // (read-only) partial parsimony vectors of a branch with the new taxon via its own joint
+    bool parallel_insert = params && params->pars_parallel && !isSuperTree();
+    vector<PhyloNode*> joints;
+    vector<UINT*> joint_pars;
+    if (parallel_insert) {
+        int num_threads = 1;
+#ifdef _OPENMP
+        num_threads = omp_get_max_threads();
+#endif
+        for (int i = 0; i < num_threads; i++) {
+            joints.push_back(newParsimonyJoint());
+            joint_pars.push_back(newBitsBlock());
+        }
+    }
+    PhyloNode *last_added = NULL;
+
     // stepwise adding the next taxon
     for (leafNum = 3; leafNum < size; leafNum++) {
         if (verbose_mode >= VB_MAX)
@@ -366,13 +387,53 @@ int PhyloTree::computeParsimonyTree(const char *out_prefix, Alignment *alignment
         added_node->addNeighbor((Node*) 1, -1.0);
         added_node->addNeighbor((Node*) 2, -1.0);
 
-        for (int nodeid = 0; nodeid < nodes1.size(); nodeid++) {
-            int score = addTaxonMPFast(new_taxon, added_node, nodes1[nodeid], nodes2[nodeid]);
-            if (score < best_pars_score) {
-                best_pars_score = score;
-                target_node = (PhyloNode*)nodes1[nodeid];
-                target_dad = (PhyloNode*)nodes2[nodeid];
-                memcpy(new_taxon_partial_pars, tmp_partial_pars, pars_block_size*sizeof(UINT));
+        if (parallel_insert) {
+            int num_branches = nodes1.size();
+            int nodeid;
+            if (last_added)
+                computePartialParsimonyAround(last_added);
+            // vectors not reached from last_added (initial tree) are computed here
+            for (nodeid = 0; nodeid < num_branches; nodeid++) {
+                computePartialParsimony((PhyloNeighbor*)nodes2[nodeid]->findNeighbor(nodes1[nodeid]), (PhyloNode*)nodes2[nodeid]);
+                computePartialParsimony((PhyloNeighbor*)nodes1[nodeid]->findNeighbor(nodes2[nodeid]), (PhyloNode*)nodes1[nodeid]);
+            }
+            PhyloNeighbor *taxon_nei = (PhyloNeighbor*)added_node->findNeighbor(new_taxon);
+            computePartialParsimony(taxon_nei, added_node);
+            IntVector scores(num_branches);
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+            {
+                int thread_id = 0;
+#ifdef _OPENMP
+                thread_id = omp_get_thread_num();
+#pragma omp for schedule(static)
+#endif
+                for (int i = 0; i < num_branches; i++)
+                    scores[i] = computeJointParsimony(joints[thread_id],
+                        ((PhyloNeighbor*)nodes2[i]->findNeighbor(nodes1[i]))->partial_pars,
+                        ((PhyloNeighbor*)nodes1[i]->findNeighbor(nodes2[i]))->partial_pars,
+                        joint_pars[thread_id], taxon_nei->partial_pars);
+            }
+            int best_id = 0;
+            for (nodeid = 1; nodeid < num_branches; nodeid++)
+                if (scores[nodeid] < scores[best_id])
+                    best_id = nodeid;
+            // redo the best insertion on the tree to obtain its partial parsimony vector
+            addTaxonMPFast(new_taxon, added_node, nodes1[best_id], nodes2[best_id]);
+            best_pars_score = scores[best_id];
+            target_node = (PhyloNode*)nodes1[best_id];
+            target_dad = (PhyloNode*)nodes2[best_id];
+            memcpy(new_taxon_partial_pars, tmp_partial_pars, pars_block_size*sizeof(UINT));
+        } else {
+            for (int nodeid = 0; nodeid < nodes1.size(); nodeid++) {
+                int score = addTaxonMPFast(new_taxon, added_node, nodes1[nodeid], nodes2[nodeid]);
+                if (score < best_pars_score) {
+                    best_pars_score = score;
+                    target_node = (PhyloNode*)nodes1[nodeid];
+                    target_dad = (PhyloNode*)nodes2[nodeid];
+                    memcpy(new_taxon_partial_pars, tmp_partial_pars, pars_block_size*sizeof(UINT));
+                }
             }
         }
         
@@ -403,13 +464,21 @@ int PhyloTree::computeParsimonyTree(const char *out_prefix, Alignment *alignment
 
         target_dad->clearReversePartialLh(added_node);
         target_node->clearReversePartialLh(added_node);
-
+        last_added = added_node;
     }
 
+    for (int i = 0; i < joints.size(); i++) {
+        aligned_free(joint_pars[i]);
+        deleteParsimonyJoint(joints[i]);
+    }
     aligned_free(tmp_partial_pars);
     
     assert(index == 4*leafNum-6);
 
+    // like the PLL parsimony trees, refine by SPR within -sprrad (default 6); -sprrad 0 skips it
+    if (parallel_insert && params->sprDist > 0)
+        best_pars_score = optimizeSPRParsimony(params->sprDist);
+
     nodeNum = 2 * leafNum - 2;
     initializeTree();
 
@@ -463,3 +532,251 @@ int PhyloTree::addTaxonMPFast(Node *added_taxon, Node* added_node, Node* node, N
     return score;
 
 }
+
+/****************************************************************************
+ Parallel helpers and SPR refinement for parsimony trees
+ ****************************************************************************/
+
+PhyloNode *PhyloTree::newParsimonyJoint() {
+    PhyloNode *joint = (PhyloNode*)newNode();
+    for (int i = 0; i < 3; i++) {
+        Node *end = newNode();
+        joint->addNeighbor(end, -1.0);
+        end->addNeighbor(joint, -1.0);
+    }
+    return joint;
+}
+
+void PhyloTree::deleteParsimonyJoint(PhyloNode *joint) {
+    for (int i = 0; i < 3; i++)
+        delete joint->neighbors[i]->node;
+    delete joint;
+}
+
+int PhyloTree::computeJointParsimony(PhyloNode *joint, UINT *left_pars, UINT *right_pars, UINT *joint_pars, UINT *end_pars) {
+    PhyloNeighbor *left = (PhyloNeighbor*)joint->neighbors[0];
+    PhyloNeighbor *right = (PhyloNeighbor*)joint->neighbors[1];
+    PhyloNeighbor *end = (PhyloNeighbor*)joint->neighbors[2];
+    PhyloNode *end_node = (PhyloNode*)end->node;
+    PhyloNeighbor *joint_nei = (PhyloNeighbor*)end_node->neighbors[0];
+    left->partial_pars = left_pars;
+    left->partial_lh_computed = 2;
+    right->partial_pars = right_pars;
+    right->partial_lh_computed = 2;
+    joint_nei->partial_pars = joint_pars;
+    joint_nei->partial_lh_computed = 0;
+    computePartialParsimony(joint_nei, end_node);
+    if (!end_pars)
+        return 0;
+    end->partial_pars = end_pars;
+    end->partial_lh_computed = 2;
+    return computeParsimonyBranch(end, joint);
+}
+
+void PhyloTree::computePartialParsimonyAround(PhyloNode *added_node) {
+    // a vector pointing to a node at distance d from added_node only depends on vectors
+    // pointing to nodes at distance d-1 and on valid vectors of disjoint subtrees
+    NodeVector frontier, frontier_dad;
+    frontier.push_back(added_node);
+    frontier_dad.push_back(NULL);
+    while (!frontier.empty()) {
+        vector<PhyloNeighbor*> level_nei;
+        vector<PhyloNode*> level_dad;
+        NodeVector next, next_dad;
+        for (int i = 0; i < frontier.size(); i++) {
+            Node *node = frontier[i];
+            FOR_NEIGHBOR_IT(node, frontier_dad[i], it) {
+                PhyloNeighbor *nei = (PhyloNeighbor*)(*it)->node->findNeighbor(node);
+                if ((nei->partial_lh_computed & 2) == 0) {
+                    level_nei.push_back(nei);
+                    level_dad.push_back((PhyloNode*)(*it)->node);
+                }
+                next.push_back((*it)->node);
+                next_dad.push_back(node);
+            }
+        }
+        int num_nei = level_nei.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) if(num_nei > 1)
+#endif
+        for (int i = 0; i < num_nei; i++)
+            computePartialParsimony(level_nei[i], level_dad[i]);
+        frontier.swap(next);
+        frontier_dad.swap(next_dad);
+    }
+}
+
+void PhyloTree::searchSPRParsimony(PhyloNode *node, PhyloNode *dad, UINT *dad_pars, UINT *subtree_pars, int depth, int radius,
+        PhyloNode *joint, UINT **buffers, int &best_score, PhyloNode* &best_node, PhyloNode* &best_dad) {
+    PhyloNeighbor *node_nei = (PhyloNeighbor*)dad->findNeighbor(node);
+    computePartialParsimony(node_nei, dad);
+    int score = computeJointParsimony(joint, node_nei->partial_pars, dad_pars, buffers[radius], subtree_pars);
+    if (score < best_score) {
+        best_score = score;
+        best_node = node;
+        best_dad = dad;
+    }
+    if (depth >= radius)
+        return;
+    FOR_NEIGHBOR_IT(node, dad, it) {
+        // the rest of the pruned tree seen from branch (node, child)
+        Node *other = NULL;
+        FOR_NEIGHBOR_IT(node, dad, it2)
+            if (it2 != it)
+                other = (*it2)->node;
+        PhyloNeighbor *other_nei = (PhyloNeighbor*)node->findNeighbor(other);
+        computePartialParsimony(other_nei, node);
+        computeJointParsimony(joint, dad_pars, other_nei->partial_pars, buffers[depth], NULL);
+        searchSPRParsimony((PhyloNode*)(*it)->node, node, buffers[depth], subtree_pars, depth+1, radius,
+            joint, buffers, best_score, best_node, best_dad);
+    }
+}
+
+int PhyloTree::evaluateSPRParsimony(PhyloNode *p, PhyloNode *s, int radius, PhyloNode *joint, UINT **buffers,
+        PhyloNode* &best_node, PhyloNode* &best_dad) {
+    best_node = best_dad = NULL;
+    PhyloNode *side[2];
+    int i = 0;
+    FOR_NEIGHBOR_IT(p, s, it)
+        side[i++] = (PhyloNode*)(*it)->node;
+    PhyloNeighbor *subtree_nei = (PhyloNeighbor*)p->findNeighbor(s);
+    PhyloNeighbor *side_nei[2];
+    computePartialParsimony(subtree_nei, p);
+    for (i = 0; i < 2; i++) {
+        side_nei[i] = (PhyloNeighbor*)p->findNeighbor(side[i]);
+        computePartialParsimony(side_nei[i], p);
+    }
+    int cur_score = computeJointParsimony(joint, side_nei[0]->partial_pars, side_nei[1]->partial_pars,
+        buffers[radius], subtree_nei->partial_pars);
+    int best_score = cur_score;
+    // regraft on branches of the pruned tree, where side[0] and side[1] are joined directly
+    for (i = 0; i < 2; i++) {
+        PhyloNode *node = side[i];
+        UINT *opposite_pars = side_nei[1-i]->partial_pars;
+        FOR_NEIGHBOR_IT(node, p, it) {
+            Node *other = NULL;
+            FOR_NEIGHBOR_IT(node, p, it2)
+                if (it2 != it)
+                    other = (*it2)->node;
+            PhyloNeighbor *other_nei = (PhyloNeighbor*)node->findNeighbor(other);
+            computePartialParsimony(other_nei, node);
+            computeJointParsimony(joint, opposite_pars, other_nei->partial_pars, buffers[0], NULL);
+            searchSPRParsimony((PhyloNode*)(*it)->node, node, buffers[0], subtree_nei->partial_pars, 1, radius,
+                joint, buffers, best_score, best_node, best_dad);
+        }
+    }
+    return cur_score - best_score;
+}
+
+void PhyloTree::clearReversePartialParsimony(PhyloNode *node, PhyloNode *dad, bool force) {
+    FOR_NEIGHBOR_IT(node, dad, it) {
+        PhyloNeighbor *nei = (PhyloNeighbor*)(*it)->node->findNeighbor(node);
+        if (!force && (nei->partial_lh_computed & 2) == 0)
+            continue;
+        nei->partial_lh_computed = 0;
+        clearReversePartialParsimony((PhyloNode*)(*it)->node, node, false);
+    }
+}
+
+int PhyloTree::optimizeSPRParsimony(int radius) {
+    int num_threads = 1;
+#ifdef _OPENMP
+    num_threads = omp_get_max_threads();
+#endif
+    int i;
+    vector<PhyloNode*> joints(num_threads);
+    vector<UINT*> buffers(num_threads * (radius+1));
+    for (i = 0; i < num_threads; i++)
+        joints[i] = newParsimonyJoint();
+    for (i = 0; i < buffers.size(); i++)
+        buffers[i] = newBitsBlock();
+
+    best_pars_score = INT_MAX;
+    best_pars_score = computeParsimony();
+    int start_score = best_pars_score;
+    int total_moves = 0;
+
+    while (true) {
+        // all vectors must be available before they are read concurrently
+        NodeVector nodes1, nodes2;
+        getBranches(nodes1, nodes2);
+        for (i = 0; i < nodes1.size(); i++) {
+            computePartialParsimony((PhyloNeighbor*)nodes2[i]->findNeighbor(nodes1[i]), (PhyloNode*)nodes2[i]);
+            computePartialParsimony((PhyloNeighbor*)nodes1[i]->findNeighbor(nodes2[i]), (PhyloNode*)nodes1[i]);
+        }
+        NodeVector nodes;
+        getInternalNodes(nodes);
+        vector<PhyloNode*> prune_p, prune_s;
+        for (i = 0; i < nodes.size(); i++)
+            FOR_NEIGHBOR_IT(nodes[i], NULL, it) {
+                prune_p.push_back((PhyloNode*)nodes[i]);
+                prune_s.push_back((PhyloNode*)(*it)->node);
+            }
+        int num_moves = prune_p.size();
+        IntVector gains(num_moves, 0);
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+        {
+            int thread_id = 0;
+#ifdef _OPENMP
+            thread_id = omp_get_thread_num();
+#pragma omp for schedule(dynamic, 16)
+#endif
+            for (int j = 0; j < num_moves; j++) {
+                PhyloNode *best_node, *best_dad;
+                gains[j] = evaluateSPRParsimony(prune_p[j], prune_s[j], radius, joints[thread_id],
+                    &buffers[thread_id * (radius+1)], best_node, best_dad);
+            }
+        }
+
+        // apply improving moves, largest gain first; earlier moves may change the
+        // gain of later ones, so each move is re-evaluated on the current tree
+        vector<pair<int,int> > order;
+        for (i = 0; i < num_moves; i++)
+            if (gains[i] > 0)
+                order.push_back(make_pair(-gains[i], i));
+        sort(order.begin(), order.end());
+        int applied = 0;
+        for (vector<pair<int,int> >::iterator oit = order.begin(); oit != order.end(); oit++) {
+            PhyloNode *p = prune_p[oit->second], *s = prune_s[oit->second];
+            if (!p->isNeighbor(s))
+                continue;
+            PhyloNode *u, *v;
+            int gain = evaluateSPRParsimony(p, s, radius, joints[0], &buffers[0], v, u);
+            if (gain <= 0)
+                continue;
+            // prune the subtree and join the two sides of p
+            PhyloNode *a = NULL, *b = NULL;
+            FOR_NEIGHBOR_IT(p, s, it)
+                if (!a) a = (PhyloNode*)(*it)->node; else b = (PhyloNode*)(*it)->node;
+            a->updateNeighbor(p, b, -1.0);
+            b->updateNeighbor(p, a, -1.0);
+            // regraft p onto branch (u,v)
+            u->updateNeighbor(v, p, -1.0);
+            v->updateNeighbor(u, p, -1.0);
+            p->updateNeighbor(a, u, -1.0);
+            p->updateNeighbor(b, v, -1.0);
+            // only vectors whose subtree contains p, a or b change; the walk from each
+            // of them ends where the previous moves already left invalid vectors
+            clearReversePartialParsimony(a, NULL, true);
+            clearReversePartialParsimony(b, NULL, true);
+            clearReversePartialParsimony(p, NULL, true);
+            ((PhyloNeighbor*)p->findNeighbor(u))->partial_lh_computed = 0;
+            ((PhyloNeighbor*)p->findNeighbor(v))->partial_lh_computed = 0;
+            best_pars_score -= gain;
+            applied++;
+        }
+        total_moves += applied;
+        if (!applied)
+            break;
+    }
+
+    for (i = 0; i < buffers.size(); i++)
+        aligned_free(buffers[i]);
+    for (i = 0; i < num_threads; i++)
+        deleteParsimonyJoint(joints[i]);
+    if (verbose_mode >= VB_MED)
+        cout << "Parsimony SPR: " << total_moves << " moves, score " << start_score << " -> " << best_pars_score << endl;
+    return best_pars_score;
+}
@@ -60,15 +60,20 @@ void PhyloTree::setParsimonyKernel(LikelihoodKernel lk) {
 void PhyloTree::setLikelihoodKernel(LikelihoodKernel lk) {
     setParsimonyKernel(lk);
 
-	if (instruction_set >= 7) {
+	if (instruction_set >= 9) {
+		setDotProductAVX512();
+	} else if (instruction_set >= 7) {
 		setDotProductAVX();
 	} else {
 #ifdef BOOT_VAL_FLOAT
 		dotProduct = &PhyloTree::dotProductSIMD<float, Vec4f, 4>;
+		dotProductMulti = &PhyloTree::dotProductMultiSIMD<float, Vec4f, 4>;
 #else
 		dotProduct = &PhyloTree::dotProductSIMD<double, Vec2d, 2>;
+		dotProductMulti = &PhyloTree::dotProductMultiSIMD<double, Vec2d, 2>;
 #endif
 		dotProductDouble = &PhyloTree::dotProductSIMD<double, Vec2d, 2>;
+		dotProductMatrix = &PhyloTree::dotProductMatrixSIMD<double, Vec2d, 2>;
 	}
 	sse = lk;
     if (!aln) {
@@ -79,6 +84,17 @@ void PhyloTree::setLikelihoodKernel(LikelihoodKernel lk) {
         sse = LK_EIGEN;
         return;
     }
+
+    // single-precision partial likelihoods are only implemented by the normal SIMD kernels
+    bool lh_float = params && params->lk_float && !force_double_lh && sse == LK_EIGEN_SSE &&
+        !(model_factory && (model_factory->model->isMixture() || model_factory->model->isSiteSpecificModel())) &&
+        (aln->num_states == 2 || aln->num_states == 4 || aln->num_states == 20 || aln->num_states == 64);
+    if (lh_float != partial_lh_float) {
+        // size of partial_lh vectors changes, re-allocate them when needed
+        if (central_partial_lh)
+            deleteAllPartialLh();
+        partial_lh_float = lh_float;
+    }
     
     if (model_factory && model_factory->model->isSiteSpecificModel()) {
         if (sse == LK_EIGEN) {
@@ -170,10 +186,17 @@ void PhyloTree::setLikelihoodKernel(LikelihoodKernel lk) {
 						computeLikelihoodFromBufferPointer = &PhyloTree::computeMixtureLikelihoodFromBufferEigenSIMD<Vec2d, 2, 4>;
 					}
 				} else {
-					computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<Vec2d, 2, 4>;
-					computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<Vec2d, 2, 4>;
-					computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<Vec2d, 2, 4>;
-					computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<Vec2d, 2, 4>;
+					if (partial_lh_float) {
+						computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<float, Vec2d, 2, 4>;
+						computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<float, Vec2d, 2, 4>;
+						computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<float, Vec2d, 2, 4>;
+						computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<float, Vec2d, 2, 4>;
+					} else {
+						computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<double, Vec2d, 2, 4>;
+						computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<double, Vec2d, 2, 4>;
+						computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<double, Vec2d, 2, 4>;
+						computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<double, Vec2d, 2, 4>;
+					}
 				}
 			}
 			break;
@@ -206,10 +229,17 @@ void PhyloTree::setLikelihoodKernel(LikelihoodKernel lk) {
 						computeLikelihoodFromBufferPointer = &PhyloTree::computeMixtureLikelihoodFromBufferEigenSIMD<Vec2d, 2, 20>;
 					}
 				} else {
-					computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<Vec2d, 2, 20>;
-					computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<Vec2d, 2, 20>;
-					computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<Vec2d, 2, 20>;
-					computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<Vec2d, 2, 20>;
+					if (partial_lh_float) {
+						computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<float, Vec2d, 2, 20>;
+						computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<float, Vec2d, 2, 20>;
+						computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<float, Vec2d, 2, 20>;
+						computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<float, Vec2d, 2, 20>;
+					} else {
+						computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<double, Vec2d, 2, 20>;
+						computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<double, Vec2d, 2, 20>;
+						computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<double, Vec2d, 2, 20>;
+						computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<double, Vec2d, 2, 20>;
+					}
 				}
 			}
 			break;
@@ -227,7 +257,10 @@ void PhyloTree::setLikelihoodKernel(LikelihoodKernel lk) {
 //			computeLikelihoodFromBufferPointer = NULL;
 //			break;
 		case LK_EIGEN_SSE:
-			if (instruction_set >= 7) {
+			if (instruction_set >= 9) {
+				// CPU supports AVX-512
+				setLikelihoodKernelAVX512();
+			} else if (instruction_set >= 7) {
 				setLikelihoodKernelAVX();
 			} else {
 				if (model_factory && model_factory->model->isMixture()) {
@@ -245,10 +278,17 @@ void PhyloTree::setLikelihoodKernel(LikelihoodKernel lk) {
 //						cout << "Fast-SSE-mixture" << endl;
 					}
 				} else {
-					computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<Vec2d, 2, 64>;
-					computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<Vec2d, 2, 64>;
-					computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<Vec2d, 2, 64>;
-					computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<Vec2d, 2, 64>;
+					if (partial_lh_float) {
+						computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<float, Vec2d, 2, 64>;
+						computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<float, Vec2d, 2, 64>;
+						computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<float, Vec2d, 2, 64>;
+						computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<float, Vec2d, 2, 64>;
+					} else {
+						computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<double, Vec2d, 2, 64>;
+						computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<double, Vec2d, 2, 64>;
+						computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<double, Vec2d, 2, 64>;
+						computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<double, Vec2d, 2, 64>;
+					}
 //					cout << "Fast-SSE" << endl;
 				}
 			}
@@ -268,10 +308,17 @@ void PhyloTree::setLikelihoodKernel(LikelihoodKernel lk) {
 //	        computeLikelihoodFromBufferPointer = NULL;
 //			break;
 		case LK_EIGEN_SSE:
-			computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<Vec2d, 2, 2>;
-			computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<Vec2d, 2, 2>;
-			computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<Vec2d, 2, 2>;
-	        computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<Vec2d, 2, 2>;
+			if (partial_lh_float) {
+				computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<float, Vec2d, 2, 2>;
+				computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<float, Vec2d, 2, 2>;
+				computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<float, Vec2d, 2, 2>;
+				computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<float, Vec2d, 2, 2>;
+			} else {
+				computeLikelihoodBranchPointer = &PhyloTree::computeLikelihoodBranchEigenSIMD<double, Vec2d, 2, 2>;
+				computeLikelihoodDervPointer = &PhyloTree::computeLikelihoodDervEigenSIMD<double, Vec2d, 2, 2>;
+				computePartialLikelihoodPointer = &PhyloTree::computePartialLikelihoodEigenSIMD<double, Vec2d, 2, 2>;
+				computeLikelihoodFromBufferPointer = &PhyloTree::computeLikelihoodFromBufferEigenSIMD<double, Vec2d, 2, 2>;
+			}
 			break;
 		default:
 			break;
@@ -310,6 +357,22 @@ void PhyloTree::setLikelihoodKernel(LikelihoodKernel lk) {
 	}
 }
 
+void PhyloTree::copyLikelihoodKernel(PhyloTree *master) {
+    sse = master->sse;
+    partial_lh_float = master->partial_lh_float;
+    force_double_lh = master->force_double_lh;
+    dotProduct = master->dotProduct;
+    dotProductMulti = master->dotProductMulti;
+    dotProductDouble = master->dotProductDouble;
+    dotProductMatrix = master->dotProductMatrix;
+    computeParsimonyBranchPointer = master->computeParsimonyBranchPointer;
+    computePartialParsimonyPointer = master->computePartialParsimonyPointer;
+    computeLikelihoodBranchPointer = master->computeLikelihoodBranchPointer;
+    computeLikelihoodDervPointer = master->computeLikelihoodDervPointer;
+    computePartialLikelihoodPointer = master->computePartialLikelihoodPointer;
+    computeLikelihoodFromBufferPointer = master->computeLikelihoodFromBufferPointer;
+}
+
 void PhyloTree::changeLikelihoodKernel(LikelihoodKernel lk) {
 	if (sse == lk) return;
 //	if ((sse == LK_EIGEN || sse == LK_EIGEN_SSE) && (lk == LK_NORMAL || lk == LK_SSE)) {
@@ -333,16 +396,48 @@ void PhyloTree::changeLikelihoodKernel(LikelihoodKernel lk) {
  ******************************************************/
 
 void PhyloTree::computePartialLikelihood(PhyloNeighbor *dad_branch, PhyloNode *dad) {
-	(this->*computePartialLikelihoodPointer)(dad_branch, dad);
+	if (params->lh_mem_limit && !central_partial_lh)
+		initializeAllPartialLh();
+	if (lh_pool_size)
+		computePartialLikelihoodPool(dad_branch, dad);
+	else
+		(this->*computePartialLikelihoodPointer)(dad_branch, dad);
 }
 
 double PhyloTree::computeLikelihoodBranch(PhyloNeighbor *dad_branch, PhyloNode *dad) {
-	return (this->*computeLikelihoodBranchPointer)(dad_branch, dad);
-
+	if (params->lh_mem_limit && !central_partial_lh)
+		initializeAllPartialLh();
+	if (!lh_pool_size)
+		return (this->*computeLikelihoodBranchPointer)(dad_branch, dad);
+	// both sides of the branch must stay in the pool while the kernel runs
+	PhyloNode *node = (PhyloNode*)dad_branch->node;
+	PhyloNeighbor *node_branch = (PhyloNeighbor*)node->findNeighbor(dad);
+	computePartialLikelihoodPool(dad_branch, dad);
+	pinPartialLh(dad_branch, 1);
+	computePartialLikelihoodPool(node_branch, node);
+	pinPartialLh(node_branch, 1);
+	double tree_lh = (this->*computeLikelihoodBranchPointer)(dad_branch, dad);
+	pinPartialLh(dad_branch, -1);
+	pinPartialLh(node_branch, -1);
+	return tree_lh;
 }
 
 void PhyloTree::computeLikelihoodDerv(PhyloNeighbor *dad_branch, PhyloNode *dad, double &df, double &ddf) {
+	if (params->lh_mem_limit && !central_partial_lh)
+		initializeAllPartialLh();
+	if (!lh_pool_size) {
+		(this->*computeLikelihoodDervPointer)(dad_branch, dad, df, ddf);
+		return;
+	}
+	PhyloNode *node = (PhyloNode*)dad_branch->node;
+	PhyloNeighbor *node_branch = (PhyloNeighbor*)node->findNeighbor(dad);
+	computePartialLikelihoodPool(dad_branch, dad);
+	pinPartialLh(dad_branch, 1);
+	computePartialLikelihoodPool(node_branch, node);
+	pinPartialLh(node_branch, 1);
 	(this->*computeLikelihoodDervPointer)(dad_branch, dad, df, ddf);
+	pinPartialLh(dad_branch, -1);
+	pinPartialLh(node_branch, -1);
 }
 
 
@@ -351,6 +446,8 @@ double PhyloTree::computeLikelihoodFromBuffer() {
 
 	if (computeLikelihoodFromBufferPointer)
 		return (this->*computeLikelihoodFromBufferPointer)();
+	else if (lh_pool_size)
+		return PhyloTree::computeLikelihoodBranch(current_it, (PhyloNode*)current_it_back->node);
 	else
 		return (this->*computeLikelihoodBranchPointer)(current_it, (PhyloNode*)current_it_back->node);
 
@@ -642,8 +739,8 @@ void PhyloTree::computePartialLikelihoodEigen(PhyloNeighbor *dad_branch, PhyloNo
     }
 
     // precompute buffer to save times
-    double *echildren = new double[block*nstates*(node->degree()-1)];
-    double *partial_lh_leaves = new double[(aln->STATE_UNKNOWN+1)*block*(node->degree()-1)];
+    double *echildren = getKernelBuffer((block*nstates + (aln->STATE_UNKNOWN+1)*block) * (node->degree()-1));
+    double *partial_lh_leaves = echildren + block*nstates*(node->degree()-1);
     double *echild = echildren;
     double *partial_lh_leaf = partial_lh_leaves;
 
@@ -1005,8 +1102,6 @@ void PhyloTree::computePartialLikelihoodEigen(PhyloNeighbor *dad_branch, PhyloNo
 
 	}
 
-    delete [] partial_lh_leaves;
-    delete [] echildren;
 }
 
 //template <const int nstates>
@@ -1081,9 +1176,9 @@ void PhyloTree::computeLikelihoodDervEigen(PhyloNeighbor *dad_branch, PhyloNode
 		theta_computed = true;
 	}
 
-    double *val0 = new double[block];
-    double *val1 = new double[block];
-    double *val2 = new double[block];
+    double *val0 = getKernelBuffer(3*block);
+    double *val1 = val0 + block;
+    double *val2 = val0 + 2*block;
 	for (c = 0; c < ncat; c++) {
 		double prop = site_rate->getProp(c);
 		for (i = 0; i < nstates; i++) {
@@ -1149,9 +1244,6 @@ void PhyloTree::computeLikelihoodDervEigen(PhyloNeighbor *dad_branch, PhyloNode
     }
 
 
-    delete [] val2;
-    delete [] val1;
-    delete [] val0;
 }
 
 //template <const int nstates>
@@ -1186,7 +1278,7 @@ double PhyloTree::computeLikelihoodBranchEigen(PhyloNeighbor *dad_branch, PhyloN
     double *eval = model->getEigenvalues();
     assert(eval);
 
-    double *val = new double[block];
+    double *val = getKernelBuffer(block + (aln->STATE_UNKNOWN+1)*block);
 	for (c = 0; c < ncat; c++) {
 		double len = site_rate->getRate(c)*dad_branch->length;
 		double prop = site_rate->getProp(c);
@@ -1199,7 +1291,7 @@ double PhyloTree::computeLikelihoodBranchEigen(PhyloNeighbor *dad_branch, PhyloN
 
     if (dad->isLeaf()) {
     	// special treatment for TIP-INTERNAL NODE case
-    	double *partial_lh_node = new double[(aln->STATE_UNKNOWN+1)*block];
+    	double *partial_lh_node = val + block;
     	IntVector states_dad = aln->seq_states[dad->id];
     	states_dad.push_back(aln->STATE_UNKNOWN);
     	// precompute information from one tip
@@ -1248,7 +1340,6 @@ double PhyloTree::computeLikelihoodBranchEigen(PhyloNeighbor *dad_branch, PhyloN
 				prob_const += lh_ptn;
 			}
 		}
-		delete [] partial_lh_node;
     } else {
     	// both dad and node are internal nodes
 #ifdef _OPENMP
@@ -1334,7 +1425,6 @@ double PhyloTree::computeLikelihoodBranchEigen(PhyloNeighbor *dad_branch, PhyloN
 
 	assert(!isnan(tree_lh) && !isinf(tree_lh));
 
-    delete [] val;
     return tree_lh;
 }
 
@@ -1411,8 +1501,8 @@ void PhyloTree::computeMixratePartialLikelihoodEigen(PhyloNeighbor *dad_branch,
     }        
         
     // precompute buffer to save times
-    double *echildren = new double[block*nstates*(node->degree()-1)];
-    double *partial_lh_leaves = new double[(aln->STATE_UNKNOWN+1)*block*(node->degree()-1)];
+    double *echildren = getKernelBuffer((block*nstates + (aln->STATE_UNKNOWN+1)*block) * (node->degree()-1));
+    double *partial_lh_leaves = echildren + block*nstates*(node->degree()-1);
     double *echild = echildren;
     double *partial_lh_leaf = partial_lh_leaves;
 
@@ -1748,8 +1838,6 @@ void PhyloTree::computeMixratePartialLikelihoodEigen(PhyloNeighbor *dad_branch,
 
 	}
 
-    delete [] partial_lh_leaves;
-    delete [] echildren;
 }
 
 //template <const int nstates>
@@ -1816,9 +1904,9 @@ void PhyloTree::computeMixrateLikelihoodDervEigen(PhyloNeighbor *dad_branch, Phy
 		theta_computed = true;
 	}
 
-    double *val0 = new double[block];
-    double *val1 = new double[block];
-    double *val2 = new double[block];
+    double *val0 = getKernelBuffer(3*block);
+    double *val1 = val0 + block;
+    double *val2 = val0 + 2*block;
 	for (c = 0; c < ncat; c++) {
 		double prop = site_rate->getProp(c);
 		for (i = 0; i < nstates; i++) {
@@ -1883,9 +1971,6 @@ void PhyloTree::computeMixrateLikelihoodDervEigen(PhyloNeighbor *dad_branch, Phy
     }
 
 
-    delete [] val2;
-    delete [] val1;
-    delete [] val0;
 }
 
 //template <const int nstates>
@@ -1920,7 +2005,7 @@ double PhyloTree::computeMixrateLikelihoodBranchEigen(PhyloNeighbor *dad_branch,
     double *eval = model->getEigenvalues();
     assert(eval);
 
-    double *val = new double[block];
+    double *val = getKernelBuffer(block + (aln->STATE_UNKNOWN+1)*block);
 	for (c = 0; c < ncat; c++) {
 		double len = site_rate->getRate(c)*dad_branch->length;
 		double prop = site_rate->getProp(c);
@@ -1933,7 +2018,7 @@ double PhyloTree::computeMixrateLikelihoodBranchEigen(PhyloNeighbor *dad_branch,
 
     if (dad->isLeaf()) {
     	// special treatment for TIP-INTERNAL NODE case
-    	double *partial_lh_node = new double[(aln->STATE_UNKNOWN+1)*block];
+    	double *partial_lh_node = val + block;
     	IntVector states_dad = aln->seq_states[dad->id];
     	states_dad.push_back(aln->STATE_UNKNOWN);
     	// precompute information from one tip
@@ -1975,7 +2060,6 @@ double PhyloTree::computeMixrateLikelihoodBranchEigen(PhyloNeighbor *dad_branch,
 				prob_const += lh_ptn;
 			}
 		}
-		delete [] partial_lh_node;
     } else {
     	// both dad and node are internal nodes
 #ifdef _OPENMP
@@ -2024,7 +2108,6 @@ double PhyloTree::computeMixrateLikelihoodBranchEigen(PhyloNeighbor *dad_branch,
 
 	assert(!isnan(tree_lh) && !isinf(tree_lh));
 
-    delete [] val;
     return tree_lh;
 }
 
@@ -2100,8 +2183,8 @@ void PhyloTree::computeMixturePartialLikelihoodEigen(PhyloNeighbor *dad_branch,
     }
 
         
-    double *echildren = new double[block*nstates*(node->degree()-1)];
-    double *partial_lh_leaves = new double[(aln->STATE_UNKNOWN+1)*block*(node->degree()-1)];
+    double *echildren = getKernelBuffer((block*nstates + (aln->STATE_UNKNOWN+1)*block) * (node->degree()-1));
+    double *partial_lh_leaves = echildren + block*nstates*(node->degree()-1);
     double *echild = echildren;
     double *partial_lh_leaf = partial_lh_leaves;
 
@@ -2397,8 +2480,6 @@ void PhyloTree::computeMixturePartialLikelihoodEigen(PhyloNeighbor *dad_branch,
 
 	}
     
-    delete [] partial_lh_leaves;
-	delete [] echildren;
 }
 
 //template <const int nstates>
@@ -2471,9 +2552,9 @@ void PhyloTree::computeMixtureLikelihoodDervEigen(PhyloNeighbor *dad_branch, Phy
 		theta_computed = true;
 	}
 
-    double *val0 = new double[block];
-    double *val1 = new double[block];
-    double *val2 = new double[block];
+    double *val0 = getKernelBuffer(3*block);
+    double *val1 = val0 + block;
+    double *val2 = val0 + 2*block;
 	for (c = 0; c < ncat; c++) {
 		double prop = site_rate->getProp(c);
 		for (m = 0; m < nmixture; m++) {
@@ -2540,9 +2621,6 @@ void PhyloTree::computeMixtureLikelihoodDervEigen(PhyloNeighbor *dad_branch, Phy
     }
 
 
-    delete [] val2;
-    delete [] val1;
-    delete [] val0;
 }
 
 //template <const int nstates>
@@ -2579,7 +2657,7 @@ double PhyloTree::computeMixtureLikelihoodBranchEigen(PhyloNeighbor *dad_branch,
     double *eval = model->getEigenvalues();
     assert(eval);
 
-    double *val = new double[block];
+    double *val = getKernelBuffer(block + (aln->STATE_UNKNOWN+1)*block);
 	for (c = 0; c < ncat; c++) {
 		double len = site_rate->getRate(c)*dad_branch->length;
 		double prop = site_rate->getProp(c);
@@ -2594,7 +2672,7 @@ double PhyloTree::computeMixtureLikelihoodBranchEigen(PhyloNeighbor *dad_branch,
 
     if (dad->isLeaf()) {
     	// special treatment for TIP-INTERNAL NODE case
-    	double *partial_lh_node = new double[(aln->STATE_UNKNOWN+1)*block];
+    	double *partial_lh_node = val + block;
     	IntVector states_dad = aln->seq_states[dad->id];
     	states_dad.push_back(aln->STATE_UNKNOWN);
     	// precompute information from one tip
@@ -2647,7 +2725,6 @@ double PhyloTree::computeMixtureLikelihoodBranchEigen(PhyloNeighbor *dad_branch,
 				prob_const += lh_ptn;
 			}
 		}
-		delete [] partial_lh_node;
     } else {
     	// both dad and node are internal nodes
 #ifdef _OPENMP
@@ -2698,6 +2775,5 @@ double PhyloTree::computeMixtureLikelihoodBranchEigen(PhyloNeighbor *dad_branch,
 
 	assert(!isnan(tree_lh) && !isinf(tree_lh));
 
-    delete [] val;
     return tree_lh;
 }
@@ -714,6 +714,7 @@ void parseArg(int argc, char *argv[], Params &params) {
     params.gurobi_format = true;
     params.gurobi_threads = 1;
     params.num_bootstrap_samples = 0;
+    params.num_boot_jobs = 1;
     params.bootstrap_spec = NULL;
 
     params.aln_file = NULL;
@@ -743,6 +744,9 @@ void parseArg(int argc, char *argv[], Params &params) {
     params.loglh_epsilon = 0.001;
     params.numSmoothTree = 1;
     params.nni5 = true;
+    params.nni_parallel = false;
+    params.num_search_walkers = 1;
+    params.mpi_sync_iterations = 10;
     params.leastSquareBranch = false;
     params.pars_branch_length = false;
     params.bayes_branch_length = false;
@@ -766,10 +770,13 @@ void parseArg(int argc, char *argv[], Params &params) {
     params.model_def_file = NULL;
     params.model_test_again = false;
     params.model_test_and_tree = 0;
+    params.model_test_parallel = false;
+    params.model_test_race = 0.0;
     params.model_test_separate_rate = false;
     params.optimize_mixmodel_weight = false;
     params.optimize_rate_matrix = false;
     params.store_trans_matrix = false;
+    params.trans_matrix_cache_size = 64;
     //params.freq_type = FREQ_EMPIRICAL;
     params.freq_type = FREQ_UNKNOWN;
     params.min_rate_cats = 2;
@@ -800,6 +807,8 @@ void parseArg(int argc, char *argv[], Params &params) {
     params.localbp_replicates = 0;
     params.SSE = LK_EIGEN_SSE;
     params.lk_no_avx = false;
+    params.lk_no_avx512 = false;
+    params.lk_float = false;
     params.print_site_lh = WSL_NONE;
     params.print_site_state_freq = 0;
     params.print_site_rate = false;
@@ -884,6 +893,7 @@ void parseArg(int argc, char *argv[], Params &params) {
     params.numSupportTrees = 20;
 //    params.sprDist = 20;
     params.sprDist = 6;
+    params.pars_parallel = false;
     params.numNNITrees = 20;
     params.avh_test = 0;
     params.bootlh_test = 0;
@@ -905,6 +915,7 @@ void parseArg(int argc, char *argv[], Params &params) {
 	params.count_trees = false;
 	params.print_branch_lengths = false;
 	params.lh_mem_save = LM_PER_NODE; // auto detect
+	params.lh_mem_limit = 0;
 	params.start_tree = STT_PLL_PARSIMONY;
 	params.print_splits_file = false;
     params.ignore_identical_seqs = true;
@@ -919,6 +930,7 @@ void parseArg(int argc, char *argv[], Params &params) {
     params.link_alpha = false;
     params.ignore_checkpoint = false;
     params.checkpoint_dump_interval = 20;
+    params.checkpoint_binary = false;
     params.force_unfinished = false;
 
 
@@ -1794,6 +1806,19 @@ void parseArg(int argc, char *argv[], Params &params) {
 				params.model_test_and_tree = 1;
 				continue;
 			}
+			if (strcmp(argv[cnt], "-mpar") == 0) {
+				params.model_test_parallel = true;
+				continue;
+			}
+			if (strcmp(argv[cnt], "-mrace") == 0) {
+				cnt++;
+				if (cnt >= argc)
+					throw "Use -mrace <lnL_slack_per_parameter>";
+				params.model_test_race = convert_double(argv[cnt]);
+				if (params.model_test_race <= 0.0)
+					throw "-mrace slack must be positive";
+				continue;
+			}
 			if (strcmp(argv[cnt], "-mretree") == 0) {
 				params.model_test_and_tree = 2;
 				continue;
@@ -1839,6 +1864,15 @@ void parseArg(int argc, char *argv[], Params &params) {
 				params.store_trans_matrix = true;
 				continue;
 			}
+			if (strcmp(argv[cnt], "-mstoresize") == 0) {
+				cnt++;
+				if (cnt >= argc)
+					throw "Use -mstoresize <cache_size_in_MB>";
+				params.trans_matrix_cache_size = convert_int(argv[cnt]);
+				if (params.trans_matrix_cache_size <= 0)
+					throw "Transition matrix cache size must be positive";
+				continue;
+			}
 			if (strcmp(argv[cnt], "-nni_lh") == 0) {
 				params.nni_lh = true;
 				continue;
@@ -1871,6 +1905,14 @@ void parseArg(int argc, char *argv[], Params &params) {
 				params.lk_no_avx = true;
 				continue;
 			}
+			if (strcmp(argv[cnt], "-noavx512") == 0) {
+				params.lk_no_avx512 = true;
+				continue;
+			}
+			if (strcmp(argv[cnt], "-float") == 0) {
+				params.lk_float = true;
+				continue;
+			}
 			if (strcmp(argv[cnt], "-f") == 0) {
 				cnt++;
 				if (cnt >= argc)
@@ -2041,6 +2083,15 @@ void parseArg(int argc, char *argv[], Params &params) {
 					throw "Wrong number of threads";
 				continue;
 			}
+			if (strcmp(argv[cnt], "-bjobs") == 0) {
+				cnt++;
+				if (cnt >= argc)
+					throw "Use -bjobs <num_concurrent_replicates>";
+				params.num_boot_jobs = convert_int(argv[cnt]);
+				if (params.num_boot_jobs < 1)
+					throw "Wrong number of concurrent bootstrap replicates";
+				continue;
+			}
 			if (strcmp(argv[cnt], "-b") == 0 || strcmp(argv[cnt], "-bo") == 0) {
 				params.multi_tree = true;
 				if (strcmp(argv[cnt], "-bo") == 0)
@@ -2462,6 +2513,32 @@ void parseArg(int argc, char *argv[], Params &params) {
 				params.lh_mem_save = LM_ALL_BRANCH;
 				continue;
 			}
+			if (strcmp(argv[cnt], "-mem") == 0) {
+				cnt++;
+				if (cnt >= argc)
+					throw "Use -mem <max_memory>, e.g. -mem 16G or -mem 50%";
+				int end_pos;
+				double mem = convert_double(argv[cnt], end_pos);
+				string unit = argv[cnt] + end_pos;
+				if (unit == "%")
+					mem = mem / 100.0 * getMemorySize();
+				else if (unit == "T" || unit == "TB")
+					mem *= 1024.0 * 1024.0 * 1024.0 * 1024.0;
+				else if (unit == "G" || unit == "GB")
+					mem *= 1024.0 * 1024.0 * 1024.0;
+				else if (unit == "M" || unit == "MB" || unit == "")
+					mem *= 1024.0 * 1024.0;
+				else if (unit == "K" || unit == "KB")
+					mem *= 1024.0;
+				else
+					throw "Unknown unit for -mem: " + unit;
+				if (mem <= 0.0)
+					throw "Memory limit (-mem) must be positive";
+				params.lh_mem_limit = (uint64_t)mem;
+				// the memory pool builds upon the per-node memory saving technique
+				params.lh_mem_save = LM_PER_NODE;
+				continue;
+			}
 //			if (strcmp(argv[cnt], "-storetrees") == 0) {
 //				params.store_candidate_trees = true;
 //				continue;
@@ -2631,6 +2708,28 @@ void parseArg(int argc, char *argv[], Params &params) {
 				params.reinsert_par = true;
 				continue;
 			}
+			if (strcmp(argv[cnt], "-walkers") == 0) {
+				cnt++;
+				if (cnt >= argc)
+					throw "Use -walkers <number_of_walkers>";
+				params.num_search_walkers = convert_int(argv[cnt]);
+				if (params.num_search_walkers < 1)
+					throw "Number of walkers must be positive";
+				continue;
+			}
+			if (strcmp(argv[cnt], "-mpisync") == 0) {
+				cnt++;
+				if (cnt >= argc)
+					throw "Use -mpisync <number_of_iterations>";
+				params.mpi_sync_iterations = convert_int(argv[cnt]);
+				if (params.mpi_sync_iterations < 1)
+					throw "Number of iterations between tree exchanges must be positive";
+				continue;
+			}
+			if (strcmp(argv[cnt], "-nnipar") == 0) {
+				params.nni_parallel = true;
+				continue;
+			}
 			if (strcmp(argv[cnt], "-allnni") == 0) {
 				params.speednni = false;
 				continue;
@@ -2837,6 +2936,10 @@ void parseArg(int argc, char *argv[], Params &params) {
 				params.sprDist = convert_int(argv[cnt]);
 				continue;
 			}
+			if (strcmp(argv[cnt], "-parspar") == 0) {
+				params.pars_parallel = true;
+				continue;
+			}
 			if (strcmp(argv[cnt], "-no_rescale_gamma_invar") == 0) {
 				params.no_rescale_gamma_invar = true;
 				continue;
@@ -2922,6 +3025,11 @@ void parseArg(int argc, char *argv[], Params &params) {
 				continue;
 			}
 
+			if (strcmp(argv[cnt], "-cpbin") == 0) {
+				params.checkpoint_binary = true;
+				continue;
+			}
+
 			if (argv[cnt][0] == '-') {
                 string err = "Invalid \"";
                 err += argv[cnt];
@@ -3066,12 +3174,15 @@ void usage_iqtree(char* argv[], bool full_command) {
 #ifdef _OPENMP
             << "  -nt <#cpu_cores>     Number of cores/threads to use (REQUIRED)" << endl
 #endif
+            << "  -mem <max_RAM>       Maximum RAM for likelihood vectors, e.g. 16G or 50%" << endl
+            << "                       (vectors not fitting are recomputed on demand)" << endl
             << "  -seed <number>       Random seed number, normally used for debugging purpose" << endl
             << "  -v, -vv, -vvv        Verbose mode, printing more messages to screen" << endl
             << "  -keep-ident          Keep identical sequences (default: remove & finally add)" << endl
             << endl << "CHECKPOINTING TO RESUME STOPPED RUN:" << endl
             << "  -redo                Redo analysis even for successful runs (default: resume)" << endl
             << "  -cptime <seconds>    Minimum checkpoint time interval (default: 20)" << endl
+            << "  -cpbin               Binary checkpoint file, written incrementally in background" << endl
             << endl << "LIKELIHOOD MAPPING ANALYSIS:" << endl
             << "  -lmap <#quartets>    Number of quartets for likelihood mapping analysis" << endl
             << "  -lmclust <clustfile> NEXUS file containing clusters for likelihood mapping" << endl
@@ -3080,10 +3191,17 @@ void usage_iqtree(char* argv[], bool full_command) {
 //            << "  -pll                 Use phylogenetic likelihood library (PLL) (default: off)" << endl
             << "  -numpars <number>    Number of initial parsimony trees (default: 100)" << endl
             << "  -toppars <number>    Number of best parsimony trees (default: 20)" << endl
-            << "  -sprrad <number>     Radius for parsimony SPR search (default: 6)" << endl
+            << "  -sprrad <number>     Radius for parsimony SPR search (default: 6, 0 to skip" << endl
+            << "                       the SPR refinement of -parspar)" << endl
+            << "  -parspar             Parallel stepwise addition and SPR (within -sprrad)" << endl
+            << "                       for parsimony trees" << endl
             << "  -numcand <number>    Size of the candidate tree set (defaut: 5)" << endl
             << "  -pers <proportion>   Perturbation strength for randomized NNI (default: 0.5)" << endl
             << "  -allnni              Perform more thorough NNI search (default: off)" << endl
+            << "  -nnipar              Evaluate NNIs on different branches in parallel (with -nt)," << endl
+            << "                       implies -nolhmemsave; not used with -bb, -mem or partitions" << endl
+            << "  -walkers <number>    Number of perturbation+NNI walkers per round (default: 1)" << endl
+            << "  -mpisync <number>    Iterations between tree exchanges of MPI processes (default: 10)" << endl
             << "  -numstop <number>    Number of unsuccessful iterations to stop (default: 100)" << endl
             << "  -n <#iterations>     Fix number of iterations to <#iterations> (default: auto)" << endl
             << "  -iqp                 Use the IQP tree perturbation (default: randomized NNI)" << endl
@@ -3101,6 +3219,8 @@ void usage_iqtree(char* argv[], bool full_command) {
             << "  -b <#replicates>     Bootstrap + ML tree + consensus tree (>=100)" << endl
             << "  -bc <#replicates>    Bootstrap + consensus tree" << endl
             << "  -bo <#replicates>    Bootstrap only" << endl
+            << "  -bjobs <num>         Run <num> bootstrap replicates concurrently, sharing -nt threads" << endl
+            << "                       (replicate searches use the replicate seed, so trees differ from -b alone)" << endl
 //            << "  -t <threshold>       Minimum bootstrap support [0...1) for consensus tree" << endl
             << endl << "SINGLE BRANCH TEST:" << endl
             << "  -alrt <#replicates>  SH-like approximate likelihood ratio test (SH-aLRT)" << endl
@@ -3132,6 +3252,9 @@ void usage_iqtree(char* argv[], bool full_command) {
             << "  –merit AIC|AICc|BIC  Optimality criterion to use (default: all)" << endl
 //            << "  -msep                Perform model selection and then rate selection" << endl
             << "  -mtree               Performing full tree search for each model considered" << endl
+            << "  -mpar                Evaluate independent models concurrently (with -nt)" << endl
+            << "  -mrace <slack>       Drop models that cannot beat the best after one round" << endl
+            << "                       of optimization even with +<slack> lnL per parameter" << endl
             << "  -mredo               Ignoring model results computed earlier (default: no)" << endl
             << "  -madd mx1,...,mxk    List of mixture models to also consider" << endl
             << "  -mdef <nexus_file>   A model definition NEXUS file (see Manual)" << endl
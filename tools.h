@@ -490,6 +490,12 @@ public:
 	 */
 	int sprDist;
 
+	/**
+	 *  TRUE to score insertion branches of stepwise-addition parsimony in parallel
+	 *  and to refine the parsimony tree by SPR moves within sprDist
+	 */
+	bool pars_parallel;
+
 	/**
 	 *  Number of NNI locally optimal trees generated from the set of parsimony trees
 	 *  Default = 20 (out of 100 parsimony trees)
@@ -553,6 +559,24 @@ public:
 	 */
 	bool nni5;
 
+	/**
+	 *  TRUE to evaluate NNIs of independent branches concurrently (one thread per branch)
+	 *  instead of parallelizing each evaluation over patterns
+	 */
+	bool nni_parallel;
+
+	/**
+	 *  Number of independent perturbation+NNI walkers run concurrently in each
+	 *  round of the stochastic tree search (DEFAULT: 1, i.e. serial search)
+	 */
+	int num_search_walkers;
+
+	/**
+	 *  Number of iterations between two exchanges of candidate trees between the
+	 *  processes of the distributed (MPI) tree search (DEFAULT: 10)
+	 */
+	int mpi_sync_iterations;
+
     /**
      *  Number of branch length optimization rounds performed after
      *  each NNI step (DEFAULT: 1)
@@ -1158,6 +1182,13 @@ public:
         */
     short int model_test_and_tree;
 
+    /** TRUE to evaluate independent candidate models concurrently, each on its own tree copy */
+    bool model_test_parallel;
+
+    /** racing slack in log-likelihood units per free parameter: after one optimization round,
+        drop a candidate model if its lnL plus this slack still cannot beat the best score (0: no racing) */
+    double model_test_race;
+
     /** true to fist test equal rate model, then test rate heterogeneity (default: false) */
     bool model_test_separate_rate;
 
@@ -1172,6 +1203,11 @@ public:
      */
     bool store_trans_matrix;
 
+    /**
+            maximal memory in MB of the transition matrix cache (-mstoresize)
+     */
+    int trans_matrix_cache_size;
+
     /**
             state frequency type
      */
@@ -1256,6 +1292,12 @@ public:
      */
     int num_bootstrap_samples;
 
+    /**
+     *  number of standard bootstrap replicates run concurrently, each with an equal
+     *  share of num_threads (DEFAULT: 1)
+     */
+    int num_boot_jobs;
+
     /** bootstrap specification of the form "l1:b1,l2:b2,...,lk:bk"
         to randomly draw b1 sites from the first l1 sites, etc. Note that l1+l2+...+lk
         must equal m, where m is the alignment length. Otherwise, an error will occur.
@@ -1335,6 +1377,15 @@ public:
     /** TRUE to not use AVX even available in CPU, default: FALSE */
     bool lk_no_avx;
 
+    /** TRUE to not use AVX-512 even available in CPU, default: FALSE */
+    bool lk_no_avx512;
+
+    /**
+        TRUE to store partial likelihoods in single precision during tree search
+        (the best tree is re-evaluated in double precision), default: FALSE
+     */
+    bool lk_float;
+
     /**
      	 	WSL_NONE: do not print anything
             WSL_SITE: print site log-likelihood
@@ -1673,6 +1724,12 @@ public:
 	 * 1: only store 1 partial likelihood vector per node */
 	LhMemSave lh_mem_save;
 
+	/**
+	 * maximum RAM in bytes for partial likelihood vectors (-mem option), 0 for no limit.
+	 * If exceeded, vectors are kept in a fixed pool and recomputed on demand.
+	 */
+	uint64_t lh_mem_limit;
+
 	/* TRUE to print .splits file in star-dot format */
 	bool print_splits_file;
     
@@ -1703,6 +1760,10 @@ public:
 
     /** time (in seconds) between checkpoint dump */
     int checkpoint_dump_interval;
+
+    /** TRUE to write binary, incremental checkpoint file in a background thread */
+    bool checkpoint_binary;
+
     /** TRUE to print quartet log-likelihoods to .quartetlh file */
     bool print_lmap_quartet_lh;
 